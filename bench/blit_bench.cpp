@@ -0,0 +1,113 @@
+#include "../src/blit.h"
+#include "../src/format.h"
+#include <chrono>
+#include <iostream>
+
+/** Compares palette expansion and blitting kernels with naive per-pixel loops
+ * on a frame-sized pixmap.
+ */
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(const Clock::time_point & start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+Chthon::Pixmap make_sprite(unsigned width, unsigned height, unsigned color_count)
+{
+	Chthon::Pixmap pixmap(width, height, color_count);
+	for(unsigned i = 1; i < color_count; ++i) {
+		pixmap.palette[i] = Chthon::from_rgb(uint8_t(i * 7), uint8_t(i * 13), uint8_t(i * 29));
+	}
+	unsigned x = 0;
+	for(unsigned & pixel : pixmap.pixels) {
+		pixel = (x / 3 + x / 1024) % color_count;
+		++x;
+	}
+	return pixmap;
+}
+
+void report(const std::string & name, size_t pixel_count, double time)
+{
+	double megapixels = double(pixel_count) / 1000000.0;
+	std::cout << Chthon::format("{0}: {1} Mpx/s", name, int(megapixels / time)) << std::endl;
+}
+
+}
+
+int main()
+{
+	const unsigned width = 1024, height = 1024, frames = 8;
+	const size_t pixel_count = size_t(width) * height * frames;
+	Chthon::Pixmap sprite = make_sprite(width, height, 16);
+	std::vector<uint32_t> source(width * height), frame(width * height, 0xff000000);
+	Chthon::ARGBBuffer source_buffer(source.data(), width, height);
+	Chthon::ARGBBuffer frame_buffer(frame.data(), width, height);
+
+	Clock::time_point start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		for(unsigned y = 0; y < height; ++y) {
+			for(unsigned x = 0; x < width; ++x) {
+				unsigned index = sprite.pixels.cell(int(x), int(y));
+				source[x + y * width] = index < sprite.palette.size() ? sprite.palette[index] : 0;
+			}
+		}
+	}
+	report("expand, naive", pixel_count, seconds_since(start));
+	start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		Chthon::expand_pixmap(sprite, source_buffer);
+	}
+	report("expand", pixel_count, seconds_since(start));
+	Chthon::PixelMap compact_sprite(sprite.pixels);
+	start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		Chthon::expand_pixmap(compact_sprite, sprite.palette, source_buffer);
+	}
+	report("expand, byte indices", pixel_count, seconds_since(start));
+
+	start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		for(size_t j = 0; j < frame.size(); ++j) {
+			if(!Chthon::is_transparent(source[j])) {
+				frame[j] = source[j];
+			}
+		}
+	}
+	report("color key blit, naive", pixel_count, seconds_since(start));
+	start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		Chthon::blit(source_buffer, frame_buffer, 0, 0);
+	}
+	report("color key blit", pixel_count, seconds_since(start));
+	start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		Chthon::blit(sprite, frame_buffer, 0, 0);
+	}
+	report("color key blit from pixmap", pixel_count, seconds_since(start));
+
+	for(size_t j = 0; j < source.size(); ++j) {
+		source[j] = (source[j] & 0xffffff) | (uint32_t(j % 251) << 24);
+	}
+	start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		for(size_t j = 0; j < frame.size(); ++j) {
+			uint32_t alpha = source[j] >> 24, result = 0;
+			for(unsigned shift = 0; shift < 32; shift += 8) {
+				uint32_t channel = shift == 24 ? 255 : (source[j] >> shift) & 0xff;
+				result |= ((channel * alpha + ((frame[j] >> shift) & 0xff) * (255 - alpha) + 127) / 255) << shift;
+			}
+			frame[j] = result;
+		}
+	}
+	report("alpha blit, naive", pixel_count, seconds_since(start));
+	start = Clock::now();
+	for(unsigned i = 0; i < frames; ++i) {
+		Chthon::blit(source_buffer, frame_buffer, 0, 0, Chthon::BLEND_ALPHA);
+	}
+	report("alpha blit", pixel_count, seconds_since(start));
+	return 0;
+}
@@ -0,0 +1,131 @@
+#include "../src/compress.h"
+#include "../src/files.h"
+#include "../src/map.h"
+#include "../src/format.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+/** Compares text savefile path with and without compression.
+ * Stores large map the way levels are stored and reports size ratio and speed.
+ * Fails if decompressed data differs from the original.
+ */
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(const Clock::time_point & start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+Chthon::Map<int> make_map(unsigned width, unsigned height)
+{
+	Chthon::Map<int> map(width, height);
+	unsigned x = 0;
+	for(int & cell : map) {
+		cell = (x % 17 == 0 || x % 23 == 0) ? 2 : 1;
+		++x;
+	}
+	return map;
+}
+
+void write_map(std::ostream & out, const Chthon::Map<int> & map)
+{
+	Chthon::Writer writer(out);
+	store(writer, map);
+	writer.check("map");
+}
+
+void read_map(std::istream & in, Chthon::Map<int> & map)
+{
+	Chthon::Reader reader(in);
+	store(reader, map);
+	reader.check("map");
+}
+
+bool same_map(const Chthon::Map<int> & a, const Chthon::Map<int> & b)
+{
+	return a.width() == b.width() && a.height() == b.height() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+bool check_restored(const std::string & name, bool restored)
+{
+	if(!restored) {
+		std::cerr << name << ": decompressed data differs from the original." << std::endl;
+	}
+	return restored;
+}
+
+void report(const std::string & name, size_t text_size, size_t stored_size, double write_time, double read_time)
+{
+	double megabytes = double(text_size) / (1024.0 * 1024.0);
+	std::cout << Chthon::format("{0}: ratio {1}%, write {2} MB/s, read {3} MB/s",
+			name,
+			int(100.0 * double(stored_size) / double(text_size)),
+			int(megabytes / write_time),
+			int(megabytes / read_time)
+			) << std::endl;
+}
+
+}
+
+int main()
+{
+	const Chthon::Map<int> map = make_map(2048, 2048);
+
+	Clock::time_point start = Clock::now();
+	std::ostringstream text_out;
+	write_map(text_out, map);
+	double text_write_time = seconds_since(start);
+	std::string text = text_out.str();
+	start = Clock::now();
+	std::istringstream text_in(text);
+	Chthon::Map<int> restored;
+	read_map(text_in, restored);
+	double text_read_time = seconds_since(start);
+	if(!check_restored("text", same_map(restored, map))) {
+		return 1;
+	}
+	report("text", text.size(), text.size(), text_write_time, text_read_time);
+
+	unsigned thread_counts[] = {1, std::max(2u, std::thread::hardware_concurrency())};
+	for(unsigned threads : thread_counts) {
+		start = Clock::now();
+		std::ostringstream packed_out;
+		{
+			Chthon::CompressedOStream compressed(packed_out, threads);
+			write_map(compressed, map);
+		}
+		double write_time = seconds_since(start);
+		std::string packed = packed_out.str();
+		start = Clock::now();
+		std::istringstream packed_in(packed);
+		Chthon::CompressedIStream decompressed(packed_in);
+		restored = Chthon::Map<int>();
+		read_map(decompressed, restored);
+		double read_time = seconds_since(start);
+		std::string name = Chthon::format("compressed, {0} threads", threads);
+		if(!check_restored(name, same_map(restored, map))) {
+			return 1;
+		}
+		report(name, text.size(), packed.size(), write_time, read_time);
+
+		start = Clock::now();
+		std::string block = Chthon::compress_block(text.data(), text.size());
+		double compress_time = seconds_since(start);
+		start = Clock::now();
+		std::string unpacked = Chthon::decompress_block(block.data(), block.size(), text.size());
+		double decompress_time = seconds_since(start);
+		if(!check_restored("raw blocks", unpacked == text)) {
+			return 1;
+		}
+		if(threads == 1) {
+			report("raw blocks", text.size(), block.size(), compress_time, decompress_time);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+#include "../src/pixmap.h"
+#include "../src/format.h"
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+/** Measures XPM decoding and encoding of large sprite sheet,
+ * and loading of sprite pack file by file compared to batch loading.
+ */
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(const Clock::time_point & start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+Chthon::Pixmap make_pixmap(unsigned width, unsigned height, unsigned color_count)
+{
+	Chthon::Pixmap pixmap(width, height, color_count);
+	for(unsigned i = 0; i < color_count; ++i) {
+		pixmap.palette[i] = Chthon::from_rgb(uint8_t(i * 7), uint8_t(i * 13), uint8_t(i * 29));
+	}
+	unsigned x = 0;
+	for(unsigned & pixel : pixmap.pixels) {
+		pixel = (x / 3 + x / 1024) % color_count;
+		++x;
+	}
+	return pixmap;
+}
+
+void report(const std::string & name, size_t pixel_count, double time)
+{
+	double megapixels = double(pixel_count) / 1000000.0;
+	std::cout << Chthon::format("{0}: {1} Mpx/s", name, int(megapixels / time)) << std::endl;
+}
+
+}
+
+int main()
+{
+	const unsigned width = 2048, height = 2048;
+	unsigned color_counts[] = {16, 64};
+	for(unsigned color_count : color_counts) {
+		Chthon::Pixmap pixmap = make_pixmap(width, height, color_count);
+		Clock::time_point start = Clock::now();
+		std::string xpm = pixmap.save();
+		report(Chthon::format("save, {0} colors", color_count), width * height, seconds_since(start));
+		Chthon::Pixmap loaded;
+		start = Clock::now();
+		loaded.load(xpm);
+		report(Chthon::format("load, {0} colors", color_count), width * height, seconds_since(start));
+	}
+
+	const unsigned file_count = 64, sprite_size = 256;
+	std::string xpm = make_pixmap(sprite_size, sprite_size, 64).save();
+	std::vector<std::string> filenames;
+	for(unsigned i = 0; i < file_count; ++i) {
+		filenames.push_back(Chthon::format("tmp/bench/sprite_{0}.xpm", i));
+		std::ofstream(filenames.back().c_str(), std::ios::binary) << xpm;
+	}
+	Clock::time_point start = Clock::now();
+	for(const std::string & filename : filenames) {
+		std::ifstream in(filename.c_str(), std::ios::binary);
+		std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		Chthon::Pixmap pixmap;
+		pixmap.load(data);
+	}
+	report(Chthon::format("load {0} files one by one", file_count), file_count * sprite_size * sprite_size, seconds_since(start));
+	start = Clock::now();
+	Chthon::load_pixmaps(filenames);
+	report(Chthon::format("load {0} files in batch", file_count), file_count * sprite_size * sprite_size, seconds_since(start));
+	for(const std::string & filename : filenames) {
+		std::remove(filename.c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,145 @@
+#include "../src/files.h"
+#include "../src/map.h"
+#include "../src/format.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+/** Compares loading of multi-level savefile by text Reader, BinaryReader and MappedReader.
+ * Each level is a map of cells and a list of names, like monsters and items of real levels.
+ */
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(const Clock::time_point & start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct BenchLevel {
+	Chthon::Map<int> map;
+	std::vector<std::string> names;
+};
+
+BenchLevel make_level(int index)
+{
+	BenchLevel level;
+	level.map = Chthon::Map<int>(256, 256);
+	unsigned x = 0;
+	for(int & cell : level.map) {
+		cell = int((x * 7 + unsigned(index)) % 13);
+		++x;
+	}
+	for(int i = 0; i < 2000; ++i) {
+		level.names.push_back(Chthon::format("creature #{0} of level {1}", i, index));
+	}
+	return level;
+}
+
+template<class Writer>
+void write_levels(const std::string & filename, const std::vector<BenchLevel> & levels)
+{
+	std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+	Writer writer(out);
+	for(const BenchLevel & level : levels) {
+		store(writer, level.map);
+		store(writer, level.names);
+	}
+	writer.check("levels");
+}
+
+template<class Reader>
+size_t read_levels(Reader & reader, size_t level_count)
+{
+	size_t name_count = 0;
+	Chthon::Map<int> map;
+	std::vector<std::string> names;
+	for(size_t i = 0; i < level_count; ++i) {
+		store(reader, map);
+		store(reader, names);
+		name_count += names.size();
+	}
+	reader.check("levels");
+	return name_count;
+}
+
+/// Names are read as views into the mapped file, without copying.
+size_t read_levels_as_views(Chthon::MappedReader & reader, size_t level_count)
+{
+	size_t name_count = 0;
+	Chthon::Map<int> map;
+	Chthon::StringView name;
+	for(size_t i = 0; i < level_count; ++i) {
+		store(reader, map);
+		unsigned count = 0;
+		reader.store(count);
+		for(unsigned j = 0; j < count; ++j) {
+			reader.store(name);
+		}
+		name_count += count;
+	}
+	reader.check("levels");
+	return name_count;
+}
+
+size_t file_size(const std::string & filename)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	return size_t(file.tellg());
+}
+
+void report(const std::string & name, size_t size, double time)
+{
+	double megabytes = double(size) / (1024.0 * 1024.0);
+	std::cout << Chthon::format("{0}: {1} ms, {2} MB/s", name, int(time * 1000.0), int(megabytes / time)) << std::endl;
+}
+
+}
+
+int main()
+{
+	const std::string text_filename = "chthon_bench_text.sav";
+	const std::string binary_filename = "chthon_bench_binary.sav";
+	std::vector<BenchLevel> levels;
+	for(int i = 0; i < 16; ++i) {
+		levels.push_back(make_level(i));
+	}
+	write_levels<Chthon::Writer>(text_filename, levels);
+	write_levels<Chthon::BinaryWriter>(binary_filename, levels);
+
+	Clock::time_point start = Clock::now();
+	{
+		std::ifstream in(text_filename.c_str());
+		Chthon::Reader reader(in);
+		read_levels(reader, levels.size());
+	}
+	report("text reader", file_size(text_filename), seconds_since(start));
+
+	start = Clock::now();
+	{
+		std::ifstream in(binary_filename.c_str(), std::ios::in | std::ios::binary);
+		Chthon::BinaryReader reader(in);
+		read_levels(reader, levels.size());
+	}
+	report("binary reader", file_size(binary_filename), seconds_since(start));
+
+	start = Clock::now();
+	{
+		Chthon::MappedReader reader(binary_filename);
+		read_levels(reader, levels.size());
+	}
+	report("mapped reader", file_size(binary_filename), seconds_since(start));
+
+	start = Clock::now();
+	{
+		Chthon::MappedReader reader(binary_filename);
+		read_levels_as_views(reader, levels.size());
+	}
+	report("mapped reader, string views", file_size(binary_filename), seconds_since(start));
+
+	std::remove(text_filename.c_str());
+	std::remove(binary_filename.c_str());
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include "../src/xmlreader.h"
+#include "../src/xmldocument.h"
+#include "../src/format.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+/** Compares seeking to the last section of large XML document
+ * with tag-by-tag reading and with skip_to_tag().
+ * Then compares parsing of all records on one thread and in parallel.
+ */
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(const Clock::time_point & start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string make_document(unsigned record_count)
+{
+	std::ostringstream out;
+	out << "<data>\n";
+	for(unsigned i = 0; i < record_count; ++i) {
+		out << Chthon::format("<record id=\"{0}\" name=\"Record &quot;{0}&quot;\">", i);
+		out << "Some text content &amp; entities, long enough to be scanned by blocks.";
+		out << "</record>\n";
+	}
+	out << "<section name=\"last\">found</section>\n</data>\n";
+	return out.str();
+}
+
+void report(const std::string & name, size_t size, double time, bool found)
+{
+	double megabytes = double(size) / (1024.0 * 1024.0);
+	std::cout << Chthon::format("{0}: {1} MB/s{2}", name, int(megabytes / time), found ? "" : " (not found)") << std::endl;
+}
+
+}
+
+int main()
+{
+	const std::string document = make_document(200000);
+
+	Clock::time_point start = Clock::now();
+	std::istringstream stream_in(document);
+	Chthon::XMLReader reader(stream_in);
+	while(!reader.to_next_tag().empty() && reader.get_current_tag() != "section") {
+	}
+	report("stream, to_next_tag", document.size(), seconds_since(start), !reader.get_current_tag().empty());
+
+	start = Clock::now();
+	std::istringstream skip_in(document);
+	Chthon::XMLReader skip_reader(skip_in);
+	skip_reader.skip_to_tag("section");
+	report("stream, skip_to_tag", document.size(), seconds_since(start), !skip_reader.get_current_tag().empty());
+
+	start = Clock::now();
+	Chthon::XMLBufferReader buffer_reader(document.data(), document.size());
+	while(!buffer_reader.to_next_tag().empty() && buffer_reader.get_current_tag() != "section") {
+	}
+	report("buffer, to_next_tag", document.size(), seconds_since(start), !buffer_reader.get_current_tag().empty());
+
+	start = Clock::now();
+	Chthon::XMLBufferReader buffer_skip_reader(document.data(), document.size());
+	buffer_skip_reader.skip_to_tag("section");
+	report("buffer, skip_to_tag", document.size(), seconds_since(start), !buffer_skip_reader.get_current_tag().empty());
+
+	unsigned thread_counts[] = {1, std::max(2u, std::thread::hardware_concurrency())};
+	for(unsigned threads : thread_counts) {
+		start = Clock::now();
+		size_t total_length = 0;
+		size_t count = Chthon::parse_xml_records(document.data(), document.size(), "record", [&total_length](const Chthon::XMLNode & record) {
+			total_length += record.content().size();
+		}, threads);
+		report(Chthon::format("records, {0} threads", threads), document.size(), seconds_since(start), count == 200000 && total_length > 0);
+	}
+	return 0;
+}
@@ -10,7 +10,7 @@ class Game;
 class Monster;
 
 /** Basic action class. Represents game action.
- * New action is created by subclassing Action and overriding its pure virtual function commit().
+ * New action is created by subclassing Action and overriding its pure virtual functions commit() and clone().
  *
  * Action should be constructed in order to commit:
  * @code{.cpp}
@@ -31,6 +31,8 @@ public:
 	 * @param game reference to the game.
 	 */
 	virtual void commit(Monster & someone, Game & game) = 0;
+	/// Returns new copy of the action, e.g. for copies of monster plan.
+	virtual Action * clone() const = 0;
 	/** Evaluates and asserts game related expressions.
 	 * If expression evaluates to false, throws corresponding Exception of exception_type and subject and object parameters.
 	 * @see GameEvent
@@ -70,6 +72,7 @@ public:
 class Wait : public Action {
 public:
 	virtual void commit(Monster &, Game &) {}
+	virtual Action * clone() const { return new Wait(*this); }
 };
 
 /** Bump into monsters, impassable objects or cells.
@@ -79,6 +82,7 @@ class Move : public DirectedAction {
 public:
 	Move(const Point & action_shift) : DirectedAction(action_shift) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Move(*this); }
 };
 
 /** Open closed doors and take items from container.
@@ -88,6 +92,7 @@ class Open : public DirectedAction {
 public:
 	Open(const Point & direction) : DirectedAction(direction) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Open(*this); }
 };
 
 /** Close opened doors.
@@ -96,6 +101,7 @@ class Close : public DirectedAction {
 public:
 	Close(const Point & direction) : DirectedAction(direction) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Close(*this); }
 };
 
 /** Swing in specified direction.
@@ -106,6 +112,7 @@ class Swing : public DirectedAction {
 public:
 	Swing(const Point & direction) : DirectedAction(direction) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Swing(*this); }
 };
 
 /** Throw wielded object in specified direction.
@@ -117,6 +124,7 @@ class Fire : public DirectedAction {
 public:
 	Fire(const Point & direction) : DirectedAction(direction) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Fire(*this); }
 };
 
 /** Drink (and heal, if needed) from drinkable object.
@@ -125,6 +133,7 @@ class Drink : public DirectedAction {
 public:
 	Drink(const Point & direction) : DirectedAction(direction) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Drink(*this); }
 };
 
 /** Grab item from the floor.
@@ -132,6 +141,7 @@ public:
 class Grab : public Action {
 public:
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Grab(*this); }
 };
 
 /** Drop item on the floor.
@@ -141,6 +151,7 @@ class Drop : public SlotAction {
 public:
 	Drop(unsigned action_slot) : SlotAction(action_slot) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Drop(*this); }
 };
 
 /** Wield item. If it was worn, it will be taken off first.
@@ -149,6 +160,7 @@ class Wield : public SlotAction {
 public:
 	Wield(unsigned action_slot) : SlotAction(action_slot) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Wield(*this); }
 };
 
 /** Unwield wielded item.
@@ -156,6 +168,7 @@ public:
 class Unwield : public Action {
 public:
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Unwield(*this); }
 };
 
 /** Wear wearable item. If it was wielded, it will be unwielded first.
@@ -164,6 +177,7 @@ class Wear : public SlotAction {
 public:
 	Wear(unsigned action_slot) : SlotAction(action_slot) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Wear(*this); }
 };
 
 /** Take off worn item.
@@ -171,6 +185,7 @@ public:
 class TakeOff : public Action {
 public:
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new TakeOff(*this); }
 };
 
 /** Eat edible item.
@@ -183,6 +198,7 @@ class Eat : public SlotAction {
 public:
 	Eat(unsigned action_slot) : SlotAction(action_slot) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Eat(*this); }
 };
 
 /** Go up using stairs.
@@ -192,6 +208,7 @@ public:
 class GoUp : public Action {
 public:
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new GoUp(*this); }
 };
 
 /** Go down using stairs.
@@ -201,6 +218,7 @@ public:
 class GoDown : public Action {
 public:
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new GoDown(*this); }
 };
 
 /** Put item into object or on the floor.
@@ -211,6 +229,7 @@ class Put : public DirectedAction {
 public:
 	Put(const Point & direction) : DirectedAction(direction) {}
 	virtual void commit(Monster & someone, Game & game);
+	virtual Action * clone() const { return new Put(*this); }
 };
 
 /// @}
@@ -3,7 +3,6 @@
 #include "actions.h"
 #include "log.h"
 #include "util.h"
-#include <cstdlib>
 
 namespace Chthon {
 
@@ -26,7 +25,7 @@ Action * BasicAI::act(Monster & monster, Game & game)
 			sign(player.pos.x - monster.pos.x),
 			sign(player.pos.y - monster.pos.y)
 			);
-	Point random_direction = Point(rand() % 3 - 1, rand() % 3 - 1);
+	Point random_direction = Point(int(game.random.get(3)) - 1, int(game.random.get(3)) - 1);
 
 	foreach(unsigned action, actions) {
 		switch(action) {
@@ -55,24 +54,16 @@ Action * BasicAI::act(Monster & monster, Game & game)
 }
 
 
-ControllerFactory::~ControllerFactory()
-{
-	typedef std::pair<const int, Controller*> KeyValue;
-	foreach(KeyValue & key_value, controllers) {
-		delete key_value.second;
-	}
-}
-
 void ControllerFactory::add_controller(int ai, Controller * controller)
 {
-	controllers[ai] = controller;
+	controllers[ai] = std::shared_ptr<Controller>(controller);
 }
 
 Controller * ControllerFactory::get_controller(int ai) const
 {
-	std::map<int, Controller*>::const_iterator result = controllers.find(ai);
+	std::map<int, std::shared_ptr<Controller> >::const_iterator result = controllers.find(ai);
 	if(result != controllers.end()) {
-		return result->second;
+		return result->second.get();
 	}
 	log("Unknown AI code: {0}", ai);
 	return nullptr;
@@ -1,6 +1,7 @@
 #pragma once
 #include <map>
 #include <vector>
+#include <memory>
 
 namespace Chthon { /// @defgroup AI AI
 /// @{
@@ -48,15 +49,16 @@ private:
 	std::vector<unsigned> actions;
 };
 
-/// Stores controllers by its id.
+/** Stores controllers by its id.
+ * Factory takes ownership of controllers. Copies of the factory (e.g. in forked games) share them.
+ */
 struct ControllerFactory {
-	~ControllerFactory();
 	/// Add new controller under given id.
 	void add_controller(int ai, Controller * controller);
 	/// Get controller by its id.
 	Controller * get_controller(int ai) const;
 private:
-	std::map<int, Controller*> controllers;
+	std::map<int, std::shared_ptr<Controller> > controllers;
 };
 
 /// @}
@@ -0,0 +1,380 @@
+#include "blit.h"
+#include <algorithm>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CHTHON_AVX2_KERNELS
+#define CHTHON_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace Chthon {
+
+ARGBBuffer::ARGBBuffer(uint32_t * buffer, unsigned buffer_width, unsigned buffer_height, unsigned row_pitch)
+	: pixels(buffer), width(buffer_width), height(buffer_height), pitch(row_pitch ? row_pitch : buffer_width)
+{
+}
+
+/// @cond INTERNAL
+struct ClipRect {
+	unsigned source_x, source_y;
+	unsigned target_x, target_y;
+	unsigned width, height;
+};
+/// @endcond
+
+/// Returns false if rectangle is completely outside of target.
+static bool clip_rect(unsigned width, unsigned height, unsigned target_width, unsigned target_height, int x, int y, ClipRect & rect)
+{
+	long long left = std::max<long long>(x, 0);
+	long long top = std::max<long long>(y, 0);
+	long long right = std::min<long long>((long long)x + width, target_width);
+	long long bottom = std::min<long long>((long long)y + height, target_height);
+	if(right <= left || bottom <= top) {
+		return false;
+	}
+	rect.source_x = unsigned(left - x);
+	rect.source_y = unsigned(top - y);
+	rect.target_x = unsigned(left);
+	rect.target_y = unsigned(top);
+	rect.width = unsigned(right - left);
+	rect.height = unsigned(bottom - top);
+	return true;
+}
+
+ARGBBuffer ARGBBuffer::region(int x, int y, unsigned region_width, unsigned region_height) const
+{
+	ClipRect rect;
+	if(!clip_rect(region_width, region_height, width, height, x, y, rect)) {
+		return ARGBBuffer(pixels, 0, 0, pitch);
+	}
+	return ARGBBuffer(row(rect.target_y) + rect.target_x, rect.width, rect.height, pitch);
+}
+
+static bool has_avx2()
+{
+#ifdef CHTHON_AVX2_KERNELS
+	static const bool supported = __builtin_cpu_supports("avx2") != 0;
+	return supported;
+#else
+	return false;
+#endif
+}
+
+/// Computes (source * alpha + target * (255 - alpha)) / 255 for every channel,
+/// with source alpha channel treated as 255, so result alpha is alpha over target alpha.
+/// Division is rounded the same way as in SIMD kernels.
+static uint32_t blend_pixel(uint32_t source, uint32_t target)
+{
+	uint32_t alpha = source >> 24;
+	uint32_t opaque = source | 0xff000000u;
+	uint32_t result = 0;
+	for(unsigned shift = 0; shift < 32; shift += 8) {
+		uint32_t value = ((opaque >> shift) & 0xff) * alpha + ((target >> shift) & 0xff) * (255 - alpha) + 128;
+		result |= ((value + (value >> 8)) >> 8) << shift;
+	}
+	return result;
+}
+
+static void color_key_row_scalar(const uint32_t * source, uint32_t * target, size_t count)
+{
+	for(size_t i = 0; i < count; ++i) {
+		if(!is_transparent(source[i])) {
+			target[i] = source[i];
+		}
+	}
+}
+
+static void alpha_row_scalar(const uint32_t * source, uint32_t * target, size_t count)
+{
+	for(size_t i = 0; i < count; ++i) {
+		uint32_t alpha = source[i] >> 24;
+		if(alpha == 255) {
+			target[i] = source[i];
+		} else if(alpha > 0) {
+			target[i] = blend_pixel(source[i], target[i]);
+		}
+	}
+}
+
+template<class T>
+static void expand_row_scalar(const T * indices, size_t count, const uint32_t * colors, size_t color_count, uint32_t * out)
+{
+	for(size_t i = 0; i < count; ++i) {
+		out[i] = indices[i] < color_count ? colors[indices[i]] : 0;
+	}
+}
+
+/// SIMD kernels process whole vectors and return count of processed pixels,
+/// the rest is left to scalar kernels.
+#ifdef __SSE2__
+static size_t color_key_row_sse2(const uint32_t * source, uint32_t * target, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+		__m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(target + i));
+		__m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(src, 24), zero);
+		__m128i result = _mm_or_si128(_mm_and_si128(transparent, dst), _mm_andnot_si128(transparent, src));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), result);
+	}
+	return i;
+}
+
+/// Channels are unpacked into 16-bit lanes.
+static __m128i blend_channels_sse2(__m128i src, __m128i dst, __m128i alpha)
+{
+	__m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+	__m128i value = _mm_add_epi16(_mm_mullo_epi16(src, alpha), _mm_mullo_epi16(dst, inverse));
+	value = _mm_add_epi16(value, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+static size_t alpha_row_sse2(const uint32_t * source, uint32_t * target, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi32(255);
+	const __m128i alpha_mask = _mm_set1_epi32(int(0xff000000u));
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+		__m128i alpha = _mm_srli_epi32(src, 24);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, full)) == 0xffff) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), src);
+			continue;
+		}
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff) {
+			continue;
+		}
+		__m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(target + i));
+		__m128i opaque = _mm_or_si128(src, alpha_mask);
+		__m128i alpha_low = _mm_unpacklo_epi8(src, zero);
+		alpha_low = _mm_shufflehi_epi16(_mm_shufflelo_epi16(alpha_low, 0xff), 0xff);
+		__m128i alpha_high = _mm_unpackhi_epi8(src, zero);
+		alpha_high = _mm_shufflehi_epi16(_mm_shufflelo_epi16(alpha_high, 0xff), 0xff);
+		__m128i low = blend_channels_sse2(_mm_unpacklo_epi8(opaque, zero), _mm_unpacklo_epi8(dst, zero), alpha_low);
+		__m128i high = blend_channels_sse2(_mm_unpackhi_epi8(opaque, zero), _mm_unpackhi_epi8(dst, zero), alpha_high);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), _mm_packus_epi16(low, high));
+	}
+	return i;
+}
+#endif
+
+#ifdef CHTHON_AVX2_KERNELS
+CHTHON_AVX2 static size_t color_key_row_avx2(const uint32_t * source, uint32_t * target, size_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i src = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+		__m256i dst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(target + i));
+		__m256i transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(src, 24), zero);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i), _mm256_blendv_epi8(src, dst, transparent));
+	}
+	return i;
+}
+
+CHTHON_AVX2 static __m256i blend_channels_avx2(__m256i src, __m256i dst, __m256i alpha)
+{
+	__m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+	__m256i value = _mm256_add_epi16(_mm256_mullo_epi16(src, alpha), _mm256_mullo_epi16(dst, inverse));
+	value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+
+CHTHON_AVX2 static size_t alpha_row_avx2(const uint32_t * source, uint32_t * target, size_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i full = _mm256_set1_epi32(255);
+	const __m256i alpha_mask = _mm256_set1_epi32(int(0xff000000u));
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i src = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+		__m256i alpha = _mm256_srli_epi32(src, 24);
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, full)) == -1) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i), src);
+			continue;
+		}
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, zero)) == -1) {
+			continue;
+		}
+		__m256i dst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(target + i));
+		__m256i opaque = _mm256_or_si256(src, alpha_mask);
+		__m256i alpha_low = _mm256_unpacklo_epi8(src, zero);
+		alpha_low = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(alpha_low, 0xff), 0xff);
+		__m256i alpha_high = _mm256_unpackhi_epi8(src, zero);
+		alpha_high = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(alpha_high, 0xff), 0xff);
+		__m256i low = blend_channels_avx2(_mm256_unpacklo_epi8(opaque, zero), _mm256_unpacklo_epi8(dst, zero), alpha_low);
+		__m256i high = blend_channels_avx2(_mm256_unpackhi_epi8(opaque, zero), _mm256_unpackhi_epi8(dst, zero), alpha_high);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i), _mm256_packus_epi16(low, high));
+	}
+	return i;
+}
+
+/// Colour table for 8-bit indices is padded to 256 entries, so there is no need for bounds check.
+CHTHON_AVX2 static size_t expand_row_avx2(const uint8_t * indices, size_t count, const uint32_t * colors, size_t, uint32_t * out)
+{
+	const int * table = reinterpret_cast<const int *>(colors);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + i)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_i32gather_epi32(table, index, 4));
+	}
+	return i;
+}
+
+CHTHON_AVX2 static size_t expand_row_avx2(const uint16_t * indices, size_t count, const uint32_t * colors, size_t color_count, uint32_t * out)
+{
+	const int * table = reinterpret_cast<const int *>(colors);
+	const __m256i limit = _mm256_set1_epi32(int(std::min<size_t>(color_count, 0x10000)));
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i)));
+		__m256i valid = _mm256_cmpgt_epi32(limit, index);
+		__m256i color = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), table, index, valid, 4);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), color);
+	}
+	return i;
+}
+
+/// Indices are compared as unsigned by flipping the sign bit.
+CHTHON_AVX2 static size_t expand_row_avx2(const uint32_t * indices, size_t count, const uint32_t * colors, size_t color_count, uint32_t * out)
+{
+	const int * table = reinterpret_cast<const int *>(colors);
+	const __m256i sign = _mm256_set1_epi32(int(0x80000000u));
+	const __m256i limit = _mm256_xor_si256(_mm256_set1_epi32(int(uint32_t(std::min<size_t>(color_count, 0xffffffffu)))), sign);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + i));
+		__m256i valid = _mm256_cmpgt_epi32(limit, _mm256_xor_si256(index, sign));
+		__m256i color = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), table, index, valid, 4);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), color);
+	}
+	return i;
+}
+#endif
+
+static void blend_row(const uint32_t * source, uint32_t * target, size_t count, BlendMode mode)
+{
+	size_t done = 0;
+	switch(mode) {
+		case BLEND_COLOR_KEY:
+#ifdef CHTHON_AVX2_KERNELS
+			if(has_avx2()) {
+				done = color_key_row_avx2(source, target, count);
+			}
+#endif
+#ifdef __SSE2__
+			done += color_key_row_sse2(source + done, target + done, count - done);
+#endif
+			color_key_row_scalar(source + done, target + done, count - done);
+			break;
+		case BLEND_ALPHA:
+#ifdef CHTHON_AVX2_KERNELS
+			if(has_avx2()) {
+				done = alpha_row_avx2(source, target, count);
+			}
+#endif
+#ifdef __SSE2__
+			done += alpha_row_sse2(source + done, target + done, count - done);
+#endif
+			alpha_row_scalar(source + done, target + done, count - done);
+			break;
+		default:
+			break;
+	}
+}
+
+template<class T>
+static void expand_row(const T * indices, size_t count, const std::vector<uint32_t> & colors, uint32_t * out)
+{
+	size_t done = 0;
+#ifdef CHTHON_AVX2_KERNELS
+	if(has_avx2()) {
+		done = expand_row_avx2(indices, count, colors.data(), colors.size(), out);
+	}
+#endif
+	expand_row_scalar(indices + done, count - done, colors.data(), colors.size(), out + done);
+}
+
+/// Works directly on index storage of the actual type.
+static void expand_indices(const Map<unsigned> & pixels, unsigned x, unsigned y, unsigned count, const std::vector<uint32_t> & colors, uint32_t * out)
+{
+	expand_row(pixels.data() + size_t(y) * pixels.width() + x, count, colors, out);
+}
+
+/// Works directly on index storage of the actual type.
+static void expand_indices(const PixelMap & pixels, unsigned x, unsigned y, unsigned count, const std::vector<uint32_t> & colors, uint32_t * out)
+{
+	size_t offset = size_t(y) * pixels.width() + x;
+	switch(pixels.index_size()) {
+		case 1: expand_row(pixels.data<uint8_t>() + offset, count, colors, out); break;
+		case 2: expand_row(pixels.data<uint16_t>() + offset, count, colors, out); break;
+		default: expand_row(pixels.data<uint32_t>() + offset, count, colors, out); break;
+	}
+}
+
+/// Table is padded to 256 entries with transparent colour.
+static std::vector<uint32_t> make_color_table(const std::vector<Color> & palette)
+{
+	std::vector<uint32_t> colors(palette.begin(), palette.end());
+	if(colors.size() < 256) {
+		colors.resize(256, 0);
+	}
+	return colors;
+}
+
+template<class PixelsType>
+static void expand_pixels(const PixelsType & pixels, const std::vector<Color> & palette, const ARGBBuffer & target)
+{
+	ClipRect rect;
+	if(!clip_rect(pixels.width(), pixels.height(), target.width, target.height, 0, 0, rect)) {
+		return;
+	}
+	std::vector<uint32_t> colors = make_color_table(palette);
+	for(unsigned y = 0; y < rect.height; ++y) {
+		expand_indices(pixels, 0, y, rect.width, colors, target.row(y));
+	}
+}
+
+void expand_pixmap(const Pixmap & pixmap, const ARGBBuffer & target)
+{
+	expand_pixels(pixmap.pixels, pixmap.palette, target);
+}
+
+void expand_pixmap(const PixelMap & pixels, const std::vector<Color> & palette, const ARGBBuffer & target)
+{
+	expand_pixels(pixels, palette, target);
+}
+
+void blit(const ARGBBuffer & source, const ARGBBuffer & target, int x, int y, BlendMode mode)
+{
+	ClipRect rect;
+	if(!clip_rect(source.width, source.height, target.width, target.height, x, y, rect)) {
+		return;
+	}
+	for(unsigned row = 0; row < rect.height; ++row) {
+		const uint32_t * source_row = source.row(rect.source_y + row) + rect.source_x;
+		blend_row(source_row, target.row(rect.target_y + row) + rect.target_x, rect.width, mode);
+	}
+}
+
+/// Each clipped row is expanded into temporary row buffer and then blended.
+void blit(const Pixmap & source, const ARGBBuffer & target, int x, int y, BlendMode mode)
+{
+	ClipRect rect;
+	if(!clip_rect(source.pixels.width(), source.pixels.height(), target.width, target.height, x, y, rect)) {
+		return;
+	}
+	std::vector<uint32_t> colors = make_color_table(source.palette);
+	std::vector<uint32_t> row_buffer(rect.width);
+	for(unsigned row = 0; row < rect.height; ++row) {
+		expand_indices(source.pixels, rect.source_x, rect.source_y + row, rect.width, colors, row_buffer.data());
+		blend_row(row_buffer.data(), target.row(rect.target_y + row) + rect.target_x, rect.width, mode);
+	}
+}
+
+}
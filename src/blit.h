@@ -0,0 +1,60 @@
+#pragma once
+#include "pixmap.h"
+#include <stdint.h>
+
+namespace Chthon { /// @defgroup Blit ARGB rendering
+/// @{
+
+/// Mode of combining source pixels with target pixels.
+enum BlendMode {
+	/// Transparent source pixels (see is_transparent()) are skipped, others replace target pixels.
+	BLEND_COLOR_KEY,
+	/// Source pixels are mixed with target pixels according to their alpha value.
+	BLEND_ALPHA
+};
+
+/** Rectangular view of ARGB pixel buffer owned by caller.
+ * Buffer is not copied, so it should outlive the view.
+ * Views of const buffers are made with const_cast; blit() never writes into the source view.
+ */
+struct ARGBBuffer {
+	/// First pixel of the first row.
+	uint32_t * pixels;
+	unsigned width, height;
+	/// Distance between starts of rows in pixels.
+	unsigned pitch;
+
+	/// Constructs view of buffer with given size. Zero pitch means that rows are not padded.
+	ARGBBuffer(uint32_t * buffer, unsigned buffer_width, unsigned buffer_height, unsigned row_pitch = 0);
+	/// Returns pointer to the first pixel of given row.
+	uint32_t * row(unsigned y) const { return pixels + size_t(y) * pitch; }
+	/// Returns view of rectangle with top-left corner at (x, y), clipped to buffer bounds.
+	ARGBBuffer region(int x, int y, unsigned region_width, unsigned region_height) const;
+};
+
+/** Writes colours of pixmap pixels into target buffer.
+ * Only the part which fits into target is written.
+ * Indices outside of palette produce transparent black.
+ * Uses AVX2 gathers if CPU supports it.
+ * @code{.cpp}
+ * std::vector<uint32_t> frame(pixmap.pixels.width() * pixmap.pixels.height());
+ * expand_pixmap(pixmap, ARGBBuffer(frame.data(), pixmap.pixels.width(), pixmap.pixels.height()));
+ * @endcode
+ */
+void expand_pixmap(const Pixmap & pixmap, const ARGBBuffer & target);
+/// Writes colours of compact pixel map into target buffer like expand_pixmap() for Pixmap.
+/// Byte and 16-bit indices are read without widening, so small palettes are expanded faster.
+void expand_pixmap(const PixelMap & pixels, const std::vector<Color> & palette, const ARGBBuffer & target);
+/** Draws source buffer onto target with top-left corner at (x, y).
+ * Source is clipped to target bounds, so position can be negative.
+ * Uses SSE2/AVX2 if CPU supports it.
+ */
+void blit(const ARGBBuffer & source, const ARGBBuffer & target, int x, int y, BlendMode mode = BLEND_COLOR_KEY);
+/** Draws pixmap onto target with top-left corner at (x, y).
+ * Works like blit() for buffer with expanded pixmap, but does not need to expand the whole pixmap.
+ * Indices outside of palette are treated as transparent.
+ */
+void blit(const Pixmap & source, const ARGBBuffer & target, int x, int y, BlendMode mode = BLEND_COLOR_KEY);
+
+/// @}
+}
@@ -0,0 +1,355 @@
+#include "compress.h"
+#include "util.h"
+#include <future>
+#include <cstring>
+#include <stdint.h>
+
+/** @ingroup Compress
+ * @page compression Compressed block format
+ *
+ * Compressed block is a sequence of commands. Each command starts with token byte:
+ * high 4 bits are count of literals, low 4 bits are match length minus 4.
+ * Value 15 means that length continues in the following bytes,
+ * each byte is added to the length until byte is not equal to 255.
+ * Token is followed by literal length bytes, literals, 2-byte little-endian match offset
+ * and match length bytes. The last command contains only literals.
+ *
+ * Compressed stream starts with "CHLZ" signature followed by blocks.
+ * Each block is prefixed with two varints: original size and compressed size.
+ * If sizes are equal, block is stored uncompressed.
+ */
+
+namespace Chthon {
+
+enum {
+	MIN_MATCH = 4,
+	MAX_OFFSET = 65535,
+	HASH_BITS = 14,
+	LENGTH_MASK = 15,
+	/// Each byte of compressed block produces at most this count of bytes.
+	MAX_EXPANSION = 255
+};
+
+static uint32_t read_uint32(const char * data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static size_t hash_sequence(uint32_t sequence)
+{
+	return size_t((sequence * 2654435761u) >> (32 - HASH_BITS));
+}
+
+static void write_length(std::string & out, size_t length)
+{
+	while(length >= 255) {
+		out += char(255);
+		length -= 255;
+	}
+	out += char(length);
+}
+
+static void write_command(std::string & out, const char * literals, size_t literal_count, size_t offset, size_t match_length)
+{
+	size_t match_code = match_length >= MIN_MATCH ? match_length - MIN_MATCH : 0;
+	unsigned token = unsigned(std::min<size_t>(literal_count, LENGTH_MASK) << 4);
+	token |= unsigned(std::min<size_t>(match_code, LENGTH_MASK));
+	out += char(token);
+	if(literal_count >= LENGTH_MASK) {
+		write_length(out, literal_count - LENGTH_MASK);
+	}
+	out.append(literals, literal_count);
+	if(match_length == 0) {
+		return;
+	}
+	out += char(offset & 0xff);
+	out += char(offset >> 8);
+	if(match_code >= LENGTH_MASK) {
+		write_length(out, match_code - LENGTH_MASK);
+	}
+}
+
+/// Uses greedy parsing with single-entry hash table of 4-byte sequences.
+std::string compress_block(const char * data, size_t size)
+{
+	std::string out;
+	out.reserve(size + size / 255 + 16);
+	std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+	size_t anchor = 0;
+	size_t pos = 0;
+	while(pos + MIN_MATCH <= size) {
+		uint32_t sequence = read_uint32(data + pos);
+		size_t hash = hash_sequence(sequence);
+		size_t candidate = table[hash];
+		table[hash] = uint32_t(pos + 1);
+		if(candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || read_uint32(data + candidate - 1) != sequence) {
+			++pos;
+			continue;
+		}
+		size_t match = candidate - 1;
+		size_t length = MIN_MATCH;
+		while(pos + length < size && data[match + length] == data[pos + length]) {
+			++length;
+		}
+		write_command(out, data + anchor, pos - anchor, pos - match, length);
+		pos += length;
+		anchor = pos;
+		if(pos + 2 <= size) {
+			table[hash_sequence(read_uint32(data + pos - 2))] = uint32_t(pos - 2 + 1);
+		}
+	}
+	write_command(out, data + anchor, size - anchor, 0, 0);
+	return out;
+}
+
+static size_t read_length(const uint8_t * & in, const uint8_t * end)
+{
+	size_t length = 0;
+	uint8_t byte = 255;
+	while(byte == 255) {
+		if(in == end) {
+			throw CompressionException("Compressed block is corrupted: unexpected end of block.");
+		}
+		byte = *in++;
+		length += byte;
+	}
+	return length;
+}
+
+std::string decompress_block(const char * data, size_t size, size_t original_size)
+{
+	if(original_size / MAX_EXPANSION > size) {
+		throw CompressionException("Compressed block is corrupted: original size is too large.");
+	}
+	std::string out(original_size, '\0');
+	const uint8_t * in = reinterpret_cast<const uint8_t *>(data);
+	const uint8_t * end = in + size;
+	size_t pos = 0;
+	while(in != end) {
+		unsigned token = *in++;
+		size_t literal_count = token >> 4;
+		if(literal_count == LENGTH_MASK) {
+			literal_count += read_length(in, end);
+		}
+		if(literal_count > size_t(end - in) || literal_count > original_size - pos) {
+			throw CompressionException("Compressed block is corrupted: literals are out of block.");
+		}
+		memcpy(&out[pos], in, literal_count);
+		in += literal_count;
+		pos += literal_count;
+		if(in == end) {
+			break;
+		}
+		if(end - in < 2) {
+			throw CompressionException("Compressed block is corrupted: unexpected end of block.");
+		}
+		size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+		in += 2;
+		size_t length = token & LENGTH_MASK;
+		if(length == LENGTH_MASK) {
+			length += read_length(in, end);
+		}
+		length += MIN_MATCH;
+		if(offset == 0 || offset > pos || length > original_size - pos) {
+			throw CompressionException("Compressed block is corrupted: match is out of block.");
+		}
+		if(offset >= length) {
+			memcpy(&out[pos], &out[pos - offset], length);
+			pos += length;
+		} else {
+			for(size_t i = 0; i < length; ++i, ++pos) {
+				out[pos] = out[pos - offset];
+			}
+		}
+	}
+	if(pos != original_size) {
+		throw CompressionException("Compressed block is corrupted: block is too short.");
+	}
+	return out;
+}
+
+
+static const char stream_signature[] = "CHLZ";
+
+static void write_varint(std::string & out, size_t value)
+{
+	while(value >= 0x80) {
+		out += char((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out += char(value);
+}
+
+static bool read_varint(std::istream & in, size_t & value)
+{
+	value = 0;
+	for(unsigned shift = 0; shift < 35; shift += 7) {
+		char c;
+		if(!in.get(c)) {
+			return false;
+		}
+		value |= size_t(uint8_t(c) & 0x7f) << shift;
+		if((uint8_t(c) & 0x80) == 0) {
+			return true;
+		}
+	}
+	throw CompressionException("Compressed stream is corrupted: varint is too long.");
+}
+
+static std::string pack_block(const char * data, size_t size)
+{
+	std::string packed = compress_block(data, size);
+	std::string result;
+	write_varint(result, size);
+	if(packed.size() >= size) {
+		write_varint(result, size);
+		result.append(data, size);
+	} else {
+		write_varint(result, packed.size());
+		result += packed;
+	}
+	return result;
+}
+
+CompressingBuffer::CompressingBuffer(std::ostream & out_stream, unsigned thread_count, size_t block_size)
+	: out(out_stream), threads(std::max(1u, thread_count)),
+	block(std::min<size_t>(std::max<size_t>(1, block_size), MAX_STREAM_BLOCK_SIZE)),
+	input(threads * block)
+{
+	out.write(stream_signature, 4);
+	setp(input.data(), input.data() + input.size());
+}
+
+CompressingBuffer::~CompressingBuffer()
+{
+	try {
+		write_blocks();
+	} catch(...) {
+	}
+}
+
+/// Each block is compressed by its own task, results are written in order.
+bool CompressingBuffer::write_blocks()
+{
+	size_t size = size_t(pptr() - pbase());
+	if(size == 0) {
+		return true;
+	}
+	std::vector<std::string> packed((size + block - 1) / block);
+	if(packed.size() == 1) {
+		packed[0] = pack_block(input.data(), size);
+	} else {
+		std::vector<std::future<std::string> > tasks;
+		for(size_t start = 0; start < size; start += block) {
+			const char * data = input.data() + start;
+			size_t block_size = std::min(block, size - start);
+			tasks.push_back(std::async(std::launch::async, [data, block_size]() {
+				return pack_block(data, block_size);
+			}));
+		}
+		for(size_t i = 0; i < tasks.size(); ++i) {
+			packed[i] = tasks[i].get();
+		}
+	}
+	foreach(const std::string & data, packed) {
+		out.write(data.data(), std::streamsize(data.size()));
+	}
+	setp(input.data(), input.data() + input.size());
+	return out.good();
+}
+
+CompressingBuffer::int_type CompressingBuffer::overflow(int_type c)
+{
+	if(!write_blocks()) {
+		return traits_type::eof();
+	}
+	if(!traits_type::eq_int_type(c, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+int CompressingBuffer::sync()
+{
+	if(!write_blocks()) {
+		return -1;
+	}
+	out.flush();
+	return out.good() ? 0 : -1;
+}
+
+
+DecompressingBuffer::DecompressingBuffer(std::istream & in_stream)
+	: in(in_stream), header_read(false)
+{
+}
+
+bool DecompressingBuffer::read_block()
+{
+	if(!header_read) {
+		char signature[4];
+		if(!in.read(signature, 4) || !std::equal(signature, signature + 4, stream_signature)) {
+			throw CompressionException("Stream is not compressed.");
+		}
+		header_read = true;
+	}
+	size_t original_size = 0, packed_size = 0;
+	if(!read_varint(in, original_size)) {
+		return false;
+	}
+	if(!read_varint(in, packed_size)) {
+		throw CompressionException("Compressed stream is corrupted: unexpected end of stream.");
+	}
+	if(original_size > MAX_STREAM_BLOCK_SIZE || packed_size > original_size) {
+		throw CompressionException("Compressed stream is corrupted: block is too large.");
+	}
+	packed.resize(packed_size);
+	if(packed_size > 0 && !in.read(&packed[0], std::streamsize(packed_size))) {
+		throw CompressionException("Compressed stream is corrupted: unexpected end of stream.");
+	}
+	if(packed_size == original_size) {
+		output.swap(packed);
+	} else {
+		output = decompress_block(packed.data(), packed.size(), original_size);
+	}
+	return true;
+}
+
+/// Exceptions are caught by std::istream and make the stream bad.
+DecompressingBuffer::int_type DecompressingBuffer::underflow()
+{
+	if(gptr() < egptr()) {
+		return traits_type::to_int_type(*gptr());
+	}
+	do {
+		if(!read_block()) {
+			return traits_type::eof();
+		}
+	} while(output.empty());
+	char * data = &output[0];
+	setg(data, data, data + output.size());
+	return traits_type::to_int_type(*gptr());
+}
+
+
+CompressedOStream::CompressedOStream(std::ostream & out_stream, unsigned thread_count, size_t block_size)
+	: std::ostream(nullptr), buffer(out_stream, thread_count, block_size)
+{
+	rdbuf(&buffer);
+}
+
+CompressedOStream::~CompressedOStream()
+{
+	flush();
+}
+
+CompressedIStream::CompressedIStream(std::istream & in_stream)
+	: std::istream(nullptr), buffer(in_stream)
+{
+	rdbuf(&buffer);
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+
+namespace Chthon { /// @defgroup Compress Compression
+/// @{
+
+/// Basic compression exception.
+struct CompressionException {
+	std::string message;
+	/// Constructs exception instance with given text.
+	CompressionException(const std::string & text) : message(text) {}
+};
+
+/** Compresses block of data using LZ77-family algorithm.
+ * Matches are searched within 64Kb window, so repetitive data (e.g. text savefiles) compresses well.
+ */
+std::string compress_block(const char * data, size_t size);
+/** Decompresses block produced by compress_block().
+ * Original size should be known in advance.
+ * Throws CompressionException if block is corrupted
+ * or original size is larger than block of given size can be expanded to.
+ */
+std::string decompress_block(const char * data, size_t size, size_t original_size);
+
+/// Maximal size of block in compressed stream. Larger blocks are rejected by reader as corrupted.
+enum { MAX_STREAM_BLOCK_SIZE = 16 * 1024 * 1024 };
+
+/// @cond INTERNAL
+class CompressingBuffer : public std::streambuf {
+public:
+	CompressingBuffer(std::ostream & out_stream, unsigned thread_count, size_t block_size);
+	virtual ~CompressingBuffer();
+protected:
+	virtual int_type overflow(int_type c);
+	virtual int sync();
+private:
+	std::ostream & out;
+	unsigned threads;
+	size_t block;
+	std::vector<char> input;
+	bool write_blocks();
+};
+
+class DecompressingBuffer : public std::streambuf {
+public:
+	DecompressingBuffer(std::istream & in_stream);
+	virtual ~DecompressingBuffer() {}
+protected:
+	virtual int_type underflow();
+private:
+	std::istream & in;
+	bool header_read;
+	std::string output;
+	std::string packed;
+	bool read_block();
+};
+/// @endcond
+
+/** Output stream which compresses data and writes it to another stream.
+ * Data is split into blocks, which are compressed independently,
+ * so several blocks can be compressed in parallel.
+ * Compressed data is written when stream is flushed or destroyed.
+ * Can be used as a filter between Writer and file:
+ * @code{.cpp}
+ * std::ofstream file("game.sav", std::ios::binary);
+ * CompressedOStream out(file);
+ * Writer writer(out);
+ * @endcode
+ */
+class CompressedOStream : public std::ostream {
+public:
+	/** Constructs stream writing to out_stream.
+	 * Up to thread_count blocks of block_size bytes are buffered and compressed in parallel.
+	 * Block size is limited by MAX_STREAM_BLOCK_SIZE.
+	 */
+	CompressedOStream(std::ostream & out_stream, unsigned thread_count = 1, size_t block_size = 65536);
+	virtual ~CompressedOStream();
+private:
+	CompressingBuffer buffer;
+};
+
+/** Input stream which reads data compressed by CompressedOStream from another stream.
+ * Corrupted data makes stream bad, so it is reported by usual Reader::check().
+ */
+class CompressedIStream : public std::istream {
+public:
+	/// Constructs stream reading from in_stream.
+	CompressedIStream(std::istream & in_stream);
+	virtual ~CompressedIStream() {}
+private:
+	DecompressingBuffer buffer;
+};
+
+/// @}
+}
@@ -3,6 +3,13 @@
 #include "map.h"
 #include "format.h"
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <cstring>
+#include <algorithm>
 
 /** @ingroup Files
  * @page serialization Serialization using Files module
@@ -110,6 +117,33 @@
  * 	savefile.check(section);
  * }
  * @endcode
+ *
+ * @section binary Binary streams
+ *
+ * BinaryReader and BinaryWriter have the same interface as Reader and Writer,
+ * so the same store() functions can be used with them:
+ *
+ * @code{.cpp}
+ * std::ofstream out("game.sav", std::ios::binary);
+ * BinaryWriter writer(out);
+ * writer.version(1, 1);
+ * store(writer, value);
+ * writer.check("value");
+ * @endcode
+ *
+ * Binary streams are several times smaller and faster to process,
+ * but they are not human-readable.
+ *
+ * Binary savefile can also be read with MappedReader, which maps the whole file
+ * into memory and parses values directly from it. String fields can be read
+ * as StringView, which refers to the mapped data instead of copying it:
+ *
+ * @code{.cpp}
+ * MappedReader reader("game.sav");
+ * reader.version(1, 1);
+ * StringView name;
+ * store(reader, name, "name");
+ * @endcode
  * 
  */
 
@@ -288,4 +322,641 @@ Writer & Writer::store(const std::string & value)
 	return *this;
 }
 
+
+static uint32_t zigzag(int value)
+{
+	return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static int unzigzag(uint32_t value)
+{
+	return int(value >> 1) ^ -int(value & 1);
+}
+
+BinaryReader::BinaryReader(std::istream & in_stream)
+	: actual_minor_version(0), failed(false), in(in_stream)
+{
+}
+
+uint8_t BinaryReader::read_byte()
+{
+	std::streambuf::int_type c = in.rdbuf()->sbumpc();
+	if(std::streambuf::traits_type::eq_int_type(c, std::streambuf::traits_type::eof())) {
+		failed = true;
+		in.setstate(std::ios::eofbit | std::ios::failbit);
+		return 0;
+	}
+	return uint8_t(std::streambuf::traits_type::to_char_type(c));
+}
+
+uint32_t BinaryReader::read_varint()
+{
+	uint32_t value = 0;
+	for(unsigned shift = 0; shift < 35 && !failed; shift += 7) {
+		uint8_t byte = read_byte();
+		value |= uint32_t(byte & 0x7f) << shift;
+		if((byte & 0x80) == 0) {
+			return value;
+		}
+	}
+	failed = true;
+	return 0;
+}
+
+BinaryReader & BinaryReader::newline()
+{
+	return *this;
+}
+
+BinaryReader & BinaryReader::version(int major_version, int minor_version)
+{
+	int actual_major_version = 0;
+	store(actual_major_version);
+	check("major version");
+	if(actual_major_version != major_version) {
+		throw Exception(format(
+					"Savefile has major version {0}, which is incompatible with current program savefile major version {1}.",
+					actual_major_version, major_version
+					));
+	}
+	store(actual_minor_version);
+	check("minor version");
+	if(actual_minor_version > minor_version) {
+		throw Exception(format(
+					"Savefile has minor version {0}, which is incompatible with current program savefile minor version {1}.",
+					actual_minor_version, minor_version
+					));
+	}
+	return *this;
+}
+
+BinaryReader & BinaryReader::check(const std::string & section)
+{
+	if(failed || !in.good()) {
+		throw Exception("Error: savefile is corrupted (reading " + to_string(section) + ").");
+	}
+	return *this;
+}
+
+BinaryReader & BinaryReader::store(int & value)
+{
+	value = unzigzag(read_varint());
+	return *this;
+}
+
+BinaryReader & BinaryReader::store(unsigned int & value)
+{
+	value = read_varint();
+	return *this;
+}
+
+BinaryReader & BinaryReader::store(char & value)
+{
+	value = char(read_byte());
+	return *this;
+}
+
+BinaryReader & BinaryReader::store(bool & value)
+{
+	value = read_byte() != 0;
+	return *this;
+}
+
+/// String is read by chunks, so corrupted length does not lead to huge allocation.
+BinaryReader & BinaryReader::store(std::string & value)
+{
+	value.clear();
+	uint32_t size = read_varint();
+	char chunk[4096];
+	while(size > 0 && !failed) {
+		std::streamsize chunk_size = std::streamsize(std::min<uint32_t>(size, sizeof(chunk)));
+		std::streamsize actual_size = in.rdbuf()->sgetn(chunk, chunk_size);
+		value.append(chunk, size_t(actual_size));
+		if(actual_size < chunk_size) {
+			failed = true;
+			in.setstate(std::ios::eofbit | std::ios::failbit);
+		}
+		size -= uint32_t(actual_size);
+	}
+	return *this;
+}
+
+BinaryReader & BinaryReader::store_block(char * data, size_t size)
+{
+	if(failed) {
+		return *this;
+	}
+	std::streamsize actual_size = in.rdbuf()->sgetn(data, std::streamsize(size));
+	if(actual_size < std::streamsize(size)) {
+		failed = true;
+		in.setstate(std::ios::eofbit | std::ios::failbit);
+	}
+	return *this;
+}
+
+
+static const size_t binary_buffer_size = 4096;
+
+BinaryWriter::BinaryWriter(std::ostream & out_stream)
+	: actual_minor_version(0), out(out_stream)
+{
+	buffer.reserve(binary_buffer_size);
+}
+
+BinaryWriter::~BinaryWriter()
+{
+	flush();
+}
+
+BinaryWriter & BinaryWriter::flush()
+{
+	if(!buffer.empty()) {
+		out.write(buffer.data(), std::streamsize(buffer.size()));
+		buffer.clear();
+	}
+	return *this;
+}
+
+void BinaryWriter::write_varint(uint32_t value)
+{
+	while(value >= 0x80) {
+		buffer.push_back(char((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(char(value));
+	if(buffer.size() >= binary_buffer_size) {
+		flush();
+	}
+}
+
+BinaryWriter & BinaryWriter::newline()
+{
+	return *this;
+}
+
+BinaryWriter & BinaryWriter::version(int major_version, int minor_version)
+{
+	store(major_version);
+	store(minor_version);
+	actual_minor_version = minor_version;
+	return *this;
+}
+
+BinaryWriter & BinaryWriter::check(const std::string & section)
+{
+	flush();
+	if(!out.good()) {
+		throw Exception("Error: savefile is corrupted (writing " + to_string(section) + ") .");
+	}
+	return *this;
+}
+
+BinaryWriter & BinaryWriter::store(int value)
+{
+	write_varint(zigzag(value));
+	return *this;
+}
+
+BinaryWriter & BinaryWriter::store(unsigned int value)
+{
+	write_varint(value);
+	return *this;
+}
+
+BinaryWriter & BinaryWriter::store(char value)
+{
+	buffer.push_back(value);
+	if(buffer.size() >= binary_buffer_size) {
+		flush();
+	}
+	return *this;
+}
+
+BinaryWriter & BinaryWriter::store(bool value)
+{
+	return store(char(value ? 1 : 0));
+}
+
+BinaryWriter & BinaryWriter::store(const std::string & value)
+{
+	write_varint(uint32_t(value.size()));
+	return store_block(value.data(), value.size());
+}
+
+BinaryWriter & BinaryWriter::store(const StringView & value)
+{
+	write_varint(uint32_t(value.size()));
+	return store_block(value.data(), value.size());
+}
+
+BinaryWriter & BinaryWriter::store_block(const char * data, size_t size)
+{
+	if(buffer.size() + size > binary_buffer_size) {
+		flush();
+		out.write(data, std::streamsize(size));
+	} else {
+		buffer.insert(buffer.end(), data, data + size);
+	}
+	return *this;
+}
+
+
+#ifdef _WIN32
+/// Mapped file cannot be replaced or truncated on Windows,
+/// and savefile is kept open until the next save, so file is read into memory instead.
+MappedFile::MappedFile(const std::string & filename)
+	: opened(false), begin(nullptr), length(0)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	std::streamoff size = file ? std::streamoff(file.tellg()) : -1;
+	if(size < 0) {
+		return;
+	}
+	if(size > 0) {
+		char * data = new char[size_t(size)];
+		file.seekg(0);
+		if(!file.read(data, std::streamsize(size))) {
+			delete [] data;
+			return;
+		}
+		begin = data;
+		length = size_t(size);
+	}
+	opened = true;
+}
+
+MappedFile::~MappedFile()
+{
+	delete [] begin;
+}
+#else
+MappedFile::MappedFile(const std::string & filename)
+	: opened(false), begin(nullptr), length(0)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return;
+	}
+	struct stat file_stat;
+	if(fstat(fd, &file_stat) == 0) {
+		length = size_t(file_stat.st_size);
+		if(length == 0) {
+			opened = true;
+		} else {
+			void * mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(mapped != MAP_FAILED) {
+				begin = static_cast<const char *>(mapped);
+				opened = true;
+				madvise(mapped, length, MADV_SEQUENTIAL);
+			}
+		}
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if(begin) {
+		munmap(const_cast<char *>(begin), length);
+	}
+}
+#endif
+
+
+MappedReader::MappedReader(const std::string & filename)
+	: file(std::make_shared<MappedFile>(filename)), actual_minor_version(0), failed(false),
+	begin(file->data()), current(begin), end(begin + file->size())
+{
+	if(!file->is_open()) {
+		throw Exception("Error: cannot open savefile " + escaped(filename) + ".");
+	}
+}
+
+MappedReader::MappedReader(const char * data, size_t size)
+	: actual_minor_version(0), failed(false), begin(data), current(data), end(data + size)
+{
+}
+
+MappedReader::MappedReader(const std::shared_ptr<MappedFile> & mapped_file, const char * data, size_t size)
+	: file(mapped_file), actual_minor_version(0), failed(false), begin(data), current(data), end(data + size)
+{
+}
+
+const char * MappedReader::read_bytes(size_t size)
+{
+	if(failed || size_t(end - current) < size) {
+		failed = true;
+		return nullptr;
+	}
+	const char * result = current;
+	current += size;
+	return result;
+}
+
+uint32_t MappedReader::read_varint()
+{
+	uint32_t value = 0;
+	for(unsigned shift = 0; shift < 35 && current != end; shift += 7) {
+		uint8_t byte = uint8_t(*current++);
+		value |= uint32_t(byte & 0x7f) << shift;
+		if((byte & 0x80) == 0) {
+			return value;
+		}
+	}
+	failed = true;
+	return 0;
+}
+
+MappedReader & MappedReader::newline()
+{
+	return *this;
+}
+
+MappedReader & MappedReader::version(int major_version, int minor_version)
+{
+	int actual_major_version = 0;
+	store(actual_major_version);
+	check("major version");
+	if(actual_major_version != major_version) {
+		throw Exception(format(
+					"Savefile has major version {0}, which is incompatible with current program savefile major version {1}.",
+					actual_major_version, major_version
+					));
+	}
+	store(actual_minor_version);
+	check("minor version");
+	if(actual_minor_version > minor_version) {
+		throw Exception(format(
+					"Savefile has minor version {0}, which is incompatible with current program savefile minor version {1}.",
+					actual_minor_version, minor_version
+					));
+	}
+	return *this;
+}
+
+MappedReader & MappedReader::check(const std::string & section)
+{
+	if(failed) {
+		throw Exception("Error: savefile is corrupted (reading " + to_string(section) + ").");
+	}
+	return *this;
+}
+
+MappedReader & MappedReader::seek(size_t offset)
+{
+	if(offset > size_t(end - begin)) {
+		failed = true;
+	} else {
+		current = begin + offset;
+	}
+	return *this;
+}
+
+MappedReader & MappedReader::store(int & value)
+{
+	value = unzigzag(read_varint());
+	return *this;
+}
+
+MappedReader & MappedReader::store(unsigned int & value)
+{
+	value = read_varint();
+	return *this;
+}
+
+MappedReader & MappedReader::store(char & value)
+{
+	const char * byte = read_bytes(1);
+	value = byte ? *byte : 0;
+	return *this;
+}
+
+MappedReader & MappedReader::store(bool & value)
+{
+	const char * byte = read_bytes(1);
+	value = byte && *byte != 0;
+	return *this;
+}
+
+MappedReader & MappedReader::store(std::string & value)
+{
+	StringView view;
+	store(view);
+	value.assign(view.data(), view.size());
+	return *this;
+}
+
+MappedReader & MappedReader::store(StringView & value)
+{
+	uint32_t size = read_varint();
+	const char * data = read_bytes(size);
+	value = data ? StringView(data, size) : StringView();
+	return *this;
+}
+
+MappedReader & MappedReader::store_block(char * data, size_t size)
+{
+	const char * block = read_bytes(size);
+	if(block) {
+		memcpy(data, block, size);
+	}
+	return *this;
+}
+
+
+static const char indexed_magic[] = "CHSI";
+
+IndexedWriter::IndexedWriter(std::ostream & out_stream)
+	: out(out_stream)
+{
+}
+
+void IndexedWriter::finish_section()
+{
+	if(current_writer) {
+		current_writer->flush();
+		sections.back().second = current_buffer->str();
+		current_writer.reset();
+		current_buffer.reset();
+	}
+}
+
+BinaryWriter & IndexedWriter::section(const std::string & name)
+{
+	finish_section();
+	sections.push_back(std::make_pair(name, std::string()));
+	current_buffer = std::make_shared<std::ostringstream>();
+	current_writer = std::make_shared<BinaryWriter>(*current_buffer);
+	return *current_writer;
+}
+
+IndexedWriter & IndexedWriter::add_section(const std::string & name, const StringView & data)
+{
+	finish_section();
+	sections.push_back(std::make_pair(name, data.str()));
+	return *this;
+}
+
+/// Index consists of section count and name, offset and size of each section.
+/// Offsets are counted from the end of the index.
+void IndexedWriter::finish()
+{
+	finish_section();
+	out.write(indexed_magic, 4);
+	{
+		BinaryWriter index(out);
+		index.store(unsigned(sections.size()));
+		unsigned offset = 0;
+		typedef std::pair<std::string, std::string> Section;
+		foreach(const Section & section, sections) {
+			index.store(section.first).store(offset).store(unsigned(section.second.size()));
+			offset += unsigned(section.second.size());
+		}
+	}
+	typedef std::pair<std::string, std::string> Section;
+	foreach(const Section & section, sections) {
+		out.write(section.second.data(), std::streamsize(section.second.size()));
+	}
+	if(!out.good()) {
+		throw Exception("Error: cannot write savefile.");
+	}
+}
+
+
+IndexedReader::IndexedReader(const std::string & filename)
+	: file(std::make_shared<MappedFile>(filename)), parts(0), complete(true)
+{
+	if(!file->is_open()) {
+		throw Exception("Error: cannot open savefile " + escaped(filename) + ".");
+	}
+	read_index(file->data(), file->size());
+}
+
+IndexedReader::IndexedReader(const char * data, size_t size)
+	: parts(0), complete(true)
+{
+	read_index(data, size);
+}
+
+void IndexedReader::read_index(const char * data, size_t size)
+{
+	if(size < 4 || !std::equal(data, data + 4, indexed_magic)) {
+		throw Exception("Error: savefile is not an indexed savefile.");
+	}
+	size_t offset = 0;
+	while(offset < size) {
+		try {
+			offset += read_part(data + offset, size - offset);
+		} catch(const Exception &) {
+			if(parts == 0) {
+				throw;
+			}
+			complete = false;
+			break;
+		}
+		++parts;
+	}
+}
+
+/// Returns size of the part.
+size_t IndexedReader::read_part(const char * data, size_t size)
+{
+	if(size < 4 || !std::equal(data, data + 4, indexed_magic)) {
+		throw Exception("Error: savefile is not an indexed savefile.");
+	}
+	MappedReader index(data + 4, size - 4);
+	unsigned count = 0;
+	index.store(count);
+	std::vector<std::pair<std::string, std::pair<unsigned, unsigned> > > entries;
+	for(unsigned i = 0; i < count; ++i) {
+		std::string name;
+		unsigned offset = 0, section_size = 0;
+		index.store(name).store(offset).store(section_size);
+		try {
+			index.check("index");
+		} catch(const MappedReader::Exception & e) {
+			throw Exception(e.message);
+		}
+		entries.push_back(std::make_pair(name, std::make_pair(offset, section_size)));
+	}
+	const char * start = data + 4 + index.position();
+	size_t data_size = size - 4 - index.position();
+	size_t part_data_size = 0;
+	typedef std::pair<std::string, std::pair<unsigned, unsigned> > Entry;
+	foreach(const Entry & entry, entries) {
+		if(size_t(entry.second.first) + entry.second.second > data_size) {
+			throw Exception("Error: savefile is corrupted (reading section " + escaped(entry.first) + ").");
+		}
+		part_data_size = std::max(part_data_size, size_t(entry.second.first) + entry.second.second);
+	}
+	foreach(const Entry & entry, entries) {
+		StringView section_data(start + entry.second.first, entry.second.second);
+		bool replaced = false;
+		typedef std::pair<std::string, StringView> Section;
+		foreach(Section & section, sections) {
+			if(section.first == entry.first) {
+				section.second = section_data;
+				replaced = true;
+				break;
+			}
+		}
+		if(!replaced) {
+			sections.push_back(std::make_pair(entry.first, section_data));
+		}
+	}
+	return 4 + index.position() + part_data_size;
+}
+
+bool IndexedReader::has_section(const std::string & name) const
+{
+	typedef std::pair<std::string, StringView> Section;
+	foreach(const Section & section, sections) {
+		if(section.first == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<std::string> IndexedReader::section_names() const
+{
+	std::vector<std::string> result;
+	typedef std::pair<std::string, StringView> Section;
+	foreach(const Section & section, sections) {
+		result.push_back(section.first);
+	}
+	return result;
+}
+
+StringView IndexedReader::section_data(const std::string & name) const
+{
+	typedef std::pair<std::string, StringView> Section;
+	foreach(const Section & section, sections) {
+		if(section.first == name) {
+			return section.second;
+		}
+	}
+	throw Exception("Error: savefile has no section " + escaped(name) + ".");
+}
+
+MappedReader IndexedReader::section(const std::string & name) const
+{
+	StringView data = section_data(name);
+	return MappedReader(file, data.data(), data.size());
+}
+
+
+char native_byte_order()
+{
+	const uint16_t value = 1;
+	return *reinterpret_cast<const char *>(&value) == 1 ? 1 : 2;
+}
+
+void swap_block_bytes(char * data, size_t count, size_t element_size)
+{
+	for(size_t i = 0; i < count; ++i, data += element_size) {
+		std::reverse(data, data + element_size);
+	}
+}
+
 }
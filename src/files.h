@@ -3,9 +3,17 @@
 #include "cell.h"
 #include "objects.h"
 #include "util.h"
+#include "format.h"
+#include "map.h"
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <map>
+#include <stdint.h>
+#include <type_traits>
+#include <memory>
+#include <algorithm>
+#include <limits>
 
 namespace Chthon { /// @defgroup Files File utilities
 /// @{
@@ -56,6 +64,7 @@ SAVEFILE_STORE(unsigned int, unsigned_int_value) { savefile.store(unsigned_int_v
 SAVEFILE_STORE(char, char_value) { savefile.store(char_value); }
 SAVEFILE_STORE(bool, bool_value) { savefile.store(bool_value); }
 SAVEFILE_STORE(std::string, string_value) { savefile.store(string_value); }
+SAVEFILE_STORE(StringView, string_view_value) { savefile.store(string_view_value); }
 /// @endcond
 
 /// Implements reading from text stream.
@@ -67,6 +76,10 @@ public:
 		/// Constructs exception instance with given text.
 		Exception(const std::string & text) : message(text) {}
 	};
+	/// Savefile direction for store() functions which read and write differently.
+	enum { READING = true };
+	/// Text savefile cannot store raw memory blocks.
+	enum { BINARY = false };
 	/// Constructs Reader using specified in_stream.
 	Reader(std::istream & in_stream);
 
@@ -106,6 +119,10 @@ public:
 		/// Constructs exception instance with given text.
 		Exception(const std::string & text) : message(text) {}
 	};
+	/// Savefile direction for store() functions which read and write differently.
+	enum { READING = false };
+	/// Text savefile cannot store raw memory blocks.
+	enum { BINARY = false };
 	/// Constructs Writer using specified out_stream.
 	Writer(std::ostream & out_stream);
 
@@ -133,5 +150,447 @@ private:
 	std::ostream & out;
 };
 
+/** Implements reading from binary stream written by BinaryWriter.
+ * Can be used everywhere instead of Reader, store() functions are the same.
+ */
+class BinaryReader {
+public:
+	/// Basic BinaryReader exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Savefile direction for store() functions which read and write differently.
+	enum { READING = true };
+	/// Binary savefile can store raw memory blocks.
+	enum { BINARY = true };
+	/// Constructs BinaryReader using specified in_stream. Stream should be opened in binary mode.
+	BinaryReader(std::istream & in_stream);
+
+	/// Does nothing, binary stream has no newlines.
+	BinaryReader & newline();
+	/** Reads major and minor versions from file and compares it with specified ones.
+	 * Versions are checked in the same way as in Reader::version().
+	 */
+	BinaryReader & version(int major_version, int minor_version);
+	/// Returns file minor version (should be called only after versions reading).
+	int version() const { return actual_minor_version; }
+	/// Checks whether read stream is valid, throws Exception otherwise using given section name.
+	BinaryReader & check(const std::string & section);
+
+	/// Reads int value (as zigzag varint). Use store(savefile, value) function instead.
+	BinaryReader & store(int & value);
+	/// Reads unsigned int value (as varint). Use store(savefile, value) function instead.
+	BinaryReader & store(unsigned int & value);
+	/// Reads char value (as single byte). Use store(savefile, value) function instead.
+	BinaryReader & store(char & value);
+	/// Reads bool value (as single byte). Use store(savefile, value) function instead.
+	BinaryReader & store(bool & value);
+	/// Reads string value (as length-prefixed bytes). Use store(savefile, value) function instead.
+	BinaryReader & store(std::string & value);
+	/// Reads raw memory block of given size. Use store(savefile, vector) or store(savefile, map) instead.
+	BinaryReader & store_block(char * data, size_t size);
+private:
+	int actual_minor_version;
+	bool failed;
+	std::istream & in;
+	uint8_t read_byte();
+	uint32_t read_varint();
+};
+
+/** Implements writing to binary stream.
+ * Integers are written as varints (zigzag-encoded for signed values),
+ * so small values take one byte. Strings are prefixed with their length.
+ * Output is buffered and written to stream on check() and in destructor.
+ */
+class BinaryWriter {
+public:
+	/// Basic BinaryWriter exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Savefile direction for store() functions which read and write differently.
+	enum { READING = false };
+	/// Binary savefile can store raw memory blocks.
+	enum { BINARY = true };
+	/// Constructs BinaryWriter using specified out_stream. Stream should be opened in binary mode.
+	BinaryWriter(std::ostream & out_stream);
+	/// Flushes buffered data to stream.
+	~BinaryWriter();
+
+	/// Does nothing, binary stream has no newlines.
+	BinaryWriter & newline();
+	/// Writes major and minor version to stream.
+	BinaryWriter & version(int major_version, int minor_version);
+	/// Returns current minor version. Should be called only after versions storing.
+	int version() const { return actual_minor_version; }
+	/// Writes buffered data to stream.
+	BinaryWriter & flush();
+	/// Flushes buffered data and checks whether write stream is valid, throws Exception otherwise using given section name.
+	BinaryWriter & check(const std::string & section);
+
+	/// Writes int value (as zigzag varint). Use store(savefile, value) function instead.
+	BinaryWriter & store(int value);
+	/// Writes unsigned int value (as varint). Use store(savefile, value) function instead.
+	BinaryWriter & store(unsigned int value);
+	/// Writes char value (as single byte). Use store(savefile, value) function instead.
+	BinaryWriter & store(char value);
+	/// Writes bool value (as single byte). Use store(savefile, value) function instead.
+	BinaryWriter & store(bool value);
+	/// Writes string value (as length-prefixed bytes). Use store(savefile, value) function instead.
+	BinaryWriter & store(const std::string & value);
+	/// Writes string view value (as length-prefixed bytes). Use store(savefile, value) function instead.
+	BinaryWriter & store(const StringView & value);
+	/// Writes raw memory block of given size. Use store(savefile, vector) or store(savefile, map) instead.
+	BinaryWriter & store_block(const char * data, size_t size);
+private:
+	int actual_minor_version;
+	std::ostream & out;
+	std::vector<char> buffer;
+	void write_varint(uint32_t value);
+};
+
+/** Read-only memory mapping of the whole file.
+ * Mapping is released on destruction.
+ * On Windows file is read into memory instead, so it can be replaced while the mapping exists.
+ */
+class MappedFile {
+public:
+	/// Maps file with given name. If file cannot be mapped, is_open() returns false.
+	MappedFile(const std::string & filename);
+	~MappedFile();
+	/// Returns true if file was successfully mapped.
+	bool is_open() const { return opened; }
+	/// Returns start of the mapped data.
+	const char * data() const { return begin; }
+	/// Returns size of the mapped data.
+	size_t size() const { return length; }
+private:
+	bool opened;
+	const char * begin;
+	size_t length;
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+};
+
+/** Implements reading of binary savefile (written by BinaryWriter) directly from memory.
+ * Values are parsed from the buffer without stream operations,
+ * and string views are returned as references to the buffer itself,
+ * so they are valid as long as the reader exists.
+ * Can be used everywhere instead of BinaryReader.
+ */
+class MappedReader {
+public:
+	/// Basic MappedReader exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Savefile direction for store() functions which read and write differently.
+	enum { READING = true };
+	/// Binary savefile can store raw memory blocks.
+	enum { BINARY = true };
+	/// Maps savefile with given name. Throws Exception if file cannot be mapped.
+	MappedReader(const std::string & filename);
+	/// Reads from memory buffer of given size. Buffer should outlive the reader.
+	MappedReader(const char * data, size_t size);
+	/// Reads part of mapped file. Reader keeps mapping alive.
+	MappedReader(const std::shared_ptr<MappedFile> & mapped_file, const char * data, size_t size);
+
+	/// Does nothing, binary stream has no newlines.
+	MappedReader & newline();
+	/** Reads major and minor versions from file and compares it with specified ones.
+	 * Versions are checked in the same way as in Reader::version().
+	 */
+	MappedReader & version(int major_version, int minor_version);
+	/// Returns file minor version (should be called only after versions reading).
+	int version() const { return actual_minor_version; }
+	/// Checks whether all reads were successful, throws Exception otherwise using given section name.
+	MappedReader & check(const std::string & section);
+	/// Returns current read position from the start of the buffer.
+	size_t position() const { return size_t(current - begin); }
+	/// Moves read position to the given offset from the start of the buffer.
+	MappedReader & seek(size_t offset);
+
+	/// Reads int value (as zigzag varint). Use store(savefile, value) function instead.
+	MappedReader & store(int & value);
+	/// Reads unsigned int value (as varint). Use store(savefile, value) function instead.
+	MappedReader & store(unsigned int & value);
+	/// Reads char value (as single byte). Use store(savefile, value) function instead.
+	MappedReader & store(char & value);
+	/// Reads bool value (as single byte). Use store(savefile, value) function instead.
+	MappedReader & store(bool & value);
+	/// Reads string value (as length-prefixed bytes). Use store(savefile, value) function instead.
+	MappedReader & store(std::string & value);
+	/// Reads string value as a view into the buffer, without copying. Use store(savefile, value) function instead.
+	MappedReader & store(StringView & value);
+	/// Reads raw memory block of given size. Use store(savefile, vector) or store(savefile, map) instead.
+	MappedReader & store_block(char * data, size_t size);
+private:
+	std::shared_ptr<MappedFile> file;
+	int actual_minor_version;
+	bool failed;
+	const char * begin;
+	const char * current;
+	const char * end;
+	uint32_t read_varint();
+	const char * read_bytes(size_t size);
+};
+
+/** Writes indexed savefile: set of named sections preceded by index.
+ * Each section is written using BinaryWriter and can be read separately by IndexedReader.
+ * Sections are buffered in memory and written to stream by finish().
+ * @code{.cpp}
+ * IndexedWriter writer(out);
+ * store(writer.section("player"), player);
+ * store(writer.section("level 1"), level);
+ * writer.finish();
+ * @endcode
+ */
+class IndexedWriter {
+public:
+	/// Basic IndexedWriter exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Constructs IndexedWriter using specified out_stream. Stream should be opened in binary mode.
+	IndexedWriter(std::ostream & out_stream);
+	/** Starts new section with given name and returns writer for it.
+	 * Writer is valid until the next section() call. Section names should be unique.
+	 */
+	BinaryWriter & section(const std::string & name);
+	/// Adds section with given raw content (e.g. copied from IndexedReader::section_data()).
+	IndexedWriter & add_section(const std::string & name, const StringView & data);
+	/// Writes index and all sections to stream. Throws Exception if stream is bad.
+	void finish();
+private:
+	std::ostream & out;
+	std::vector<std::pair<std::string, std::string> > sections;
+	std::shared_ptr<std::ostringstream> current_buffer;
+	std::shared_ptr<BinaryWriter> current_writer;
+	void finish_section();
+};
+
+/** Reads indexed savefile written by IndexedWriter.
+ * File is mapped into memory and only index is read at construction,
+ * so any section can be read without reading the others.
+ * Copies of the reader share the same mapping.
+ *
+ * Savefile may consist of several indexed parts appended one after another
+ * (e.g. base save and incremental updates). Sections of later parts replace
+ * sections with the same name from earlier parts. Incomplete last part
+ * (e.g. interrupted append) is ignored.
+ */
+class IndexedReader {
+public:
+	/// Basic IndexedReader exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Maps savefile with given name and reads its index. Throws Exception if file cannot be mapped or is not an indexed savefile.
+	IndexedReader(const std::string & filename);
+	/// Reads index from memory buffer of given size. Buffer should outlive the reader.
+	IndexedReader(const char * data, size_t size);
+	/// Returns true if savefile has section with given name.
+	bool has_section(const std::string & name) const;
+	/// Returns names of all sections in order of writing.
+	std::vector<std::string> section_names() const;
+	/// Returns raw content of section. Throws Exception if there is no such section.
+	StringView section_data(const std::string & name) const;
+	/// Returns reader for section. Throws Exception if there is no such section.
+	MappedReader section(const std::string & name) const;
+	/// Returns count of indexed parts in savefile.
+	unsigned part_count() const { return parts; }
+	/// Returns false if savefile has incomplete or garbage data after the last valid part.
+	bool is_complete() const { return complete; }
+private:
+	std::shared_ptr<MappedFile> file;
+	std::vector<std::pair<std::string, StringView> > sections;
+	unsigned parts;
+	bool complete;
+	void read_index(const char * data, size_t size);
+	size_t read_part(const char * data, size_t size);
+};
+
+/** Tells whether values of type T can be stored as one raw memory block in binary savefiles.
+ * True for arithmetic types except bool. Can be specialized for POD structs
+ * without pointers and padding, though such blocks cannot be read on machine
+ * with different byte order.
+ */
+template<class T>
+struct TriviallySerializable : std::integral_constant<bool,
+	std::is_arithmetic<T>::value && !std::is_same<T, bool>::value
+	> {};
+
+/// @cond INTERNAL
+/// Returns byte order tag of the current machine: 1 for little-endian, 2 for big-endian.
+char native_byte_order();
+void swap_block_bytes(char * data, size_t count, size_t element_size);
+
+template<class Savefile, class T>
+void store_block(Savefile & savefile, const T * values, unsigned count, std::true_type)
+{
+	savefile.store(native_byte_order()).store(unsigned(sizeof(T)));
+	if(count > 0) {
+		savefile.store_block(reinterpret_cast<const char *>(values), count * sizeof(T));
+	}
+}
+template<class Savefile, class Pointer>
+void store_block(Savefile & savefile, Pointer values, unsigned count, std::false_type)
+{
+	for(unsigned i = 0; i < count; ++i) {
+		store(savefile, values[i]);
+	}
+}
+
+/// Returns count of elements of given size which are read at once.
+inline size_t read_chunk_size(size_t element_size) { return std::max<size_t>(1, 65536 / element_size); }
+
+/// Elements are read by chunks, so corrupted count does not lead to huge allocation.
+template<class Savefile, class T>
+void read_block(Savefile & savefile, std::vector<T> & values, unsigned count, std::true_type)
+{
+	char byte_order = 0;
+	unsigned element_size = 0;
+	savefile.store(byte_order).store(element_size);
+	if(element_size != sizeof(T)) {
+		throw typename Savefile::Exception(format(
+					"Savefile has block of elements with size {0}, which is incompatible with element size {1}.",
+					element_size, unsigned(sizeof(T))
+					));
+	}
+	values.clear();
+	while(values.size() < count) {
+		size_t start = values.size();
+		if(start > 0) {
+			savefile.check("block");
+		}
+		values.resize(start + std::min<size_t>(count - start, read_chunk_size(sizeof(T))));
+		savefile.store_block(reinterpret_cast<char *>(values.data() + start), (values.size() - start) * sizeof(T));
+	}
+	if(count > 0 && byte_order != native_byte_order()) {
+		if(!std::is_arithmetic<T>::value) {
+			throw typename Savefile::Exception("Savefile has block of elements with different byte order.");
+		}
+		swap_block_bytes(reinterpret_cast<char *>(values.data()), count, sizeof(T));
+	}
+}
+template<class Savefile, class T>
+void read_block(Savefile & savefile, std::vector<T> & values, unsigned count, std::false_type)
+{
+	values.clear();
+	while(values.size() < count) {
+		size_t start = values.size();
+		if(start > 0) {
+			savefile.check("elements");
+		}
+		values.resize(start + std::min<size_t>(count - start, read_chunk_size(sizeof(T))));
+		for(size_t i = start; i < values.size(); ++i) {
+			store(savefile, values[i]);
+		}
+	}
+}
+
+template<class Savefile, class T>
+struct StoreAsBlock : std::integral_constant<bool,
+	Savefile::BINARY && TriviallySerializable<typename std::remove_const<T>::type>::value
+	> {};
+
+template<class Savefile, class T>
+void store_elements(Savefile & savefile, const T * values, unsigned count)
+{
+	store_block(savefile, values, count, StoreAsBlock<Savefile, T>());
+}
+template<class Savefile, class T>
+void read_elements(Savefile & savefile, std::vector<T> & values, unsigned count)
+{
+	read_block(savefile, values, count, StoreAsBlock<Savefile, T>());
+}
+/// @endcond
+
+/// @cond INTERNAL
+template<class Savefile>
+struct IsReading : std::integral_constant<bool, Savefile::READING> {};
+
+template<class Savefile, class T>
+void store_vector_values(Savefile & savefile, std::vector<T> & values, std::true_type)
+{
+	unsigned size = 0;
+	savefile.store(size);
+	read_elements(savefile, values, size);
+}
+template<class Savefile, class T>
+void store_vector_values(Savefile & savefile, const std::vector<T> & values, std::false_type)
+{
+	savefile.store(unsigned(values.size()));
+	store_elements(savefile, values.data(), unsigned(values.size()));
+}
+
+template<class Savefile, class T>
+void store_map_values(Savefile & savefile, Map<T> & map, std::true_type)
+{
+	unsigned width = 0, height = 0;
+	savefile.store(width).store(height);
+	if(height > 0 && width > unsigned(std::numeric_limits<int>::max()) / height) {
+		throw typename Savefile::Exception(format("Savefile has map of too large size {0}x{1}.", width, height));
+	}
+	std::vector<T> cells;
+	read_elements(savefile, cells, width * height);
+	map = Map<T>(width, height, cells.begin(), cells.end());
+}
+template<class Savefile, class T>
+void store_map_values(Savefile & savefile, const Map<T> & map, std::false_type)
+{
+	savefile.store(map.width()).store(map.height());
+	store_elements(savefile, map.begin() == map.end() ? nullptr : map.data(), map.width() * map.height());
+}
+/// @endcond
+
+/** Stores vector size followed by its elements.
+ * In binary savefiles vectors of trivially serializable types
+ * are stored as one raw memory block, other types are stored element by element.
+ * @see TriviallySerializable
+ */
+template<class Savefile, class T>
+void store(Savefile & savefile, std::vector<T> & values, const char * section = nullptr)
+{
+	store_vector_values(savefile, values, IsReading<Savefile>());
+	if(section) { savefile.check(section); }
+}
+/// @cond INTERNAL
+template<class Savefile, class T>
+void store(Savefile & savefile, const std::vector<T> & values, const char * section = nullptr)
+{
+	store_vector_values(savefile, values, std::false_type());
+	if(section) { savefile.check(section); }
+}
+/// @endcond
+
+/** Stores map size followed by its cells.
+ * Cells are stored in the same way as vector elements.
+ */
+template<class Savefile, class T>
+void store(Savefile & savefile, Map<T> & map, const char * section = nullptr)
+{
+	store_map_values(savefile, map, IsReading<Savefile>());
+	if(section) { savefile.check(section); }
+}
+/// @cond INTERNAL
+template<class Savefile, class T>
+void store(Savefile & savefile, const Map<T> & map, const char * section = nullptr)
+{
+	store_map_values(savefile, map, std::false_type());
+	if(section) { savefile.check(section); }
+}
+/// @endcond
+
 /// @}
 }
@@ -1,4 +1,5 @@
 #include "format.h"
+#include "util.h"
 #include <sstream>
 
 namespace Chthon {
@@ -39,6 +40,11 @@ std::string to_string(const char * value)
 	return value;
 }
 
+std::string to_string(const StringView & value)
+{
+	return value.str();
+}
+
 
 /// @cond INTERNAL
 Spec::Spec(const std::string & _spec)
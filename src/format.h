@@ -6,6 +6,8 @@
 namespace Chthon { /// @defgroup Format String formatting utilities
 /// @{
 
+class StringView;
+
 /// Converts boolean value to string ("true"/"false").
 std::string to_string(bool value);
 /// Converts integer value to string.
@@ -20,6 +22,8 @@ std::string to_string(char value);
 std::string to_string(const std::string & value);
 /// Converts c-string value to string (does nothing, basically).
 std::string to_string(const char * value);
+/// Converts string view to string.
+std::string to_string(const StringView & value);
 /// Converts pointer to an integer value of its address.
 template<class T>
 std::string to_string(const T * value)
@@ -1,14 +1,20 @@
 #include "game.h"
 #include "actions.h"
+#include "replay.h"
+#include "savegame.h"
 #include "monsters.h"
 #include "format.h"
 #include "log.h"
 #include <map>
 #include <memory>
+#include <mutex>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <cstdlib>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 
 namespace Chthon {
 
@@ -28,28 +34,218 @@ std::string to_string(const GameEvent & e)
 }
 
 
+struct Game::LevelScratch {
+	std::mutex mutex;
+	std::fstream file;
+	/// Capacity of each written slot, which does not change when slot is reused.
+	std::map<std::streampos, std::streamoff> slot_sizes;
+};
+
+/// Everything needed to write savefile, taken at the moment of save.
+struct Game::SaveSnapshot {
+	State state;
+	int turns;
+	int current_level_index;
+	std::vector<uint32_t> random_state;
+	/// Levels to write. They point either to levels of the game or to level_copies.
+	std::map<int, const Level *> levels;
+	std::map<int, Level> level_copies;
+	std::map<int, std::streampos> evicted_levels;
+	std::shared_ptr<LevelScratch> scratch;
+	std::shared_ptr<IndexedReader> savefile;
+	std::set<int> saved_levels;
+	/// If set, only changed levels are appended to existing savefile.
+	bool only_changes;
+	std::set<int> changed_levels;
+};
+
 Game::Game()
-	: state(PLAYING), turns(0), current_level_index(0)
+	: state(PLAYING), turns(0), current_level_index(0),
+	recording(nullptr), pregenerate_levels(false), forced_controller(nullptr), running(false), origin(nullptr),
+	level_seed(random.seed()),
+	max_resident_levels(0), appended_parts(0), max_appended_parts(8), autosave_interval(0)
+{
+}
+
+Game::Game(const Game & other)
+	: state(PLAYING), turns(0), current_level_index(0),
+	recording(nullptr), pregenerate_levels(false), forced_controller(nullptr), running(false), origin(nullptr),
+	level_seed(0),
+	max_resident_levels(0), appended_parts(0), max_appended_parts(8), autosave_interval(0)
+{
+	copy_state(other);
+}
+
+Game::Game(const Game & other, ForkTag)
+	: state(other.state), turns(other.turns), events(other.events),
+	current_level_index(other.current_level_index),
+	controller_factory(other.controller_factory), random(other.random),
+	recording(nullptr), pregenerate_levels(other.pregenerate_levels), forced_controller(nullptr), running(false),
+	origin(&other), borrowed_levels(other.borrowed_levels), level_seed(other.level_seed),
+	max_resident_levels(other.max_resident_levels), recent_levels(other.recent_levels),
+	evicted_levels(other.evicted_levels), scratch(other.scratch), free_scratch_slots(other.free_scratch_slots),
+	savefile(other.savefile), saved_levels(other.saved_levels),
+	changed_levels(other.changed_levels), appended_parts(0), max_appended_parts(other.max_appended_parts),
+	autosave_interval(0)
 {
+	typedef std::pair<const int, Level> LevelEntry;
+	foreach(const LevelEntry & entry, other.levels) {
+		borrowed_levels.insert(entry.first);
+	}
+}
+
+Game & Game::operator=(const Game & other)
+{
+	if(this != &other) {
+		join_pregeneration();
+		pending_levels.clear();
+		if(background_save.valid()) {
+			background_save.wait();
+		}
+		background_save = std::future<void>();
+		copy_state(other);
+	}
+	return *this;
 }
 
+/// Recording, autosave and appending to the savefile of the other game are not copied,
+/// so the copy does not write into the same files.
+void Game::copy_state(const Game & other)
+{
+	state = other.state;
+	turns = other.turns;
+	events = other.events;
+	current_level_index = other.current_level_index;
+	levels = other.levels;
+	cell_types = other.cell_types;
+	monster_types = other.monster_types;
+	object_types = other.object_types;
+	item_types = other.item_types;
+	controller_factory = other.controller_factory;
+	random = other.random;
+	recording = nullptr;
+	pregenerate_levels = other.pregenerate_levels;
+	origin = other.origin;
+	borrowed_levels = other.borrowed_levels;
+	level_seed = other.level_seed;
+	max_resident_levels = other.max_resident_levels;
+	recent_levels = other.recent_levels;
+	evicted_levels = other.evicted_levels;
+	scratch = other.scratch;
+	free_scratch_slots = other.free_scratch_slots;
+	savefile = other.savefile;
+	saved_levels = other.saved_levels;
+	changed_levels = other.changed_levels;
+	last_save_filename.clear();
+	appended_parts = 0;
+	max_appended_parts = other.max_appended_parts;
+	autosave_interval = 0;
+	autosave_filename.clear();
+}
+
+const Game & Game::type_source() const
+{
+	return origin ? origin->type_source() : *this;
+}
+
+/// Background generation is already joined by run(), so only background save is waited for.
 Game::~Game()
 {
+	if(background_save.valid()) {
+		background_save.wait();
+	}
 }
 
+/// Levels are generated with the seed which the game generator has at this moment;
+/// levels generated with the previous seed are dropped.
 void Game::create_new_game()
 {
+	join_pregeneration();
+	pending_levels.clear();
+	level_seed = random.seed();
 	go_to_level(1);
 }
 
+void Game::record(Replay & replay)
+{
+	random = Random(replay.seed);
+	replay.actions.clear();
+	recording = &replay;
+}
+
+/// Levels and state of already played game are dropped, so create_new_game() generates levels anew.
+void Game::playback(const Replay & replay)
+{
+	Replay * old_recording = recording;
+	ReplayController controller(replay);
+	clear_levels();
+	savefile.reset();
+	saved_levels.clear();
+	last_save_filename.clear();
+	state = PLAYING;
+	turns = 0;
+	events.clear();
+	current_level_index = 0;
+	random = Random(replay.seed);
+	recording = nullptr;
+	forced_controller = &controller;
+	create_new_game();
+	run();
+	forced_controller = nullptr;
+	recording = old_recording;
+}
+
+/// Current level is only looked up, it is not marked as changed.
 Level & Game::current_level()
 {
-	return levels[current_level_index];
+	std::map<int, Level>::iterator found = levels.find(current_level_index);
+	if(found != levels.end()) {
+		return found->second;
+	}
+	return access_level(current_level_index);
 }
 
 const Level & Game::current_level() const
 {
-	return levels.find(current_level_index)->second;
+	return *find_level(current_level_index);
+}
+
+const Level * Game::find_level(int level_index) const
+{
+	std::map<int, Level>::const_iterator found = levels.find(level_index);
+	if(found != levels.end()) {
+		return &found->second;
+	}
+	if(borrowed_levels.count(level_index) > 0) {
+		return origin->find_level(level_index);
+	}
+	return nullptr;
+}
+
+Level & Game::level(int level_index)
+{
+	mark_changed(level_index);
+	return access_level(level_index);
+}
+
+void Game::mark_changed(int level_index)
+{
+	changed_levels.insert(level_index);
+}
+
+Level & Game::access_level(int level_index)
+{
+	if(!evicted_levels.empty() || !saved_levels.empty()) {
+		restore_level(level_index);
+	}
+	std::map<int, Level>::iterator found = levels.find(level_index);
+	if(found != levels.end()) {
+		return found->second;
+	}
+	if(borrowed_levels.erase(level_index) > 0) {
+		return levels[level_index] = *origin->find_level(level_index);
+	}
+	return levels[level_index];
 }
 
 void Game::go_to_level(int level_index)
@@ -57,35 +253,529 @@ void Game::go_to_level(int level_index)
 	Monster player = current_level().get_player();
 
 	current_level_index = level_index;
-	if(levels.count(level_index) == 0) {
-		generate(current_level(), current_level_index);
+	if(levels.count(level_index) == 0 && borrowed_levels.count(level_index) == 0 && !restore_level(level_index)) {
+		auto pending = pending_levels.find(level_index);
+		if(pending != pending_levels.end()) {
+			levels[level_index] = take_pending_level(pending->second, level_index);
+			pending_levels.erase(pending);
+		} else {
+			generate(current_level(), current_level_index);
+		}
 	}
+	mark_changed(current_level_index);
 	if(player.valid()) {
 		player.pos = current_level().get_player().pos;
 		current_level().get_player() = player;
 	} else {
 		log("Player wasn't found on the level when travelling!");
 	}
+	if(pregenerate_levels) {
+		pregenerate_adjacent_levels();
+	}
+	if(max_resident_levels > 0) {
+		recent_levels.remove(level_index);
+		recent_levels.push_front(level_index);
+		evict_levels();
+	}
+}
+
+bool Game::has_level(int level_index) const
+{
+	return levels.count(level_index) > 0 || borrowed_levels.count(level_index) > 0 || pending_levels.count(level_index) > 0
+		|| is_evicted(level_index) || is_saved(level_index);
+}
+
+void Game::set_level_cache(unsigned resident_levels_limit, const std::string & scratch_filename)
+{
+	while(!evicted_levels.empty()) {
+		load_evicted_level(evicted_levels.begin()->first);
+	}
+	scratch.reset();
+	evicted_levels.clear();
+	free_scratch_slots.clear();
+	max_resident_levels = resident_levels_limit;
+	if(max_resident_levels > 0) {
+		scratch = std::make_shared<LevelScratch>();
+		scratch->file.open(scratch_filename.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+		if(!scratch->file.good()) {
+			log("Cannot open level scratch file <{0}>, level cache is disabled.", scratch_filename);
+			max_resident_levels = 0;
+		}
+	}
+	recent_levels.clear();
+	typedef std::pair<const int, Level> LevelEntry;
+	foreach(const LevelEntry & entry, levels) {
+		if(entry.first != current_level_index) {
+			recent_levels.push_back(entry.first);
+		}
+	}
+	recent_levels.push_front(current_level_index);
+	evict_levels();
+}
+
+bool Game::is_evicted(int level_index) const
+{
+	return evicted_levels.count(level_index) > 0;
+}
+
+void Game::evict_levels()
+{
+	if(max_resident_levels == 0) {
+		return;
+	}
+	while(levels.size() > max_resident_levels && !recent_levels.empty()) {
+		int level_index = recent_levels.back();
+		if(level_index == current_level_index) {
+			break;
+		}
+		recent_levels.pop_back();
+		if(levels.count(level_index) == 0) {
+			continue;
+		}
+		std::ostringstream buffer;
+		BinaryWriter writer(buffer);
+		store(writer, static_cast<const Level &>(levels[level_index]), *this);
+		writer.newline();
+		writer.check(format("level {0}", level_index));
+		evicted_levels[level_index] = write_scratch_slot(buffer.str());
+		levels.erase(level_index);
+		borrowed_levels.erase(level_index);
+	}
+}
+
+/// Free slots are reused only when scratch file is not shared with forks or background save,
+/// as they still may refer to levels in them.
+std::streampos Game::write_scratch_slot(const std::string & data)
+{
+	std::streamoff size = std::streamoff(data.size());
+	std::lock_guard<std::mutex> lock(scratch->mutex);
+	std::set<std::streampos>::iterator slot = free_scratch_slots.end();
+	if(scratch.use_count() == 1) {
+		for(std::set<std::streampos>::iterator i = free_scratch_slots.begin(); i != free_scratch_slots.end(); ++i) {
+			std::streamoff capacity = scratch->slot_sizes[*i];
+			if(capacity >= size && (slot == free_scratch_slots.end() || capacity < scratch->slot_sizes[*slot])) {
+				slot = i;
+			}
+		}
+	}
+	scratch->file.clear();
+	std::streampos position;
+	if(slot != free_scratch_slots.end()) {
+		position = *slot;
+		free_scratch_slots.erase(slot);
+		scratch->file.seekp(position);
+	} else {
+		scratch->file.seekp(0, std::ios::end);
+		position = scratch->file.tellp();
+		scratch->slot_sizes[position] = size;
+	}
+	scratch->file.write(data.data(), size);
+	scratch->file.flush();
+	if(!scratch->file.good()) {
+		throw BinaryWriter::Exception("Error: cannot write level into scratch file.");
+	}
+	return position;
+}
+
+/// @cond INTERNAL
+template<class Scratch>
+void read_scratch_level(Scratch & scratch, std::streampos position, int level_index, const Game & game, Level & level)
+{
+	Level loaded;
+	std::lock_guard<std::mutex> lock(scratch.mutex);
+	scratch.file.clear();
+	scratch.file.seekg(position);
+	BinaryReader reader(scratch.file);
+	store(reader, loaded, game);
+	reader.check(format("level {0}", level_index));
+	std::swap(level, loaded);
+}
+/// @endcond
+
+void Game::load_evicted_level(int level_index)
+{
+	read_scratch_level(*scratch, evicted_levels[level_index], level_index, *this, levels[level_index]);
+	free_scratch_slots.insert(evicted_levels[level_index]);
+	evicted_levels.erase(level_index);
+	if(level_index != current_level_index) {
+		recent_levels.remove(level_index);
+		recent_levels.push_back(level_index);
+	}
+}
+
+bool Game::restore_level(int level_index)
+{
+	if(evicted_levels.count(level_index) > 0) {
+		load_evicted_level(level_index);
+		return true;
+	}
+	if(saved_levels.count(level_index) == 0) {
+		return false;
+	}
+	std::string section = format("level {0}", level_index);
+	Level loaded;
+	MappedReader reader = savefile->section(section);
+	store(reader, loaded, *this);
+	reader.check(section);
+	std::swap(levels[level_index], loaded);
+	saved_levels.erase(level_index);
+	if(max_resident_levels > 0 && level_index != current_level_index) {
+		recent_levels.remove(level_index);
+		recent_levels.push_back(level_index);
+	}
+	return true;
+}
+
+bool Game::is_saved(int level_index) const
+{
+	return saved_levels.count(level_index) > 0;
+}
+
+/// @cond INTERNAL
+template<class Savefile, class Type>
+void store_type_ids(Savefile & savefile, const std::map<std::string, Type> & types)
+{
+	std::vector<std::string> ids;
+	typedef std::pair<const std::string, Type> TypeEntry;
+	foreach(const TypeEntry & entry, types) {
+		ids.push_back(entry.first);
+	}
+	store(savefile, static_cast<const std::vector<std::string> &>(ids));
+}
+
+template<class Type>
+void check_type_ids(MappedReader & reader, const std::map<std::string, Type> & types)
+{
+	std::vector<std::string> ids;
+	store(reader, ids, "types");
+	foreach(const std::string & id, ids) {
+		if(types.count(id) == 0) {
+			throw IndexedReader::Exception("Error: savefile uses unknown type " + escaped(id) + ".");
+		}
+	}
+}
+/// @endcond
+
+/// Full save is forced if savefile has too many parts or is not based on this game's last save.
+std::shared_ptr<Game::SaveSnapshot> Game::make_snapshot(const std::string & filename, bool only_changes)
+{
+	if(only_changes && (filename != last_save_filename || appended_parts >= max_appended_parts)) {
+		only_changes = false;
+	}
+	std::shared_ptr<SaveSnapshot> snapshot = std::make_shared<SaveSnapshot>();
+	snapshot->state = state;
+	snapshot->turns = turns;
+	snapshot->current_level_index = current_level_index;
+	snapshot->random_state = random.get_state();
+	typedef std::pair<const int, Level> LevelEntry;
+	foreach(const LevelEntry & entry, levels) {
+		snapshot->levels[entry.first] = &entry.second;
+	}
+	foreach(int level_index, borrowed_levels) {
+		snapshot->levels[level_index] = find_level(level_index);
+	}
+	snapshot->evicted_levels = evicted_levels;
+	snapshot->scratch = scratch;
+	snapshot->savefile = savefile;
+	snapshot->saved_levels = saved_levels;
+	snapshot->only_changes = only_changes;
+	snapshot->changed_levels = changed_levels;
+	appended_parts = only_changes ? appended_parts + 1 : 0;
+	last_save_filename = filename;
+	changed_levels.clear();
+	return snapshot;
+}
+
+void Game::save(const std::string & filename)
+{
+	if(background_save.valid()) {
+		background_save.wait();
+	}
+	try {
+		write_snapshot(*make_snapshot(filename, false), filename);
+	} catch(...) {
+		last_save_filename.clear();
+		throw;
+	}
+}
+
+void Game::save_changes(const std::string & filename)
+{
+	if(background_save.valid()) {
+		background_save.wait();
+	}
+	try {
+		write_snapshot(*make_snapshot(filename, true), filename);
+	} catch(...) {
+		last_save_filename.clear();
+		throw;
+	}
+}
+
+void Game::set_save_compaction(unsigned max_parts)
+{
+	max_appended_parts = max_parts;
+}
+
+bool Game::is_changed(int level_index) const
+{
+	return changed_levels.count(level_index) > 0;
+}
+
+void Game::save_in_background(const std::string & filename, bool only_changes)
+{
+	wait_for_background_save();
+	std::shared_ptr<SaveSnapshot> snapshot = make_snapshot(filename, only_changes);
+	typedef std::pair<const int, const Level *> LevelEntry;
+	foreach(LevelEntry & entry, snapshot->levels) {
+		if(!snapshot->only_changes || snapshot->changed_levels.count(entry.first) > 0) {
+			entry.second = &(snapshot->level_copies[entry.first] = *entry.second);
+		}
+	}
+	background_save = std::async(std::launch::async, [this, snapshot, filename]() {
+		write_snapshot(*snapshot, filename);
+	});
+}
+
+void Game::wait_for_background_save()
+{
+	if(!background_save.valid()) {
+		return;
+	}
+	try {
+		background_save.get();
+	} catch(...) {
+		last_save_filename.clear();
+		throw;
+	}
+}
+
+void Game::set_autosave(unsigned turns_interval, const std::string & filename)
+{
+	autosave_interval = turns_interval;
+	autosave_filename = filename;
+}
+
+/** Game changes its levels in place, so background save gets copies of levels to write.
+ * Levels in scratch file are read back one by one.
+ * Changes are appended to the savefile as is, since incomplete last part is ignored by IndexedReader.
+ */
+void Game::write_snapshot(const SaveSnapshot & snapshot, const std::string & filename) const
+{
+	std::vector<int> level_indices;
+	typedef std::pair<const int, const Level *> LevelEntry;
+	foreach(const LevelEntry & entry, snapshot.levels) {
+		level_indices.push_back(entry.first);
+	}
+	typedef std::pair<const int, std::streampos> EvictedEntry;
+	foreach(const EvictedEntry & entry, snapshot.evicted_levels) {
+		level_indices.push_back(entry.first);
+	}
+	level_indices.insert(level_indices.end(), snapshot.saved_levels.begin(), snapshot.saved_levels.end());
+	std::sort(level_indices.begin(), level_indices.end());
+
+	std::string temp_filename = snapshot.only_changes ? filename : filename + ".tmp";
+	{
+		std::ofstream out(temp_filename.c_str(), snapshot.only_changes
+				? std::ios::out | std::ios::app | std::ios::binary
+				: std::ios::out | std::ios::trunc | std::ios::binary
+				);
+		if(!out.is_open()) {
+			throw IndexedWriter::Exception("Error: cannot open savefile " + escaped(filename) + " for writing.");
+		}
+		IndexedWriter writer(out);
+		if(!snapshot.only_changes) {
+			BinaryWriter & types_writer = writer.section("types");
+			store_type_ids(types_writer, type_source().cell_types);
+			store_type_ids(types_writer, type_source().monster_types);
+			store_type_ids(types_writer, type_source().object_types);
+			store_type_ids(types_writer, type_source().item_types);
+		}
+
+		BinaryWriter & game_writer = writer.section("game");
+		game_writer.version(1, 0);
+		game_writer.store(int(snapshot.state)).store(snapshot.turns).store(snapshot.current_level_index);
+		store(game_writer, snapshot.random_state);
+		store(game_writer, static_cast<const std::vector<int> &>(level_indices));
+
+		foreach(int level_index, level_indices) {
+			if(snapshot.only_changes && snapshot.changed_levels.count(level_index) == 0) {
+				continue;
+			}
+			std::string section = format("level {0}", level_index);
+			if(snapshot.saved_levels.count(level_index) > 0) {
+				writer.add_section(section, snapshot.savefile->section_data(section));
+				continue;
+			}
+			std::map<int, std::streampos>::const_iterator evicted = snapshot.evicted_levels.find(level_index);
+			if(evicted != snapshot.evicted_levels.end()) {
+				Level level;
+				read_scratch_level(*snapshot.scratch, evicted->second, level_index, *this, level);
+				store(writer.section(section), static_cast<const Level &>(level), *this);
+				continue;
+			}
+			store(writer.section(section), static_cast<const Level &>(*snapshot.levels.find(level_index)->second), *this);
+		}
+		writer.finish();
+	}
+	if(snapshot.only_changes) {
+		return;
+	}
+	if(std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+		std::remove(temp_filename.c_str());
+		throw IndexedWriter::Exception("Error: cannot write savefile " + escaped(filename) + ".");
+	}
+}
+
+void Game::load(const std::string & filename)
+{
+	if(background_save.valid()) {
+		background_save.wait();
+	}
+	std::shared_ptr<IndexedReader> reader = std::make_shared<IndexedReader>(filename);
+	MappedReader types_reader = reader->section("types");
+	check_type_ids(types_reader, type_source().cell_types);
+	check_type_ids(types_reader, type_source().monster_types);
+	check_type_ids(types_reader, type_source().object_types);
+	check_type_ids(types_reader, type_source().item_types);
+
+	MappedReader game_reader = reader->section("game");
+	game_reader.version(1, 0);
+	int state_value = 0, saved_turns = 0, saved_level_index = 0;
+	std::vector<uint32_t> random_state;
+	std::vector<int> level_indices;
+	game_reader.store(state_value).store(saved_turns).store(saved_level_index);
+	store(game_reader, random_state);
+	store(game_reader, level_indices);
+	game_reader.check("game");
+
+	clear_levels();
+	savefile = reader;
+	saved_levels = std::set<int>(level_indices.begin(), level_indices.end());
+	// Changes appended after torn tail would be ignored, so the next save should rewrite the whole file.
+	last_save_filename = reader->is_complete() ? filename : std::string();
+	appended_parts = reader->part_count() - 1;
+	state = State(state_value);
+	turns = saved_turns;
+	current_level_index = saved_level_index;
+	random.set_state(random_state);
+	level_seed = random.seed();
+	restore_level(current_level_index);
+	if(max_resident_levels > 0) {
+		recent_levels.push_front(current_level_index);
+	}
+}
+
+/// Generated levels would be dropped anyway, so generation which is not started yet is not done.
+void Game::clear_levels()
+{
+	join_pregeneration();
+	pending_levels.clear();
+	levels.clear();
+	borrowed_levels.clear();
+	typedef std::pair<const int, std::streampos> EvictedEntry;
+	foreach(const EvictedEntry & entry, evicted_levels) {
+		free_scratch_slots.insert(entry.second);
+	}
+	evicted_levels.clear();
+	recent_levels.clear();
+	changed_levels.clear();
+}
+
+void Game::pregenerate_adjacent_levels()
+{
+	std::vector<int> destinations;
+	foreach(const Object & object, current_level().objects) {
+		if(!deref_default(object.type).transporting) {
+			continue;
+		}
+		if(object.up_destination > 0) {
+			destinations.push_back(object.up_destination);
+		}
+		if(object.down_destination > 0) {
+			destinations.push_back(object.down_destination);
+		}
+	}
+	foreach(int level_index, destinations) {
+		if(!has_level(level_index)) {
+			pending_levels[level_index];
+		}
+	}
+	if(running) {
+		start_pregeneration();
+	}
+}
+
+void Game::start_pregeneration()
+{
+	typedef std::pair<const int, std::future<Level> > PendingLevel;
+	foreach(PendingLevel & pending, pending_levels) {
+		if(pending.second.valid()) {
+			continue;
+		}
+		int level_index = pending.first;
+		pending.second = std::async(std::launch::async, [this, level_index]() {
+			Level level;
+			generate(level, level_index);
+			return level;
+		});
+	}
+}
+
+/// Results (and exceptions) of generation are kept in futures until levels are taken.
+void Game::join_pregeneration()
+{
+	typedef std::pair<const int, std::future<Level> > PendingLevel;
+	foreach(PendingLevel & pending, pending_levels) {
+		if(pending.second.valid()) {
+			pending.second.wait();
+		}
+	}
+}
+
+/// Level which generation is not started yet is generated on the calling thread.
+Level Game::take_pending_level(std::future<Level> & pending, int level_index)
+{
+	if(pending.valid()) {
+		return pending.get();
+	}
+	Level level;
+	generate(level, level_index);
+	return level;
+}
+
+void Game::wait_for_pregeneration()
+{
+	typedef std::pair<const int, std::future<Level> > PendingLevel;
+	foreach(PendingLevel & pending, pending_levels) {
+		levels[pending.first] = take_pending_level(pending.second, pending.first);
+	}
+	pending_levels.clear();
+}
+
+Random Game::level_random(int level_index) const
+{
+	return Random(Random::derive_seed(level_seed, uint32_t(level_index)));
 }
 
 const ItemType * Game::item_type(const std::string & id) const
 {
-	return get_pointer(item_types, id);
+	return get_pointer(type_source().item_types, id);
 }
 
 const ObjectType * Game::object_type(const std::string & id) const
 {
-	return get_pointer(object_types, id);
+	return get_pointer(type_source().object_types, id);
 }
 
 const MonsterType * Game::monster_type(const std::string & id) const
 {
-	return get_pointer(monster_types, id);
+	return get_pointer(type_source().monster_types, id);
 }
 
 const CellType * Game::cell_type(const std::string & id) const
 {
-	return get_pointer(cell_types, id);
+	return get_pointer(type_source().cell_types, id);
 }
 
 ItemType::Builder Game::add_item_type(const std::string & id)
@@ -110,76 +800,110 @@ CellType::Builder Game::add_cell_type(const std::string & id)
 
 Item::Builder Game::add_item(Level & level, const std::string & type_id)
 {
-	level.items.push_back(Item(get_pointer(item_types, type_id)));
+	level.items.push_back(Item(item_type(type_id)));
 	return Item::Builder(level.items.back());
 }
 
 Item::Builder Game::add_item(Level & level, const std::string & full_type_id, const std::string & empty_type_id)
 {
-	level.items.push_back(Item(get_pointer(item_types, full_type_id), get_pointer(item_types, empty_type_id)));
+	level.items.push_back(Item(item_type(full_type_id), item_type(empty_type_id)));
 	return Item::Builder(level.items.back());
 }
 
 Object::Builder Game::add_object(Level & level, const std::string & type_id)
 {
-	level.objects.push_back(Object(get_pointer(object_types, type_id)));
+	level.objects.push_back(Object(object_type(type_id)));
 	return Object::Builder(level.objects.back());
 }
 
 Object::Builder Game::add_object(Level & level, const std::string & closed_type_id, const std::string & opened_type_id)
 {
-	level.objects.push_back(Object(get_pointer(object_types, closed_type_id), get_pointer(object_types, opened_type_id)));
+	level.objects.push_back(Object(object_type(closed_type_id), object_type(opened_type_id)));
 	return Object::Builder(level.objects.back());
 }
 
 Monster::Builder Game::add_monster(Level & level, const std::string & type_id)
 {
-	level.monsters.push_back(Monster(get_pointer(monster_types, type_id)));
+	level.monsters.push_back(Monster(monster_type(type_id)));
 	return Monster::Builder(level.monsters.back());
 }
 
 Item::Builder Game::add_item(const std::string & type_id)
 {
+	mark_changed(current_level_index);
 	return add_item(current_level(), type_id);
 }
 
 Item::Builder Game::add_item(const std::string & full_type_id, const std::string & empty_type_id)
 {
+	mark_changed(current_level_index);
 	return add_item(current_level(), full_type_id, empty_type_id);
 }
 
 Object::Builder Game::add_object(const std::string & type_id)
 {
+	mark_changed(current_level_index);
 	return add_object(current_level(), type_id);
 }
 
 Object::Builder Game::add_object(const std::string & closed_type_id, const std::string & opened_type_id)
 {
+	mark_changed(current_level_index);
 	return add_object(current_level(), closed_type_id, opened_type_id);
 }
 
 Monster::Builder Game::add_monster(const std::string & type_id)
 {
+	mark_changed(current_level_index);
 	return add_monster(current_level(), type_id);
 }
 
 
+/// Background generation is started on entry and joined on exit, even if exception is thrown.
 void Game::run()
 {
+	struct RunningScope {
+		Game & game;
+		bool was_running;
+		RunningScope(Game & running_game) : game(running_game), was_running(running_game.running)
+		{
+			game.running = true;
+			game.start_pregeneration();
+		}
+		~RunningScope()
+		{
+			game.running = was_running;
+			if(!was_running) {
+				game.join_pregeneration();
+			}
+		}
+	} running_scope(*this);
 	state = PLAYING;
 	while(state == PLAYING) {
+		bool acted = false;
 		foreach(Monster & monster, current_level().monsters) {
 			if(monster.is_dead()) {
 				continue;
 			}
-			Controller * controller = controller_factory.get_controller(deref_default(monster.type).ai);
+			Controller * controller = forced_controller;
+			if(!controller) {
+				controller = controller_factory.get_controller(deref_default(monster.type).ai);
+			}
 			if(!controller) {
 				log("No controller found for AI #{0}!", deref_default(monster.type).ai);
 				continue;
 			}
 			current_level().invalidate_fov(monster);
 			Action * action = controller->act(monster, *this);
+			if(forced_controller && !action && state == SUSPENDED) {
+				// Replay is over: recorded session stopped before this decision.
+				break;
+			}
+			if(recording) {
+				recording->record(unsigned(&monster - current_level().monsters.data()), action);
+			}
 			if(action) {
+				acted = true;
 				try {
 					action->commit(monster, *this);
 				} catch(const Action::Exception & e) {
@@ -198,8 +922,14 @@ void Game::run()
 				break;
 			}
 		}
+		if(acted) {
+			mark_changed(current_level_index);
+		}
 		current_level().erase_dead_monsters();
 		++turns;
+		if(autosave_interval > 0 && turns % int(autosave_interval) == 0) {
+			save_in_background(autosave_filename, true);
+		}
 		if(state == TURN_ENDED) {
 			state = PLAYING;
 		}
@@ -223,6 +953,9 @@ void Game::event(const Info & event_actor, GameEvent::EventType event_type, int
 
 void Game::process_environment(Monster & someone)
 {
+	if(someone.poisoning != 0) {
+		mark_changed(current_level_index);
+	}
 	if(current_level().cell_type_at(someone.pos).hurts) {
 		event(current_level().cell_type_at(someone.pos), GameEvent::HURTS, someone);
 		hurt(someone, 1);
@@ -235,6 +968,7 @@ void Game::process_environment(Monster & someone)
 		if(object->items.empty()) {
 			event(*object, GameEvent::TRAP_IS_OUT_OF_ITEMS);
 		} else {
+			mark_changed(current_level_index);
 			event(someone, GameEvent::TRIGGERS, *object);
 			object->items.back().pos = object->pos;
 			current_level().items.push_back(object->items.back());
@@ -253,6 +987,7 @@ void Game::process_environment(Monster & someone)
 
 void Game::die(Monster & someone)
 {
+	mark_changed(current_level_index);
 	Item item;
 	while((item = someone.inventory.take_first_item()).valid()) {
 		item.pos = someone.pos;
@@ -268,6 +1003,7 @@ void Game::die(Monster & someone)
 void Game::hurt(Monster & someone, int damage, bool pierce_armour)
 {
 	int received_damage = damage - (pierce_armour ? 0 : deref_default(someone.inventory.worn_item().type).defence);
+	mark_changed(current_level_index);
 	someone.hp -= received_damage;
 	event(someone, GameEvent::LOSES_HEALTH, received_damage);
 	if(someone.is_dead()) {
@@ -278,6 +1014,7 @@ void Game::hurt(Monster & someone, int damage, bool pierce_armour)
 void Game::hit(Item & item, Monster & other, int damage)
 {
 	int received_damage = damage - deref_default(other.inventory.worn_item().type).defence;
+	mark_changed(current_level_index);
 	other.hp -= received_damage;
 	event(item, GameEvent::HITS_FOR_HEALTH, received_damage, other);
 	if(other.is_dead()) {
@@ -288,6 +1025,7 @@ void Game::hit(Item & item, Monster & other, int damage)
 void Game::hit(Monster & someone, Monster & other, int damage)
 {
 	int received_damage = damage - deref_default(other.inventory.worn_item().type).defence;
+	mark_changed(current_level_index);
 	other.hp -= received_damage;
 	event(someone, GameEvent::HITS_FOR_HEALTH, received_damage, other);
 	if(deref_default(someone.type).poisonous) {
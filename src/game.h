@@ -5,8 +5,12 @@
 #include "ai.h"
 #include "level.h"
 #include "info.h"
+#include "random.h"
 #include <map>
 #include <list>
+#include <set>
+#include <future>
+#include <memory>
 
 namespace Chthon { /// @defgroup Game Game
 /// @{
@@ -41,29 +45,167 @@ struct GameEvent {
 };
 std::string to_string(const GameEvent & e);
 
+struct Replay;
+class IndexedReader;
+
 struct Game {
 	enum State { PLAYING, TURN_ENDED, SUSPENDED, PLAYER_DIED, COMPLETED };
 	State state;
 	int turns;
 	std::vector<GameEvent> events;
 	int current_level_index;
+	/** Visited levels.
+	 * Fork keeps here only levels which it has accessed through current_level() or level(),
+	 * other levels are read from the original game.
+	 */
 	std::map<int, Level> levels;
 
+	/// Type tables. They are empty in forks, see type_source().
 	std::map<std::string, CellType> cell_types;
 	std::map<std::string, MonsterType> monster_types;
 	std::map<std::string, ObjectType> object_types;
 	std::map<std::string, ItemType> item_types;
 	ControllerFactory controller_factory;
+	/// Game random generator. All game randomness should come from it.
+	Random random;
+	/// If set, every action decision made in run() is appended to it.
+	Replay * recording;
+	/** If set, levels reachable by stairs from the current one are generated
+	 * in background after each level change, so go_to_level() does not wait for generate().
+	 * Background threads work only while run() is running: generation requested outside of run()
+	 * starts when run() starts (or is done on the calling thread when level is needed before that),
+	 * and run() waits for started generation before it returns,
+	 * so generate() is never called on partially destroyed game.
+	 * generate() must be safe to call from another thread:
+	 * it should only fill the given level, read type tables and use level_random().
+	 */
+	bool pregenerate_levels;
+
+	/// Tag for fork constructor.
+	struct ForkTag {};
 
 	Game();
+	/** Copies the game with all its levels and type tables.
+	 * Copy does not record replay and does not copy background generation.
+	 */
+	Game(const Game & other);
+	/** Constructs fork of the game.
+	 * Fork uses type tables, controllers and levels of the original game,
+	 * copying each level only when it is accessed through current_level() or level().
+	 * Original game should outlive the fork and should not be changed while fork is used.
+	 * Fork does not record replay and does not wait for background generation.
+	 * @see fork()
+	 */
+	Game(const Game & other, ForkTag);
 	virtual ~Game();
+	/// Copies the game like copy constructor does.
+	Game & operator=(const Game & other);
+	/** Returns cheap fork of the game for lookahead simulations.
+	 * GameType should be the actual type of the game with fork constructor:
+	 * @code{.cpp}
+	 * MyGame(const MyGame & other, ForkTag tag) : Game(other, tag) {}
+	 * ...
+	 * MyGame simulation = game.fork<MyGame>();
+	 * simulation.run();
+	 * @endcode
+	 */
+	template<class GameType>
+	GameType fork() const { return GameType(static_cast<const GameType &>(*this), ForkTag()); }
+	/// Returns game which type tables are used by this game: the original game for forks, this game otherwise.
+	const Game & type_source() const;
 	void create_new_game();
 	void run();
 	virtual void generate(Level & level, int level_index) = 0;
 
+	/** Starts recording game session into replay.
+	 * Game random generator is reseeded using replay seed and replay actions are cleared,
+	 * so recording should be started before create_new_game().
+	 */
+	void record(Replay & replay);
+	/** Replays recorded session headlessly, without AI.
+	 * Levels and state of the game are cleared, then game is reseeded, created anew
+	 * and run with all monsters controlled by the replay.
+	 * Returns when replay is over or game is not playing anymore.
+	 */
+	void playback(const Replay & replay);
+
+	/** Returns current level. It is not marked as changed,
+	 * so changes made directly through it should be marked with mark_changed().
+	 */
 	Level & current_level();
 	const Level & current_level() const;
+	/** Returns level by index for changing, creating empty one if needed, and marks it as changed.
+	 * Fork copies level of the original game first.
+	 */
+	Level & level(int level_index);
 	void go_to_level(int level);
+	/** Returns generator for level generation.
+	 * It depends only on the game seed (as it was when the game was created or loaded) and level index,
+	 * not on the game history, so generate() produces the same level whenever and wherever it is called.
+	 */
+	Random level_random(int level_index) const;
+	/// Returns true if level was either visited or generated in background.
+	bool has_level(int level_index) const;
+	/// Waits for all background generation to finish (generating levels which are not started yet) and stores generated levels.
+	void wait_for_pregeneration();
+	/** Limits count of levels kept in memory. Zero limit (default) means no limit.
+	 * When limit is exceeded, least recently visited levels are written to the scratch file
+	 * and removed from `levels`. They are read back on demand when visited again.
+	 * Space of levels read back is reused by later evictions if it is not needed by forks or background save.
+	 * Scratch file is truncated on the next set_level_cache() call.
+	 * All types used in levels should be registered in the game.
+	 */
+	void set_level_cache(unsigned resident_levels_limit, const std::string & scratch_filename);
+	/// Returns true if level is currently stored in the scratch file.
+	bool is_evicted(int level_index) const;
+	/** Saves game into indexed savefile, where each level has its own section.
+	 * Savefile is written to temporary file first and then renamed,
+	 * so existing savefile is replaced only by complete one.
+	 * Throws IndexedWriter::Exception if file cannot be written.
+	 */
+	void save(const std::string & filename);
+	/** Loads game saved by save(). All types should be registered beforehand.
+	 * Only current level is read immediately, other levels are read on demand
+	 * when they are visited or requested via level().
+	 * Throws IndexedReader::Exception or MappedReader::Exception if savefile is invalid.
+	 */
+	void load(const std::string & filename);
+	/// Returns true if level is present in the loaded savefile but is not read yet.
+	bool is_saved(int level_index) const;
+	/** Saves only levels changed since the last save or load.
+	 * Game state and changed levels are appended to the savefile as a new part,
+	 * which replaces corresponding sections of the previous parts on load().
+	 * Level is considered changed when it is accessed via level(), visited by go_to_level(),
+	 * changed by actions and environment in run(), by game functions like add_monster() or hurt(),
+	 * or marked with mark_changed().
+	 * If savefile was not saved or loaded by this game, was loaded with incomplete data at the end,
+	 * or it already has too many appended parts, full save() is performed instead to compact the file.
+	 * @see set_save_compaction()
+	 */
+	void save_changes(const std::string & filename);
+	/// Sets maximum count of parts appended by save_changes() before full save. Default is 8.
+	void set_save_compaction(unsigned max_appended_parts);
+	/// Returns true if level was changed since the last save or load.
+	bool is_changed(int level_index) const;
+	/// Marks level as changed, so save_changes() writes it.
+	void mark_changed(int level_index);
+	/** Saves game in background thread. Works like save() or save_changes(), but on the calling thread
+	 * only snapshot of the game with copies of levels to write is taken,
+	 * and serialization and writing are done by the worker thread.
+	 * If previous background save is still running, waits for it first.
+	 * Errors are reported by wait_for_background_save().
+	 */
+	void save_in_background(const std::string & filename, bool only_changes = false);
+	/** Waits for background save to finish.
+	 * Rethrows exception of the background save, if any.
+	 * After failed save the next save_changes() performs full save.
+	 */
+	void wait_for_background_save();
+	/** Enables autosave: every given number of turns run() starts background save of changes to the given file.
+	 * Zero interval (default) disables autosave.
+	 * @see save_in_background()
+	 */
+	void set_autosave(unsigned turns_interval, const std::string & filename);
 
 	void event(const GameEvent & e);
 	void event(const Info & event_actor, GameEvent::EventType event_type, const Info & event_target = Info(), const Info & event_help = Info());
@@ -95,6 +237,47 @@ struct Game {
 	void hurt(Monster & someone, int damage, bool pierce_armour = false);
 	void hit(Monster & someone, Monster & other, int damage);
 	void hit(Item & item, Monster & other, int damage);
+private:
+	Controller * forced_controller;
+	bool running;
+	/// Original game of the fork.
+	const Game * origin;
+	/// Levels of the original game which are not copied by this fork yet.
+	std::set<int> borrowed_levels;
+	/// Seed for level_random(); taken from random by create_new_game() and load().
+	uint32_t level_seed;
+	/// Invalid future means that generation is requested but not started yet.
+	std::map<int, std::future<Level> > pending_levels;
+	unsigned max_resident_levels;
+	std::list<int> recent_levels;
+	std::map<int, std::streampos> evicted_levels;
+	struct LevelScratch;
+	std::shared_ptr<LevelScratch> scratch;
+	std::set<std::streampos> free_scratch_slots;
+	std::shared_ptr<IndexedReader> savefile;
+	std::set<int> saved_levels;
+	std::set<int> changed_levels;
+	std::string last_save_filename;
+	unsigned appended_parts;
+	unsigned max_appended_parts;
+	std::future<void> background_save;
+	unsigned autosave_interval;
+	std::string autosave_filename;
+	struct SaveSnapshot;
+	std::shared_ptr<SaveSnapshot> make_snapshot(const std::string & filename, bool only_changes);
+	bool restore_level(int level_index);
+	void write_snapshot(const SaveSnapshot & snapshot, const std::string & filename) const;
+	void copy_state(const Game & other);
+	const Level * find_level(int level_index) const;
+	Level & access_level(int level_index);
+	void clear_levels();
+	void pregenerate_adjacent_levels();
+	void start_pregeneration();
+	void join_pregeneration();
+	Level take_pending_level(std::future<Level> & pending, int level_index);
+	void evict_levels();
+	void load_evicted_level(int level_index);
+	std::streampos write_scratch_slot(const std::string & data);
 };
 
 /// @}
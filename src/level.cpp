@@ -113,6 +113,11 @@ void DungeonBuilder::fill_room(Map<Cell> & map, const std::pair<Point, Point> &
 }
 
 std::vector<Point> DungeonBuilder::random_positions(const std::pair<Point, Point> & room, unsigned count)
+{
+	return random_positions(room, count, thread_random());
+}
+
+std::vector<Point> DungeonBuilder::random_positions(const std::pair<Point, Point> & room, unsigned count, Random & random)
 {
 	std::vector<Point> result;
 	for(unsigned i = 0; i < count; ++i) {
@@ -120,8 +125,8 @@ std::vector<Point> DungeonBuilder::random_positions(const std::pair<Point, Point
 		int height = (room.second.y - room.first.y);
 		int counter = width * height;
 		while(--counter > 0) {
-			int x = rand() % width + room.first.x;
-			int y = rand() % height + room.first.y;
+			int x = int(random.get(unsigned(width))) + room.first.x;
+			int y = int(random.get(unsigned(height))) + room.first.y;
 			if(result.end() == std::find(result.begin(), result.end(), Point(x, y))) {
 				result << Point(x, y);
 				break;
@@ -135,11 +140,16 @@ std::vector<Point> DungeonBuilder::random_positions(const std::pair<Point, Point
 }
 
 std::pair<Point, Point> DungeonBuilder::connect_rooms(Level & level, const std::pair<Point, Point> & a, const std::pair<Point, Point> & b, const CellType * type)
+{
+	return connect_rooms(level, a, b, type, thread_random());
+}
+
+std::pair<Point, Point> DungeonBuilder::connect_rooms(Level & level, const std::pair<Point, Point> & a, const std::pair<Point, Point> & b, const CellType * type, Random & random)
 {
 	if(a.first.x < b.first.x) {
 		int start_y = std::max(a.first.y, b.first.y);
 		int stop_y = std::min(a.second.y, b.second.y);
-		int way = start_y + rand() % (stop_y - start_y);
+		int way = start_y + int(random.get(unsigned(stop_y - start_y)));
 		for(int x = a.second.x + 1; x != b.first.x; ++x) {
 			level.map.cell(x, way) = Cell(type);
 		}
@@ -148,7 +158,7 @@ std::pair<Point, Point> DungeonBuilder::connect_rooms(Level & level, const std::
 	if(a.first.x > b.first.x) {
 		int start_y = std::max(a.first.y, b.first.y);
 		int stop_y = std::min(a.second.y, b.second.y);
-		int way = start_y + rand() % (stop_y - start_y);
+		int way = start_y + int(random.get(unsigned(stop_y - start_y)));
 		for(int x = b.second.x + 1; x != a.first.x; ++x) {
 			level.map.cell(x, way) = Cell(type);
 		}
@@ -157,7 +167,7 @@ std::pair<Point, Point> DungeonBuilder::connect_rooms(Level & level, const std::
 	if(a.first.y < b.first.y) {
 		int start_x = std::max(a.first.x, b.first.x);
 		int stop_x = std::min(a.second.x, b.second.x);
-		int wax = start_x + rand() % (stop_x - start_x);
+		int wax = start_x + int(random.get(unsigned(stop_x - start_x)));
 		for(int y = a.second.y + 1; y != b.first.y; ++y) {
 			level.map.cell(wax, y) = Cell(type);
 		}
@@ -166,7 +176,7 @@ std::pair<Point, Point> DungeonBuilder::connect_rooms(Level & level, const std::
 	if(a.first.y > b.first.y) {
 		int start_x = std::max(a.first.x, b.first.x);
 		int stop_x = std::min(a.second.x, b.second.x);
-		int wax = start_x + rand() % (stop_x - start_x);
+		int wax = start_x + int(random.get(unsigned(stop_x - start_x)));
 		for(int y = b.second.y + 1; y != a.first.y; ++y) {
 			level.map.cell(wax, y) = Cell(type);
 		}
@@ -176,6 +186,11 @@ std::pair<Point, Point> DungeonBuilder::connect_rooms(Level & level, const std::
 }
 
 std::vector<std::pair<Point, Point> > DungeonBuilder::shuffle_rooms(const std::vector<std::pair<Point, Point> > & rooms)
+{
+	return shuffle_rooms(rooms, thread_random());
+}
+
+std::vector<std::pair<Point, Point> > DungeonBuilder::shuffle_rooms(const std::vector<std::pair<Point, Point> > & rooms, Random & random)
 {
 	static unsigned a00[] = { 8, 1, 2, 7, 0, 3, 6, 5, 4, };
 	static unsigned a01[] = { 6, 7, 8, 5, 0, 1, 4, 3, 2, };
@@ -215,7 +230,7 @@ std::vector<std::pair<Point, Point> > DungeonBuilder::shuffle_rooms(const std::v
 		a16, a17, a18, a19, a20, a21, a22, a23,
 		a24, a25, a26, a27, a28, a29, a30, a31,
 	};
-	unsigned * a = layouts[rand() % 32];
+	unsigned * a = layouts[random.get(32)];
 
 	std::vector<std::pair<Point, Point> > new_rooms(9);
 	for(unsigned i = 0; i < rooms.size(); ++i) {
@@ -4,6 +4,7 @@
 #include "objects.h"
 #include "items.h"
 #include "cell.h"
+#include "random.h"
 #include <vector>
 #include <list>
 
@@ -37,11 +38,17 @@ struct Level {
 	void erase_dead_monsters();
 };
 
+/** Helpers for level generation.
+ * Functions without generator parameter use thread_random().
+ */
 struct DungeonBuilder {
 	static void fill_room(Map<Cell> & map, const std::pair<Point, Point> & room, const CellType * type);
 	static std::vector<Point> random_positions(const std::pair<Point, Point> & room, unsigned count);
+	static std::vector<Point> random_positions(const std::pair<Point, Point> & room, unsigned count, Random & random);
 	static std::pair<Point, Point> connect_rooms(Level & level, const std::pair<Point, Point> & a, const std::pair<Point, Point> & b, const CellType * type);
+	static std::pair<Point, Point> connect_rooms(Level & level, const std::pair<Point, Point> & a, const std::pair<Point, Point> & b, const CellType * type, Random & random);
 	static std::vector<std::pair<Point, Point> > shuffle_rooms(const std::vector<std::pair<Point, Point> > & rooms);
+	static std::vector<std::pair<Point, Point> > shuffle_rooms(const std::vector<std::pair<Point, Point> > & rooms, Random & random);
 	static void pop_player_front(std::vector<Monster> & monsters);
 };
 
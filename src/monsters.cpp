@@ -25,9 +25,26 @@ Monster::Monster(const Type * monster_type)
 {
 }
 
-bool Monster::valid() const
+Monster::Monster(const Monster & other)
+	: type(other.type), pos(other.pos), hp(other.hp), inventory(other.inventory), poisoning(other.poisoning)
 {
-	return type != nullptr;
+	foreach(const Action * action, other.plan) {
+		plan.push_back(action->clone());
+	}
+}
+
+Monster & Monster::operator=(const Monster & other)
+{
+	if(this != &other) {
+		Monster copy(other);
+		type = copy.type;
+		pos = copy.pos;
+		hp = copy.hp;
+		inventory = copy.inventory;
+		poisoning = copy.poisoning;
+		plan.swap(copy.plan);
+	}
+	return *this;
 }
 
 Monster::~Monster()
@@ -37,6 +54,11 @@ Monster::~Monster()
 	}
 }
 
+bool Monster::valid() const
+{
+	return type != nullptr;
+}
+
 int Monster::damage() const
 {
 	if(inventory.wielded_item().valid()) {
@@ -47,8 +47,13 @@ struct Monster {
 	int hp;
 	Inventory inventory;
 	int poisoning;
+	/** Planned actions, owned by monster.
+	 * Copy of monster gets copies of actions made by Action::clone().
+	 */
 	std::list<Action*> plan;
 	Monster(const Type * monster_type = nullptr);
+	Monster(const Monster & other);
+	Monster & operator=(const Monster & other);
 	~Monster();
 	bool valid() const;
 	bool is_dead() const { return hp <= 0; }
@@ -1,10 +1,16 @@
 #include "pixmap.h"
 #include "util.h"
 #include "log.h"
-#include <sstream>
-#include <iomanip>
+#include "format.h"
 #include <algorithm>
-#include <map>
+#include <climits>
+#include <unordered_map>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <thread>
 
 namespace Chthon {
 
@@ -38,6 +44,135 @@ Color rgb_to_argb(Color color)
 	return color | uint32_t(0xff << 24);
 }
 
+static unsigned index_size_for(unsigned max_index)
+{
+	return max_index <= 0xff ? 1 : (max_index <= 0xffff ? 2 : 4);
+}
+
+template<class T>
+static void copy_indices(const PixelMap & pixels, std::vector<T> & target)
+{
+	std::vector<T> result(pixels.size());
+	for(size_t i = 0; i < result.size(); ++i) {
+		result[i] = T(pixels.get(i));
+	}
+	target.swap(result);
+}
+
+template<class T>
+static unsigned max_of(const std::vector<T> & values)
+{
+	return values.empty() ? 0 : unsigned(*std::max_element(values.begin(), values.end()));
+}
+
+template<class T>
+static void resize_indices(std::vector<T> & values, unsigned width, unsigned height, unsigned new_width, unsigned new_height)
+{
+	std::vector<T> result(size_t(new_width) * new_height, T());
+	unsigned common_width = std::min(width, new_width);
+	unsigned common_height = std::min(height, new_height);
+	for(unsigned y = 0; y < common_height; ++y) {
+		typename std::vector<T>::const_iterator row = values.begin() + ptrdiff_t(y * width);
+		std::copy(row, row + common_width, result.begin() + ptrdiff_t(y * new_width));
+	}
+	values.swap(result);
+}
+
+PixelMap::PixelMap(unsigned map_width, unsigned map_height, unsigned filler)
+	: w(map_width), h(map_height), index_bytes(index_size_for(filler))
+{
+	switch(index_bytes) {
+		case 1: narrow.resize(size(), uint8_t(filler)); break;
+		case 2: medium.resize(size(), uint16_t(filler)); break;
+		default: wide.resize(size(), filler); break;
+	}
+}
+
+PixelMap::PixelMap(const Map<unsigned> & map)
+	: w(map.width()), h(map.height()), index_bytes(4), wide(map.begin(), map.end())
+{
+	shrink_to_fit();
+}
+
+Map<unsigned> PixelMap::to_map() const
+{
+	return Map<unsigned>(w, h, begin(), end());
+}
+
+unsigned PixelMap::max_index() const
+{
+	switch(index_bytes) {
+		case 1: return max_of(narrow);
+		case 2: return max_of(medium);
+		default: return max_of(wide);
+	}
+}
+
+void PixelMap::convert(unsigned new_index_bytes)
+{
+	if(new_index_bytes == index_bytes) {
+		return;
+	}
+	switch(new_index_bytes) {
+		case 1: copy_indices(*this, narrow); break;
+		case 2: copy_indices(*this, medium); break;
+		default: copy_indices(*this, wide); break;
+	}
+	switch(index_bytes) {
+		case 1: std::vector<uint8_t>().swap(narrow); break;
+		case 2: std::vector<uint16_t>().swap(medium); break;
+		default: std::vector<uint32_t>().swap(wide); break;
+	}
+	index_bytes = new_index_bytes;
+}
+
+void PixelMap::widen(unsigned max_index)
+{
+	convert(std::max(index_bytes, index_size_for(max_index)));
+}
+
+void PixelMap::reserve_index(unsigned max_index)
+{
+	widen(max_index);
+}
+
+void PixelMap::shrink_to_fit()
+{
+	convert(index_size_for(max_index()));
+}
+
+void PixelMap::resize(unsigned new_width, unsigned new_height)
+{
+	switch(index_bytes) {
+		case 1: resize_indices(narrow, w, h, new_width, new_height); break;
+		case 2: resize_indices(medium, w, h, new_width, new_height); break;
+		default: resize_indices(wide, w, h, new_width, new_height); break;
+	}
+	w = new_width;
+	h = new_height;
+}
+
+/// Uses explicit stack instead of recursion, so large areas can be filled.
+void PixelMap::floodfill(int x, int y, unsigned which_value, unsigned to_what_value)
+{
+	if(which_value == to_what_value) {
+		return;
+	}
+	std::vector<Point> points(1, Point(x, y));
+	while(!points.empty()) {
+		Point pos = points.back();
+		points.pop_back();
+		if(!valid(pos) || cell(pos) != which_value) {
+			continue;
+		}
+		cell(pos) = to_what_value;
+		points.push_back(Point(pos.x - 1, pos.y));
+		points.push_back(Point(pos.x + 1, pos.y));
+		points.push_back(Point(pos.x, pos.y - 1));
+		points.push_back(Point(pos.x, pos.y + 1));
+	}
+}
+
 }
 
 namespace Chthon {
@@ -53,18 +188,136 @@ void Pixmap::clear_xpm_data()
 }
 
 Pixmap::Pixmap(unsigned pixmap_width, unsigned pixmap_height, unsigned palette_size)
-	: pixels(pixmap_width, pixmap_height, 0), palette(palette_size > 1 ? palette_size : 1, from_rgb(0, 0, 0))
+	: pixels(pixmap_width, pixmap_height, 0), palette(palette_size > 1 ? palette_size : 1, from_rgb(0, 0, 0)),
+	compact(false)
+{
+	clear_xpm_data();
+}
+
+Pixmap::Pixmap(unsigned pixmap_width, unsigned pixmap_height, unsigned palette_size, bool compact_storage)
+	: pixels(compact_storage ? 0 : pixmap_width, compact_storage ? 0 : pixmap_height, 0),
+	compact_pixels(compact_storage ? pixmap_width : 0, compact_storage ? pixmap_height : 0, 0),
+	palette(palette_size > 1 ? palette_size : 1, from_rgb(0, 0, 0)),
+	compact(compact_storage)
 {
 	clear_xpm_data();
 }
 
 /// @cond INTERNAL
 namespace Global {
-static const std::map<std::string, uint32_t> x11_colors = {
+struct X11Color {
+	const char * name;
+	uint32_t value;
+};
+
+/// Should be sorted by name (byte order), so it is searched with binary search.
+/// Table is constant-initialized, so it costs nothing at startup.
+static const X11Color x11_colors[] = {
 #include "x11_colors.inc"
 };
 
+static bool find_x11_color(const std::string & name, Color & color)
+{
+	const X11Color * end = x11_colors + size_of_array(x11_colors);
+	const X11Color * found = std::lower_bound(x11_colors, end, name.c_str(),
+			[](const X11Color & x11_color, const char * value) {
+				return strcmp(x11_color.name, value) < 0;
+			}
+			);
+	if(found == end || name != found->name) {
+		return false;
+	}
+	color = found->value;
+	return true;
+}
+
 }
+
+/** Maps pixel codes to palette indices.
+ * Codes of one or two chars are looked up directly in flat table,
+ * codes up to eight chars are packed into integer key for hash table,
+ * wider codes are hashed as strings.
+ */
+class PixelCodeTable {
+public:
+	PixelCodeTable(unsigned chars_per_pixel)
+		: cpp(chars_per_pixel), direct(cpp == 1 ? 256 : (cpp == 2 ? 65536 : 0), NONE)
+	{
+	}
+	/// Returns false if code is already present.
+	bool add(const char * code, unsigned index)
+	{
+		if(cpp <= 2) {
+			unsigned & value = direct[direct_key(code)];
+			if(value != NONE) {
+				return false;
+			}
+			value = index;
+			return true;
+		} else if(cpp <= 8) {
+			return packed.insert(std::make_pair(packed_key(code), index)).second;
+		}
+		return wide.insert(std::make_pair(std::string(code, cpp), index)).second;
+	}
+	/// Decodes row of width codes into palette indices. Returns false if some code is unknown.
+	bool decode_row(const char * row, unsigned width, unsigned * out)
+	{
+		if(cpp == 1) {
+			for(unsigned col = 0; col < width; ++col) {
+				unsigned value = direct[uint8_t(row[col])];
+				if(value == NONE) {
+					return false;
+				}
+				out[col] = value;
+			}
+		} else if(cpp == 2) {
+			for(unsigned col = 0; col < width; ++col, row += 2) {
+				unsigned value = direct[direct_key(row)];
+				if(value == NONE) {
+					return false;
+				}
+				out[col] = value;
+			}
+		} else if(cpp <= 8) {
+			for(unsigned col = 0; col < width; ++col, row += cpp) {
+				std::unordered_map<uint64_t, unsigned>::const_iterator value = packed.find(packed_key(row));
+				if(value == packed.end()) {
+					return false;
+				}
+				out[col] = value->second;
+			}
+		} else {
+			for(unsigned col = 0; col < width; ++col, row += cpp) {
+				key.assign(row, cpp);
+				std::unordered_map<std::string, unsigned>::const_iterator value = wide.find(key);
+				if(value == wide.end()) {
+					return false;
+				}
+				out[col] = value->second;
+			}
+		}
+		return true;
+	}
+private:
+	enum { NONE = 0xffffffffu };
+	unsigned cpp;
+	std::vector<unsigned> direct;
+	std::unordered_map<uint64_t, unsigned> packed;
+	std::unordered_map<std::string, unsigned> wide;
+	std::string key;
+	size_t direct_key(const char * code) const
+	{
+		return cpp == 1 ? uint8_t(code[0]) : (size_t(uint8_t(code[0])) << 8) | uint8_t(code[1]);
+	}
+	uint64_t packed_key(const char * code) const
+	{
+		uint64_t result = 0;
+		for(unsigned i = 0; i < cpp; ++i) {
+			result = (result << 8) | uint8_t(code[i]);
+		}
+		return result;
+	}
+};
 /// @endcond
 
 void Pixmap::load(const std::string & xpm_data)
@@ -90,6 +343,24 @@ void Pixmap::load(const std::string & xpm_data)
 	load(lines);
 }
 
+template<class T>
+static void store_row(T * target, const unsigned * row, unsigned width)
+{
+	for(unsigned col = 0; col < width; ++col) {
+		target[col] = T(row[col]);
+	}
+}
+
+static void store_row(PixelMap & pixels, size_t row_offset, const unsigned * row, unsigned width)
+{
+	switch(pixels.index_size()) {
+		case 1: store_row(pixels.data<uint8_t>() + row_offset, row, width); break;
+		case 2: store_row(pixels.data<uint16_t>() + row_offset, row, width); break;
+		default: store_row(pixels.data<uint32_t>() + row_offset, row, width); break;
+	}
+}
+
+/// Pixel rows are checked before pixels are allocated, so size in value line cannot exceed actual data.
 void Pixmap::load(const std::vector<std::string> & xpm_lines)
 {
 	if(xpm_lines.empty()) {
@@ -129,7 +400,7 @@ void Pixmap::load(const std::vector<std::string> & xpm_lines)
 		throw Exception("Values in value line should be integers and non-zero.");
 	}
 
-	std::map<std::string, unsigned> color_names;
+	PixelCodeTable color_names(cpp);
 	palette.clear();
 	for(int color = 0; color < int(color_count); ++color) {
 		if(line == xpm_lines.end()) {
@@ -186,11 +457,12 @@ void Pixmap::load(const std::vector<std::string> & xpm_lines)
 		if(key != "c") {
 			throw Exception("Only color key 'c' is supported.");
 		}
-		if(color_names.count(color_name) > 0) {
+		if(!color_names.add(color_name.data(), unsigned(palette.size()))) {
 			throw Exception("Color <" + color_name + "> was found more than once.");
 		}
-		if(Global::x11_colors.count(value) > 0) {
-			color_names[color_name] = static_cast<unsigned>(add_to(palette, Global::x11_colors.at(value)));
+		Color x11_color = 0;
+		if(Global::find_x11_color(value, x11_color)) {
+			add_to(palette, x11_color);
 		} else if(value[0] == '#') {
 			std::string number_value = value.substr(1);
 			bool is_zero = true;
@@ -204,7 +476,7 @@ void Pixmap::load(const std::vector<std::string> & xpm_lines)
 			if(color_value == 0 && !is_zero) {
 				throw Exception("Color value <" + value + "> is invalid.");
 			}
-			color_names[color_name] = static_cast<unsigned>(add_to(palette, rgb_to_argb(color_value)));
+			add_to(palette, rgb_to_argb(color_value));
 		} else {
 			throw Exception("Color value <" + value + "> is invalid.");
 		}
@@ -212,28 +484,42 @@ void Pixmap::load(const std::vector<std::string> & xpm_lines)
 		++line;
 	}
 
-	row_count = 0;
-	pixels = Map<unsigned>(w, h, 0);
-	unsigned index = 0;
-	unsigned rows = h;
-	while(rows --> 0) {
-		if(line == xpm_lines.end()) {
+	if(w > UINT_MAX / h || cpp > UINT_MAX / w) {
+		throw Exception(format("Pixmap size {0}x{1} is too large.", w, h));
+	}
+	std::vector<std::string>::const_iterator row = line;
+	for(unsigned rows = h; rows > 0; --rows, ++row) {
+		if(row == xpm_lines.end()) {
 			throw Exception("Pixel rows are missing or not enough");
 		}
-		if(line->size() % cpp != 0) {
+		if(row->size() % cpp != 0) {
 			throw Exception("Pixel value in a row is broken.");
-		} else if(line->size() < cpp * w) {
+		} else if(row->size() < cpp * w) {
 			throw Exception("Pixel row is too small.");
-		} else if(line->size() > cpp * w) {
+		} else if(row->size() > cpp * w) {
 			throw Exception("Pixel row is too large.");
 		}
-		for(unsigned col = 0; col < w; ++col) {
-			std::string current_pixel = line->substr(col * cpp, cpp);
-			if(color_names.count(current_pixel) == 0) {
-				throw Exception("Pixel value is invalid.");
-			}
-			pixels.data()[index++] = color_names[current_pixel];
+	}
+
+	row_count = 0;
+	// Compact pixels are decoded row by row through a buffer, with storage wide enough for the whole palette.
+	pixels = compact ? Map<unsigned>() : Map<unsigned>(w, h, 0);
+	compact_pixels = compact ? PixelMap(w, h, 0) : PixelMap();
+	if(compact && !palette.empty()) {
+		compact_pixels.reserve_index(unsigned(palette.size() - 1));
+	}
+	std::vector<unsigned> row_buffer(compact ? w : 0);
+	size_t row_offset = 0;
+	unsigned rows = h;
+	while(rows --> 0) {
+		unsigned * row_pixels = compact ? row_buffer.data() : pixels.data() + row_offset;
+		if(!color_names.decode_row(line->data(), w, row_pixels)) {
+			throw Exception("Pixel value is invalid.");
 		}
+		if(compact && w > 0) {
+			store_row(compact_pixels, row_offset, row_pixels, w);
+		}
+		row_offset += w;
 		++row_count;
 		++line;
 	}
@@ -248,13 +534,13 @@ void recreate_xpm_data(Pixmap * pixmap)
 	pixmap->colors.clear();
 	pixmap->colors_interspaces.clear();
 
-	pixmap->row_count = pixmap->pixels.height();
+	pixmap->row_count = pixmap->height();
 
 	std::vector<std::string> tmp_values_interspaces(4, " ");
 	tmp_values_interspaces[0] = "";
 	pixmap->values_interspaces.swap(tmp_values_interspaces);
 
-	std::vector<std::string> tmp_interspaces(1 + pixmap->palette.size() + 1 + pixmap->pixels.height(), ",\n");
+	std::vector<std::string> tmp_interspaces(1 + pixmap->palette.size() + 1 + pixmap->height(), ",\n");
 	tmp_interspaces[0] = 
 		"/* XPM */\n"
 		"static char * xpm[] = {\n"
@@ -272,6 +558,53 @@ void recreate_xpm_data(Pixmap * pixmap)
 	pixmap->interspaces.swap(tmp_interspaces);
 }
 
+static void append_hex_color(std::string & out, Color color)
+{
+	static const char digits[] = "0123456789abcdef";
+	out += '#';
+	for(int shift = 20; shift >= 0; shift -= 4) {
+		out += digits[(color >> shift) & 0xf];
+	}
+}
+
+/// If all codes are single chars, code_chars contains them and row is written by one pass.
+static void append_pixel_row(std::string & result, const unsigned * row, unsigned width,
+		const std::vector<std::string> & codes, const std::vector<char> & code_chars)
+{
+	if(!code_chars.empty()) {
+		size_t start = result.size();
+		result.resize(start + width);
+		char * out = &result[start];
+		for(unsigned col = 0; col < width; ++col) {
+			out[col] = code_chars[row[col]];
+		}
+	} else {
+		for(unsigned col = 0; col < width; ++col) {
+			if(row[col] < codes.size()) {
+				result += codes[row[col]];
+			}
+		}
+	}
+}
+
+template<class T>
+static void load_row(const T * source, unsigned * row, unsigned width)
+{
+	for(unsigned col = 0; col < width; ++col) {
+		row[col] = source[col];
+	}
+}
+
+static void load_row(const PixelMap & pixels, size_t row_offset, unsigned * row, unsigned width)
+{
+	switch(pixels.index_size()) {
+		case 1: load_row(pixels.data<uint8_t>() + row_offset, row, width); break;
+		case 2: load_row(pixels.data<uint16_t>() + row_offset, row, width); break;
+		default: load_row(pixels.data<uint32_t>() + row_offset, row, width); break;
+	}
+}
+
+/// Pixel codes are precomputed for every palette index, so pixel rows are written by a single pass.
 std::string Pixmap::save() const
 {
 	std::string result;
@@ -280,19 +613,25 @@ std::string Pixmap::save() const
 		recreate_xpm_data(const_cast<Pixmap*>(this));
 		interspace = interspaces.begin();
 	}
+	size_t reserved_size = width() * height() + palette.size() * 32 + 64;
+	foreach(const std::string & text, interspaces) {
+		reserved_size += text.size();
+	}
+	foreach(const std::string & color, colors) {
+		reserved_size += color.size() * width() * height() / std::max<size_t>(1, colors.size());
+	}
+	result.reserve(reserved_size);
 	result += *interspace;
 
-	std::ostringstream values;
-	values << '"';
-	values << values_interspaces[0] << pixels.width();
-	values << values_interspaces[1] << pixels.height();
-	values << values_interspaces[2] << palette.size();
-	values << values_interspaces[3] << 1;
+	result += '"';
+	result += values_interspaces[0] + to_string(width());
+	result += values_interspaces[1] + to_string(height());
+	result += values_interspaces[2] + to_string(palette.size());
+	result += values_interspaces[3] + '1';
 	if(values_interspaces.size() >= 5) {
-		values << values_interspaces[4];
+		result += values_interspaces[4];
 	}
-	values << '"';
-	result += values.str();
+	result += '"';
 
 	++interspace;
 	if(interspace == interspaces.end()) {
@@ -300,21 +639,16 @@ std::string Pixmap::save() const
 	}
 	result += *interspace;
 
-	std::vector<std::string>::const_iterator it_color_key = colors.begin();
+	std::vector<std::string> codes(colors);
+	codes.resize(std::max(colors.size(), palette.size()));
 	std::vector<std::pair<std::string, std::pair<std::string, std::string> > >::const_iterator it_color_interspace = colors_interspaces.begin();
 	char free_color_key = 'a';
-	unsigned current_color_index = 0;
-	std::map<unsigned, std::string> new_color_names;
-	for(std::vector<Color>::const_iterator current_color = palette.begin(); current_color != palette.end(); ++current_color) {
-		std::string color_key;
-		if(it_color_key != colors.end()) {
-			color_key = *it_color_key;
-			++it_color_key;
-		} else {
-			color_key = free_color_key;
-			new_color_names[current_color_index] = color_key;
+	for(unsigned current_color_index = 0; current_color_index < palette.size(); ++current_color_index) {
+		if(current_color_index >= colors.size()) {
+			codes[current_color_index] = std::string(1, free_color_key);
 			++free_color_key;
 		}
+		const std::string & color_key = codes[current_color_index];
 
 		std::pair<std::string, std::pair<std::string, std::string> > color_interspace;
 		if(it_color_interspace != colors_interspaces.end()) {
@@ -324,15 +658,19 @@ std::string Pixmap::save() const
 			color_interspace.first = " ";
 			color_interspace.second.first = " ";
 		}
-		result += std::string("\"") + color_key + color_interspace.first + "c" + color_interspace.second.first;
-		if(is_transparent(*current_color)) {
+		result += '"';
+		result += color_key;
+		result += color_interspace.first;
+		result += 'c';
+		result += color_interspace.second.first;
+		Color current_color = palette[current_color_index];
+		if(is_transparent(current_color)) {
 			result += "None";
 		} else {
-			std::ostringstream color_value;
-			color_value << std::hex << std::setw(6) << std::setfill('0') << (*current_color & 0xffffff);
-			result += "#" + color_value.str();
+			append_hex_color(result, current_color);
 		}
-		result += color_interspace.second.second + '"';
+		result += color_interspace.second.second;
+		result += '"';
 
 		bool print_original_interspace = (current_color_index < color_count - 1) || (current_color_index == palette.size() - 1);
 		if(print_original_interspace) {
@@ -344,46 +682,109 @@ std::string Pixmap::save() const
 		} else {
 			result += ",\n";
 		}
-		++current_color_index;
 	}
 
-	unsigned row_size = 0;
-	unsigned current_row = 0;
-	for(std::vector<unsigned>::const_iterator current_pixel = pixels.begin(); current_pixel != pixels.end(); ++current_pixel) {
-		if(row_size == 0) {
-			result += '"';
+	bool single_char_codes = compact
+		? compact_pixels.size() == 0 || compact_pixels.max_index() < codes.size()
+		: std::find_if(pixels.begin(), pixels.end(), [&codes](unsigned index) { return index >= codes.size(); }) == pixels.end();
+	foreach(const std::string & code, codes) {
+		single_char_codes = single_char_codes && code.size() == 1;
+	}
+	std::vector<char> code_chars;
+	if(single_char_codes) {
+		foreach(const std::string & code, codes) {
+			code_chars.push_back(code[0]);
 		}
-		if(*current_pixel >= colors.size()) {
-			result += new_color_names[*current_pixel];
-		} else {
-			result += colors[*current_pixel];
+	}
+
+	if(width() == 0) {
+		return result;
+	}
+	std::vector<unsigned> row_buffer(compact ? width() : 0);
+	for(unsigned current_row = 0; current_row < height(); ++current_row) {
+		result += '"';
+		size_t row_offset = size_t(current_row) * width();
+		const unsigned * row_pixels = compact ? row_buffer.data() : pixels.data() + row_offset;
+		if(compact) {
+			load_row(compact_pixels, row_offset, row_buffer.data(), width());
 		}
-		++row_size;
-		if(row_size >= pixels.width()) {
-			result += '"';
-			bool is_last_one = current_row == pixels.height() - 1;
-			bool print_original_interspace = (current_row < row_count - 1) || (current_row == pixels.height() - 1);
-			if(is_last_one) {
-				std::string last_interspace;
-				while(interspace != interspaces.end()) {
-					last_interspace = *interspace++;
-				}
-				result += last_interspace;
-			} else if(print_original_interspace) {
-				++interspace;
-				if(interspace == interspaces.end()) {
-					return result;
-				}
-				result += *interspace;
-			} else {
-				result += ",\n";
+		append_pixel_row(result, row_pixels, width(), codes, code_chars);
+		result += '"';
+		bool is_last_one = current_row == height() - 1;
+		bool print_original_interspace = (current_row < row_count - 1) || (current_row == height() - 1);
+		if(is_last_one) {
+			std::string last_interspace;
+			while(interspace != interspaces.end()) {
+				last_interspace = *interspace++;
 			}
-
-			row_size = 0;
-			++current_row;
+			result += last_interspace;
+		} else if(print_original_interspace) {
+			++interspace;
+			if(interspace == interspaces.end()) {
+				return result;
+			}
+			result += *interspace;
+		} else {
+			result += ",\n";
 		}
 	}
 	return result;
 }
 
+
+static bool read_whole_file(const std::string & filename, std::string & data)
+{
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!in) {
+		return false;
+	}
+	in.seekg(0, std::ios::end);
+	std::streamoff size = in.tellg();
+	if(size < 0) {
+		return false;
+	}
+	in.seekg(0, std::ios::beg);
+	data.resize(size_t(size));
+	return size == 0 || in.read(&data[0], size);
+}
+
+/// At most thread_count files are being decoded at once, so memory for read data is bounded.
+std::vector<PixmapLoadResult> load_pixmaps(const std::vector<std::string> & filenames, unsigned thread_count)
+{
+	if(thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	std::vector<PixmapLoadResult> results(filenames.size());
+	std::deque<std::future<void> > tasks;
+	for(size_t i = 0; i < filenames.size(); ++i) {
+		PixmapLoadResult * result = &results[i];
+		result->filename = filenames[i];
+		std::shared_ptr<std::string> data = std::make_shared<std::string>();
+		if(!read_whole_file(filenames[i], *data)) {
+			result->error = format("Error: cannot read XPM file \"{0}\".", filenames[i]);
+			continue;
+		}
+		if(tasks.size() >= thread_count) {
+			tasks.front().get();
+			tasks.pop_front();
+		}
+		tasks.push_back(std::async(std::launch::async, [result, data]() {
+			try {
+				result->pixmap.load(*data);
+			} catch(const Pixmap::Exception & e) {
+				result->error = e.what;
+			} catch(const std::exception & e) {
+				result->error = e.what();
+			} catch(...) {
+				result->error = "Error: unknown error while loading XPM file.";
+			}
+		}));
+	}
+	while(!tasks.empty()) {
+		tasks.front().get();
+		tasks.pop_front();
+	}
+	return results;
+}
+
 }
@@ -2,6 +2,9 @@
 #include "map.h"
 #include <vector>
 #include <string>
+#include <iterator>
+#include <cstddef>
+#include <stdint.h>
 
 namespace Chthon { /// @defgroup Pixmap Pixmap
 /// @{
@@ -28,6 +31,180 @@ bool is_transparent(Color color);
 /// Converts RGB color to an opaque ARGB quardruplet.
 Color rgb_to_argb(Color color);
 
+/** Compact map of palette indices.
+ * Indices are stored as 8-, 16- or 32-bit values, whichever is enough for the largest index,
+ * so pixel maps with small palettes take one byte per pixel.
+ * Storage is widened automatically when larger index is written.
+ * It is an opt-in alternative to Map<unsigned> of Pixmap::pixels (see Pixmap::compact),
+ * e.g. for large sprite sheets kept in memory.
+ * Interface follows Map<unsigned>, except that cell() and iterators
+ * return proxy objects instead of references:
+ * @code{.cpp}
+ * Pixmap pixmap;
+ * pixmap.compact = true;
+ * pixmap.load(xpm_data);
+ * pixmap.compact_pixels.cell(0, 0) = 300; // Storage is widened to 16 bits.
+ * for(auto && pixel : pixmap.compact_pixels) {
+ *     pixel = 0;
+ * }
+ * @endcode
+ * Access through proxies checks index size for every pixel,
+ * so per-pixel loops should work on storage directly using data<T>().
+ */
+class PixelMap {
+public:
+	/// Proxy for one stored index.
+	class reference {
+	public:
+		/// Constructs proxy for index at given position.
+		reference(PixelMap & pixel_map, size_t pixel_index) : map(&pixel_map), index(pixel_index) {}
+		/// Constructs proxy for the same index.
+		reference(const reference & other) : map(other.map), index(other.index) {}
+		/// Returns stored index.
+		operator unsigned() const { return map->get(index); }
+		/// Stores index, widening storage if needed.
+		reference & operator=(unsigned value) { map->set(index, value); return *this; }
+		/// Copies index from other proxy.
+		reference & operator=(const reference & other) { map->set(index, unsigned(other)); return *this; }
+		/// Swaps referenced indices, so proxies can be used in std::reverse, std::sort etc.
+		friend void swap(reference a, reference b) { unsigned value = a; a = unsigned(b); b = value; }
+	private:
+		PixelMap * map;
+		size_t index;
+	};
+
+	/// @cond INTERNAL
+	template<class MapType, class Value>
+	class basic_iterator {
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef unsigned value_type;
+		typedef ptrdiff_t difference_type;
+		typedef void pointer;
+		typedef Value reference;
+		basic_iterator(MapType & pixel_map, size_t pixel_index) : map(&pixel_map), index(pixel_index) {}
+		Value operator*() const { return map->cell_at(index); }
+		Value operator[](difference_type offset) const { return map->cell_at(size_t(difference_type(index) + offset)); }
+		basic_iterator & operator++() { ++index; return *this; }
+		basic_iterator operator++(int) { basic_iterator result = *this; ++index; return result; }
+		basic_iterator & operator--() { --index; return *this; }
+		basic_iterator operator--(int) { basic_iterator result = *this; --index; return result; }
+		basic_iterator & operator+=(difference_type offset) { index = size_t(difference_type(index) + offset); return *this; }
+		basic_iterator & operator-=(difference_type offset) { index = size_t(difference_type(index) - offset); return *this; }
+		basic_iterator operator+(difference_type offset) const { basic_iterator result = *this; return result += offset; }
+		basic_iterator operator-(difference_type offset) const { basic_iterator result = *this; return result -= offset; }
+		difference_type operator-(const basic_iterator & other) const { return difference_type(index) - difference_type(other.index); }
+		bool operator==(const basic_iterator & other) const { return index == other.index; }
+		bool operator!=(const basic_iterator & other) const { return index != other.index; }
+		bool operator<(const basic_iterator & other) const { return index < other.index; }
+		bool operator>(const basic_iterator & other) const { return index > other.index; }
+		bool operator<=(const basic_iterator & other) const { return index <= other.index; }
+		bool operator>=(const basic_iterator & other) const { return index >= other.index; }
+		friend basic_iterator operator+(difference_type offset, const basic_iterator & it) { return it + offset; }
+	private:
+		MapType * map;
+		size_t index;
+	};
+	/// @endcond
+	typedef basic_iterator<PixelMap, reference> iterator;
+	typedef basic_iterator<const PixelMap, unsigned> const_iterator;
+
+	/// Constructs map with specified size filled with filler.
+	PixelMap(unsigned map_width = 0, unsigned map_height = 0, unsigned filler = 0);
+	/// Constructs map with indices of given map, stored in the smallest type which can hold them.
+	explicit PixelMap(const Map<unsigned> & map);
+	/// Returns indices as plain map.
+	Map<unsigned> to_map() const;
+
+	iterator begin() { return iterator(*this, 0); }
+	const_iterator begin() const { return const_iterator(*this, 0); }
+	iterator end() { return iterator(*this, size()); }
+	const_iterator end() const { return const_iterator(*this, size()); }
+
+	unsigned width() const { return w; }
+	unsigned height() const { return h; }
+	/// Returns count of pixels.
+	size_t size() const { return size_t(w) * h; }
+	/// Returns size of one stored index in bytes: 1, 2 or 4.
+	unsigned index_size() const { return index_bytes; }
+	/// Returns the largest stored index.
+	unsigned max_index() const;
+	/** Returns pointer to stored indices if they are stored as type T
+	 * (uint8_t, uint16_t or uint32_t), otherwise returns null pointer.
+	 */
+	template<class T>
+	const T * data() const { return sizeof(T) == index_bytes && size() > 0 ? storage(T()).data() : nullptr; }
+	/// Returns pointer to stored indices if they are stored as type T, otherwise returns null pointer.
+	template<class T>
+	T * data() { return sizeof(T) == index_bytes && size() > 0 ? storage(T()).data() : nullptr; }
+
+	/// Checks if point (x, y) is valid, i.e. inside the map bounds.
+	bool valid(int x, int y) const { return (0 <= x && x < int(w) && 0 <= y && y < int(h)); }
+	/// Checks if point (x, y) is valid, i.e. inside the map bounds.
+	bool valid(const Point & pos) const { return valid(pos.x, pos.y); }
+	/// Returns index at the specified position. If position is invalid, behaviour is undefined.
+	unsigned cell(int x, int y) const { return get(unsigned(x) + unsigned(y) * w); }
+	/// Returns index at the specified position. If position is invalid, behaviour is undefined.
+	unsigned cell(const Point & pos) const { return cell(pos.x, pos.y); }
+	/// Returns proxy for index at the specified position. If position is invalid, behaviour is undefined.
+	reference cell(int x, int y) { return reference(*this, unsigned(x) + unsigned(y) * w); }
+	/// Returns proxy for index at the specified position. If position is invalid, behaviour is undefined.
+	reference cell(const Point & pos) { return cell(pos.x, pos.y); }
+
+	/// Returns index at given position in row-major order.
+	unsigned get(size_t index) const
+	{
+		switch(index_bytes) {
+			case 1: return narrow[index];
+			case 2: return medium[index];
+			default: return wide[index];
+		}
+	}
+	/// Stores index at given position in row-major order, widening storage if needed.
+	void set(size_t index, unsigned value)
+	{
+		if(value > max_value()) {
+			widen(value);
+		}
+		switch(index_bytes) {
+			case 1: narrow[index] = uint8_t(value); break;
+			case 2: medium[index] = uint16_t(value); break;
+			default: wide[index] = value; break;
+		}
+	}
+	/// Widens storage, so it can hold given index without conversion.
+	void reserve_index(unsigned max_index);
+	/// Narrows storage to the smallest type which can hold all stored indices.
+	void shrink_to_fit();
+	/// Resizes map keeping top-left part. New pixels are set to zero.
+	void resize(unsigned new_width, unsigned new_height);
+	/// Replaces all connected indices equal to which_value with to_what_value, starting with (x, y) point.
+	void floodfill(int x, int y, unsigned which_value, unsigned to_what_value);
+	/// Replaces all connected indices equal to which_value with to_what_value, starting with pos point.
+	void floodfill(const Point & pos, unsigned which_value, unsigned to_what_value) { floodfill(pos.x, pos.y, which_value, to_what_value); }
+	/// Replaces all connected indices equal to the one at (x, y) with to_what_value.
+	void floodfill(int x, int y, unsigned to_what_value) { floodfill(x, y, cell(x, y), to_what_value); }
+	/// Replaces all connected indices equal to the one at pos with to_what_value.
+	void floodfill(const Point & pos, unsigned to_what_value) { floodfill(pos.x, pos.y, to_what_value); }
+private:
+	unsigned w, h;
+	unsigned index_bytes;
+	std::vector<uint8_t> narrow;
+	std::vector<uint16_t> medium;
+	std::vector<uint32_t> wide;
+	reference cell_at(size_t index) { return reference(*this, index); }
+	unsigned cell_at(size_t index) const { return get(index); }
+	unsigned max_value() const { return index_bytes == 1 ? 0xffu : (index_bytes == 2 ? 0xffffu : 0xffffffffu); }
+	const std::vector<uint8_t> & storage(uint8_t) const { return narrow; }
+	const std::vector<uint16_t> & storage(uint16_t) const { return medium; }
+	const std::vector<uint32_t> & storage(uint32_t) const { return wide; }
+	std::vector<uint8_t> & storage(uint8_t) { return narrow; }
+	std::vector<uint16_t> & storage(uint16_t) { return medium; }
+	std::vector<uint32_t> & storage(uint32_t) { return wide; }
+	void widen(unsigned max_index);
+	void convert(unsigned new_index_bytes);
+};
+
 /** Stores pixmap and its palette.
  * Allows basic manipulation with pixels and palette colors.
  * Also loading and saving XPM files.
@@ -42,10 +219,22 @@ public:
 	};
 
 	Map<unsigned> pixels;
+	/// Pixels in compact storage. They are used instead of pixels if compact is set.
+	PixelMap compact_pixels;
 	std::vector<Color> palette;
+	/** If set, load() fills compact_pixels and leaves pixels empty, and save() writes compact_pixels.
+	 * Otherwise load() fills pixels and leaves compact_pixels empty, and save() writes pixels.
+	 */
+	bool compact;
 
 	/// Constructs pixmap with given size, pallette of one black color, and filled with this color.
 	Pixmap(unsigned w = 1, unsigned h = 1, unsigned palette_size = 1);
+	/// Constructs pixmap with given size and palette, keeping pixels in compact storage if compact_storage is set.
+	Pixmap(unsigned w, unsigned h, unsigned palette_size, bool compact_storage);
+	/// Returns width of the pixels in use.
+	unsigned width() const { return compact ? compact_pixels.width() : pixels.width(); }
+	/// Returns height of the pixels in use.
+	unsigned height() const { return compact ? compact_pixels.height() : pixels.height(); }
 
 	/// Loads Pixmap from string which contains loaded XPM data.
 	/// This way Pixmap can be later saved with as few differences as possible.
@@ -66,5 +255,31 @@ private:
 	friend void recreate_xpm_data(Pixmap * pixmap);
 };
 
+/// Result of loading one file by load_pixmaps().
+struct PixmapLoadResult {
+	std::string filename;
+	/// Loaded pixmap. Default one if file could not be loaded.
+	Pixmap pixmap;
+	/// Reason of failure. Empty if file was loaded successfully.
+	std::string error;
+	/// Returns true if file was loaded successfully.
+	bool ok() const { return error.empty(); }
+};
+
+/** Loads batch of XPM files.
+ * Files are read one after another on the calling thread, each with a single read,
+ * while already read files are decoded on up to thread_count threads (0 means hardware concurrency).
+ * Errors are reported per file and do not stop loading of other files.
+ * Results are returned in the order of file names.
+ * @code{.cpp}
+ * foreach(const PixmapLoadResult & result, load_pixmaps(filenames)) {
+ *     if(!result.ok()) {
+ *         log(result.filename + ": " + result.error);
+ *     }
+ * }
+ * @endcode
+ */
+std::vector<PixmapLoadResult> load_pixmaps(const std::vector<std::string> & filenames, unsigned thread_count = 0);
+
 /// @}
 }
@@ -0,0 +1,133 @@
+#include "random.h"
+#include <atomic>
+#include <unordered_set>
+
+namespace Chthon {
+
+static uint64_t splitmix64(uint64_t & x)
+{
+	uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static uint32_t rotl(uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+/// State is expanded from seed using splitmix64, so it is never all zeroes.
+Random::Random(uint32_t random_seed)
+	: initial_seed(random_seed)
+{
+	uint64_t x = random_seed;
+	uint64_t a = splitmix64(x);
+	uint64_t b = splitmix64(x);
+	state[0] = uint32_t(a);
+	state[1] = uint32_t(a >> 32);
+	state[2] = uint32_t(b);
+	state[3] = uint32_t(b >> 32);
+}
+
+uint32_t Random::derive_seed(uint32_t base_seed, uint32_t stream)
+{
+	uint64_t x = (uint64_t(base_seed) << 32) | stream;
+	return uint32_t(splitmix64(x) >> 32);
+}
+
+std::vector<uint32_t> Random::get_state() const
+{
+	std::vector<uint32_t> result(1, initial_seed);
+	result.insert(result.end(), state, state + 4);
+	return result;
+}
+
+void Random::set_state(const std::vector<uint32_t> & values)
+{
+	if(values.size() != 5) {
+		return;
+	}
+	initial_seed = values[0];
+	std::copy(values.begin() + 1, values.end(), state);
+}
+
+/// Uses xoshiro128** algorithm.
+uint32_t Random::next()
+{
+	uint32_t result = rotl(state[1] * 5, 7) * 9;
+	uint32_t t = state[1] << 9;
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = rotl(state[3], 11);
+	return result;
+}
+
+/// Uses Lemire's multiply-shift method with rejection.
+unsigned Random::get(unsigned n)
+{
+	if(n == 0) {
+		return 0;
+	}
+	uint64_t m = uint64_t(next()) * n;
+	uint32_t low = uint32_t(m);
+	if(low < n) {
+		uint32_t threshold = (0u - n) % n;
+		while(low < threshold) {
+			m = uint64_t(next()) * n;
+			low = uint32_t(m);
+		}
+	}
+	return unsigned(m >> 32);
+}
+
+int Random::range(int min, int max)
+{
+	if(max < min) {
+		std::swap(min, max);
+	}
+	uint32_t span = uint32_t(max) - uint32_t(min);
+	if(span == 0xffffffffu) {
+		return int(next());
+	}
+	return int(uint32_t(min) + get(span + 1));
+}
+
+bool Random::chance(unsigned numerator, unsigned denominator)
+{
+	return get(denominator) < numerator;
+}
+
+/// Uses Floyd's algorithm with hash set of chosen values,
+/// so it takes count steps of constant expected time (plus sorting of the result).
+std::vector<unsigned> Random::sample(unsigned n, unsigned count)
+{
+	std::vector<unsigned> result;
+	if(count > n) {
+		count = n;
+	}
+	result.reserve(count);
+	std::unordered_set<unsigned> chosen(count);
+	for(unsigned j = n - count; j < n; ++j) {
+		unsigned t = get(j + 1);
+		if(!chosen.insert(t).second) {
+			t = j;
+			chosen.insert(t);
+		}
+		result.push_back(t);
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+Random & thread_random()
+{
+	static std::atomic<uint32_t> thread_count(0);
+	thread_local Random random(Random::derive_seed(0, thread_count++));
+	return random;
+}
+
+}
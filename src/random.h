@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+namespace Chthon { /// @defgroup Random Random numbers
+/// @{
+
+/** Seeded pseudo-random number generator.
+ * Two generators constructed with the same seed produce the same sequence,
+ * so everything that depends only on the generator can be reproduced later.
+ * Generator has no shared state, so each thread can use its own instance
+ * without locking.
+ */
+class Random {
+public:
+	/// Constructs generator using given seed.
+	Random(uint32_t random_seed = 0);
+	/** Returns seed for independent stream, determined only by base seed and stream number.
+	 * Useful for per-level or per-thread generators:
+	 * @code{.cpp}
+	 * Random level_random(Random::derive_seed(game_seed, level_index));
+	 * @endcode
+	 */
+	static uint32_t derive_seed(uint32_t base_seed, uint32_t stream);
+	/// Returns seed which generator was constructed with.
+	uint32_t seed() const { return initial_seed; }
+	/// Returns new generator for independent stream derived from this generator's seed.
+	Random fork(uint32_t stream) const { return Random(derive_seed(initial_seed, stream)); }
+	/// Returns full generator state (seed followed by four state words), e.g. for saving.
+	std::vector<uint32_t> get_state() const;
+	/// Restores state returned by get_state(). State of wrong size is ignored.
+	void set_state(const std::vector<uint32_t> & values);
+
+	/// Returns next raw 32-bit value.
+	uint32_t next();
+	/// Returns random value in range [0; n) without modulo bias. Returns 0 if n is 0.
+	unsigned get(unsigned n);
+	/// Returns random value in range [min; max], bounds included.
+	int range(int min, int max);
+	/// Returns true with probability of numerator/denominator.
+	bool chance(unsigned numerator, unsigned denominator);
+
+	/// Shuffles sequence (Fisher-Yates).
+	template<class Iterator>
+	void shuffle(Iterator first, Iterator last)
+	{
+		unsigned n = unsigned(last - first);
+		while(n > 1) {
+			unsigned i = get(n);
+			--n;
+			std::iter_swap(first + int(i), first + int(n));
+		}
+	}
+	/// Returns random element of vector. Vector should not be empty.
+	template<class T>
+	const T & choice(const std::vector<T> & values)
+	{
+		return values[get(unsigned(values.size()))];
+	}
+	/** Returns count distinct random values from range [0; n) in increasing order.
+	 * If count is greater than n, all n values are returned.
+	 */
+	std::vector<unsigned> sample(unsigned n, unsigned count);
+	/// Returns count distinct random elements of vector, preserving their order.
+	template<class T>
+	std::vector<T> sample(const std::vector<T> & values, unsigned count)
+	{
+		std::vector<T> result;
+		for(unsigned index : sample(unsigned(values.size()), count)) {
+			result.push_back(values[index]);
+		}
+		return result;
+	}
+private:
+	uint32_t initial_seed;
+	uint32_t state[4];
+};
+
+/** Returns generator of the current thread.
+ * Each thread gets its own instance seeded with derive_seed(0, thread_number),
+ * where threads are numbered in order of first call.
+ * It can be reseeded by assignment: `thread_random() = Random(seed);`
+ */
+Random & thread_random();
+
+/// @}
+}
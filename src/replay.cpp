@@ -0,0 +1,213 @@
+#include "replay.h"
+#include "actions.h"
+#include "game.h"
+#include "log.h"
+#include <typeinfo>
+#include <istream>
+#include <ostream>
+
+namespace Chthon {
+
+static uint8_t action_type(const Action * action)
+{
+	if(!action) {
+		return ActionRecord::NONE;
+	}
+	static const std::type_info * types[ActionRecord::COUNT] = {
+		nullptr, nullptr,
+		&typeid(Wait), &typeid(Move), &typeid(Open), &typeid(Close), &typeid(Swing),
+		&typeid(Fire), &typeid(Drink), &typeid(Grab), &typeid(Drop),
+		&typeid(Wield), &typeid(Unwield), &typeid(Wear), &typeid(TakeOff),
+		&typeid(Eat), &typeid(GoUp), &typeid(GoDown), &typeid(Put),
+	};
+	const std::type_info & type = typeid(*action);
+	for(uint8_t i = ActionRecord::WAIT; i < ActionRecord::COUNT; ++i) {
+		if(*types[i] == type) {
+			return i;
+		}
+	}
+	return ActionRecord::UNKNOWN;
+}
+
+ActionRecord::ActionRecord(unsigned actor_index, const Action * action)
+	: type(action_type(action)), actor(actor_index), slot(0)
+{
+	if(is_directed()) {
+		shift = static_cast<const DirectedAction*>(action)->shift;
+	} else if(is_slot()) {
+		slot = static_cast<const SlotAction*>(action)->slot;
+	}
+}
+
+bool ActionRecord::is_directed() const
+{
+	switch(type) {
+		case MOVE: case OPEN: case CLOSE: case SWING: case FIRE: case DRINK: case PUT:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool ActionRecord::is_slot() const
+{
+	switch(type) {
+		case DROP: case WIELD: case WEAR: case EAT:
+			return true;
+		default:
+			return false;
+	}
+}
+
+Action * ActionRecord::restore() const
+{
+	switch(type) {
+		case WAIT: return new Wait();
+		case MOVE: return new Move(shift);
+		case OPEN: return new Open(shift);
+		case CLOSE: return new Close(shift);
+		case SWING: return new Swing(shift);
+		case FIRE: return new Fire(shift);
+		case DRINK: return new Drink(shift);
+		case GRAB: return new Grab();
+		case DROP: return new Drop(slot);
+		case WIELD: return new Wield(slot);
+		case UNWIELD: return new Unwield();
+		case WEAR: return new Wear(slot);
+		case TAKE_OFF: return new TakeOff();
+		case EAT: return new Eat(slot);
+		case GO_UP: return new GoUp();
+		case GO_DOWN: return new GoDown();
+		case PUT: return new Put(shift);
+		case NONE: case UNKNOWN: default: return nullptr;
+	}
+}
+
+
+static void write_varint(std::ostream & out, uint32_t value)
+{
+	while(value >= 0x80) {
+		out.put(char((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.put(char(value));
+}
+
+static uint32_t read_varint(std::istream & in)
+{
+	uint32_t value = 0;
+	for(unsigned shift = 0; shift < 35; shift += 7) {
+		char c;
+		if(!in.get(c)) {
+			throw Replay::Exception("Replay is corrupted: unexpected end of stream.");
+		}
+		value |= uint32_t(uint8_t(c) & 0x7f) << shift;
+		if((uint8_t(c) & 0x80) == 0) {
+			return value;
+		}
+	}
+	throw Replay::Exception("Replay is corrupted: varint is too long.");
+}
+
+static uint32_t zigzag(int value)
+{
+	return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static int unzigzag(uint32_t value)
+{
+	return int(value >> 1) ^ -int(value & 1);
+}
+
+static const char replay_magic[] = "CHRP";
+static const uint8_t replay_version = 1;
+
+Replay::Replay(uint32_t replay_seed)
+	: seed(replay_seed)
+{
+}
+
+void Replay::record(unsigned actor, const Action * action)
+{
+	actions.push_back(ActionRecord(actor, action));
+}
+
+void Replay::write(std::ostream & out) const
+{
+	out.write(replay_magic, 4);
+	out.put(char(replay_version));
+	write_varint(out, seed);
+	write_varint(out, uint32_t(actions.size()));
+	foreach(const ActionRecord & record, actions) {
+		out.put(char(record.type));
+		write_varint(out, record.actor);
+		if(record.is_directed()) {
+			write_varint(out, zigzag(record.shift.x));
+			write_varint(out, zigzag(record.shift.y));
+		} else if(record.is_slot()) {
+			write_varint(out, record.slot);
+		}
+	}
+}
+
+void Replay::read(std::istream & in)
+{
+	char magic[4];
+	if(!in.read(magic, 4) || !std::equal(magic, magic + 4, replay_magic)) {
+		throw Exception("Stream is not a replay.");
+	}
+	char version;
+	if(!in.get(version) || uint8_t(version) != replay_version) {
+		throw Exception("Replay has unsupported version.");
+	}
+	seed = read_varint(in);
+	uint32_t count = read_varint(in);
+	actions.clear();
+	for(uint32_t i = 0; i < count; ++i) {
+		ActionRecord record;
+		char type;
+		if(!in.get(type)) {
+			throw Exception("Replay is corrupted: unexpected end of stream.");
+		}
+		record.type = uint8_t(type);
+		if(record.type >= ActionRecord::COUNT) {
+			throw Exception(format("Replay is corrupted: unknown action type {0}.", int(record.type)));
+		}
+		record.actor = read_varint(in);
+		if(record.is_directed()) {
+			record.shift.x = unzigzag(read_varint(in));
+			record.shift.y = unzigzag(read_varint(in));
+		} else if(record.is_slot()) {
+			record.slot = read_varint(in);
+		}
+		actions.push_back(record);
+	}
+}
+
+
+ReplayController::ReplayController(const Replay & replay_to_play)
+	: replay(replay_to_play), position(0)
+{
+}
+
+Action * ReplayController::act(Monster & monster, Game & game)
+{
+	if(done()) {
+		game.state = Game::SUSPENDED;
+		return nullptr;
+	}
+	const ActionRecord & record = replay.actions[position++];
+	unsigned actor = unsigned(&monster - game.current_level().monsters.data());
+	if(record.actor != actor) {
+		log("Replay is out of sync: expected actor #{0}, got #{1}.", record.actor, actor);
+		position = replay.actions.size();
+		game.state = Game::SUSPENDED;
+		return nullptr;
+	}
+	if(record.type == ActionRecord::UNKNOWN) {
+		log("Replay contains unknown action of actor #{0}, skipping.", actor);
+	}
+	return record.restore();
+}
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "ai.h"
+#include "point.h"
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace Chthon { /// @defgroup Replay Replays
+/// @{
+
+class Action;
+class Monster;
+class Game;
+
+/** Compact record of a single action decision made during Game::run().
+ * Stores action type, its parameter (shift or slot, if any)
+ * and index of acting monster in the current level monster list.
+ */
+struct ActionRecord {
+	enum Type {
+		NONE, ///< Controller produced no action.
+		UNKNOWN, ///< User-defined action, which cannot be restored.
+		WAIT, MOVE, OPEN, CLOSE, SWING, FIRE, DRINK, GRAB, DROP,
+		WIELD, UNWIELD, WEAR, TAKE_OFF, EAT, GO_UP, GO_DOWN, PUT,
+		COUNT
+	};
+	uint8_t type;
+	unsigned actor;
+	Point shift;
+	unsigned slot;
+	/// Constructs record of an action. Null action is recorded as NONE.
+	ActionRecord(unsigned actor_index = 0, const Action * action = nullptr);
+	/// Returns true if action type has a direction.
+	bool is_directed() const;
+	/// Returns true if action type has an inventory slot.
+	bool is_slot() const;
+	/** Constructs new action from record.
+	 * Returns null pointer for NONE and UNKNOWN actions.
+	 * Caller takes ownership of the action.
+	 */
+	Action * restore() const;
+};
+
+/** Recorded game session: initial seed plus each action decision in order.
+ * Game is fully determined by its seed and actions, so replaying
+ * the record on the same game setup reproduces the session exactly.
+ * @see Game::record()
+ * @see Game::playback()
+ */
+struct Replay {
+	/// Basic Replay exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	uint32_t seed;
+	std::vector<ActionRecord> actions;
+
+	/// Constructs empty replay with given seed.
+	Replay(uint32_t replay_seed = 0);
+	/// Appends action decision of the actor.
+	void record(unsigned actor, const Action * action);
+	/** Writes replay as compact binary stream.
+	 * Integers are stored as varints, so usual record takes 3-4 bytes.
+	 */
+	void write(std::ostream & out) const;
+	/// Reads replay from binary stream. Throws Exception if stream is corrupted.
+	void read(std::istream & in);
+};
+
+/** Controller which produces actions from replay instead of AI.
+ * Every monster in the game should be controlled by it in order to
+ * reproduce the session. When replay is over or actor does not match,
+ * game is suspended.
+ */
+class ReplayController : public Controller {
+public:
+	ReplayController(const Replay & replay_to_play);
+	virtual ~ReplayController() {}
+	/// Returns true if all recorded actions were played.
+	bool done() const { return position >= replay.actions.size(); }
+	virtual Action * act(Monster & monster, Game & game);
+private:
+	const Replay & replay;
+	size_t position;
+};
+
+/// @}
+}
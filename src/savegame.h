@@ -0,0 +1,248 @@
+#pragma once
+#include "files.h"
+#include "game.h"
+#include "level.h"
+#include "replay.h"
+#include <type_traits>
+
+namespace Chthon { /// @defgroup Savegame Storing game state
+/// @{
+
+/** Defines store functions for game entities, which need game to resolve type pointers.
+ * Works like SAVEFILE_STORE(), except that produced functions take additional
+ * `const Game & game` argument, which is available in the definition body.
+ * Type pointers are stored as type ids and resolved using game type tables when reading,
+ * so all types should be registered in the game.
+ * @see SAVEFILE_STORE()
+ */
+#define SAVEGAME_STORE(Type, variable) \
+	template<class Savefile, class T> void store_game_ext_##variable(Savefile &, T &, const Game &); \
+	template<class Savefile> void store(Savefile & savefile, Type & variable, const Game & game) \
+		{ store_game_ext_##variable(savefile, variable, game); } \
+	template<class Savefile> void store(Savefile & savefile, const Type & variable, const Game & game) \
+		{ store_game_ext_##variable(savefile, variable, game); } \
+	template<class Savefile, class T> \
+	void store_game_ext_##variable(Savefile & savefile, T & variable, const Game & game)
+
+/// @cond INTERNAL
+template<class Savefile, class Type>
+void store_type_pointer(Savefile & savefile, const Type * const & type, const std::map<std::string, Type> &, std::false_type)
+{
+	savefile.store(deref_default(type).id);
+}
+template<class Savefile, class Type>
+void store_type_pointer(Savefile & savefile, const Type * & type, const std::map<std::string, Type> & types, std::true_type)
+{
+	std::string id;
+	savefile.store(id);
+	type = get_pointer(types, id);
+}
+
+
+template<class Savefile>
+void store_plan(Savefile & savefile, const std::list<Action*> & plan, std::false_type)
+{
+	savefile.store(unsigned(plan.size()));
+	foreach(const Action * action, plan) {
+		ActionRecord record(0, action);
+		savefile.store(unsigned(record.type));
+		savefile.store(record.shift.x).store(record.shift.y).store(record.slot);
+	}
+}
+template<class Savefile>
+void store_plan(Savefile & savefile, std::list<Action*> & plan, std::true_type)
+{
+	foreach(Action * action, plan) {
+		delete action;
+	}
+	plan.clear();
+	unsigned size = 0;
+	savefile.store(size);
+	for(unsigned i = 0; i < size; ++i) {
+		ActionRecord record;
+		unsigned type = 0;
+		savefile.store(type);
+		record.type = uint8_t(type);
+		savefile.store(record.shift.x).store(record.shift.y).store(record.slot);
+		Action * action = record.restore();
+		if(action) {
+			plan.push_back(action);
+		}
+	}
+}
+/// @endcond
+
+/// Stores type pointer as type id. When reading, id is resolved using given type table.
+template<class Savefile, class Pointer, class Type>
+void store_type(Savefile & savefile, Pointer & type, const std::map<std::string, Type> & types)
+{
+	store_type_pointer(savefile, type, types, IsReading<Savefile>());
+}
+
+/// @cond INTERNAL
+template<class Savefile, class Vector>
+void store_vector_values(Savefile & savefile, Vector & values, const Game & game, std::false_type)
+{
+	savefile.store(unsigned(values.size()));
+	for(auto & value : values) {
+		store(savefile, value, game);
+	}
+}
+/// Values are added one by one while savefile is valid, so corrupted size does not lead to huge allocation.
+template<class Savefile, class Vector>
+void store_vector_values(Savefile & savefile, Vector & values, const Game & game, std::true_type)
+{
+	unsigned size = 0;
+	savefile.store(size);
+	values.clear();
+	for(unsigned i = 0; i < size; ++i) {
+		if(i > 0) {
+			savefile.check("values");
+		}
+		values.push_back(typename Vector::value_type());
+		store(savefile, values.back(), game);
+	}
+}
+/// @endcond
+
+/// Stores vector size followed by each value. Values are stored using store(savefile, value, game).
+template<class Savefile, class Vector>
+void store_vector(Savefile & savefile, Vector & values, const Game & game)
+{
+	store_vector_values(savefile, values, game, IsReading<Savefile>());
+}
+
+/** Stores monster plan as a list of action records.
+ * Only predefined actions are restored, user-defined ones are dropped.
+ * @see ActionRecord
+ */
+template<class Savefile, class Plan>
+void store_plan(Savefile & savefile, Plan & plan)
+{
+	store_plan(savefile, plan, IsReading<Savefile>());
+}
+
+/// @cond INTERNAL
+SAVEFILE_STORE(Point, point_value)
+{
+	savefile.store(point_value.x).store(point_value.y);
+}
+
+SAVEGAME_STORE(Cell, cell)
+{
+	store_type(savefile, cell.type, game.type_source().cell_types);
+	savefile.store(cell.visible).store(cell.seen_sprite);
+}
+
+/// Map is stored by columns: table of cell type ids, then blocks of type indices, visibility and seen sprites.
+template<class Savefile>
+void store(Savefile & savefile, Map<Cell> & map, const Game & game)
+{
+	unsigned width = 0, height = 0;
+	savefile.store(width).store(height);
+	std::vector<std::string> type_ids;
+	std::vector<unsigned> type_indices;
+	std::vector<char> visible;
+	std::vector<int> seen_sprites;
+	store(savefile, type_ids);
+	store(savefile, type_indices);
+	store(savefile, visible);
+	store(savefile, seen_sprites);
+	std::vector<const CellType *> types;
+	foreach(const std::string & id, type_ids) {
+		types.push_back(get_pointer(game.type_source().cell_types, id));
+	}
+	size_t size = size_t(width) * height;
+	if(type_indices.size() != size || visible.size() != size || seen_sprites.size() != size) {
+		throw typename Savefile::Exception("Error: savefile is corrupted (reading map).");
+	}
+	map = Map<Cell>(width, height);
+	for(size_t i = 0; i < size; ++i) {
+		Cell & cell = *(map.begin() + int(i));
+		cell.type = type_indices[i] < types.size() ? types[type_indices[i]] : nullptr;
+		cell.visible = visible[i] != 0;
+		cell.seen_sprite = seen_sprites[i];
+	}
+}
+template<class Savefile>
+void store(Savefile & savefile, const Map<Cell> & map, const Game &)
+{
+	savefile.store(map.width()).store(map.height());
+	std::map<const CellType *, unsigned> type_index;
+	std::vector<std::string> type_ids;
+	std::vector<unsigned> type_indices;
+	std::vector<char> visible;
+	std::vector<int> seen_sprites;
+	type_indices.reserve(map.width() * map.height());
+	visible.reserve(map.width() * map.height());
+	seen_sprites.reserve(map.width() * map.height());
+	for(const Cell & cell : map) {
+		std::map<const CellType *, unsigned>::const_iterator index = type_index.find(cell.type);
+		if(index == type_index.end()) {
+			index = type_index.insert(std::make_pair(cell.type, unsigned(type_ids.size()))).first;
+			type_ids.push_back(deref_default(cell.type).id);
+		}
+		type_indices.push_back(index->second);
+		visible.push_back(cell.visible ? 1 : 0);
+		seen_sprites.push_back(cell.seen_sprite);
+	}
+	store(savefile, type_ids);
+	store(savefile, type_indices);
+	store(savefile, visible);
+	store(savefile, seen_sprites);
+}
+
+SAVEGAME_STORE(Item, item)
+{
+	store_type(savefile, item.type, game.type_source().item_types);
+	store_type(savefile, item.full_type, game.type_source().item_types);
+	store_type(savefile, item.empty_type, game.type_source().item_types);
+	store(savefile, item.pos);
+	savefile.store(item.key_type);
+}
+
+SAVEGAME_STORE(Inventory, inventory)
+{
+	savefile.store(inventory.wielded).store(inventory.worn);
+	store_vector(savefile, inventory.items, game);
+}
+
+SAVEGAME_STORE(Monster, monster)
+{
+	store_type(savefile, monster.type, game.type_source().monster_types);
+	store(savefile, monster.pos);
+	savefile.store(monster.hp);
+	store(savefile, monster.inventory, game);
+	savefile.store(monster.poisoning);
+	store_plan(savefile, monster.plan);
+}
+
+SAVEGAME_STORE(Object, object)
+{
+	store_type(savefile, object.type, game.type_source().object_types);
+	store_type(savefile, object.closed_type, game.type_source().object_types);
+	store_type(savefile, object.opened_type, game.type_source().object_types);
+	store(savefile, object.pos);
+	store_vector(savefile, object.items, game);
+	savefile.store(object.up_destination).store(object.down_destination);
+	savefile.store(object.locked).store(object.lock_type);
+}
+/// @endcond
+
+/** Stores whole level: map, monsters, items and objects.
+ * @code{.cpp}
+ * Writer writer(out);
+ * store(writer, game.current_level(), game);
+ * writer.check("level");
+ * @endcode
+ */
+SAVEGAME_STORE(Level, level)
+{
+	store(savefile, level.map, game);
+	store_vector(savefile, level.monsters, game);
+	store_vector(savefile, level.items, game);
+	store_vector(savefile, level.objects, game);
+}
+
+/// @}
+}
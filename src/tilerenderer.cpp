@@ -0,0 +1,104 @@
+#include "tilerenderer.h"
+#include "format.h"
+#include "util.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Chthon {
+
+TileRenderer::TileRenderer(const Pixmap & atlas, unsigned tile_width, unsigned tile_height, Color background)
+	: tile_w(tile_width), tile_h(tile_height), atlas_columns(0), background_color(background),
+	atlas_width(atlas.pixels.width()), atlas_height(atlas.pixels.height()), full_redraw(true)
+{
+	if(tile_w == 0 || tile_h == 0 || atlas_width < tile_w || atlas_height < tile_h) {
+		throw Exception(format("Error: tile size {0}x{1} does not fit atlas {2}x{3}.", tile_w, tile_h, atlas_width, atlas_height));
+	}
+	atlas_pixels.resize(size_t(atlas_width) * atlas_height);
+	ARGBBuffer atlas_buffer(atlas_pixels.data(), atlas_width, atlas_height);
+	expand_pixmap(atlas, atlas_buffer);
+	atlas_columns = atlas_width / tile_w;
+	unsigned tile_rows = atlas_height / tile_h;
+	tile_opaque.resize(size_t(atlas_columns) * tile_rows);
+	for(size_t tile = 0; tile < tile_opaque.size(); ++tile) {
+		ARGBBuffer tile_buffer = atlas_buffer.region(int(unsigned(tile) % atlas_columns * tile_w), int(unsigned(tile) / atlas_columns * tile_h), tile_w, tile_h);
+		bool opaque = true;
+		for(unsigned y = 0; opaque && y < tile_h; ++y) {
+			const uint32_t * row = tile_buffer.row(y);
+			opaque = std::find_if(row, row + tile_w, is_transparent) == row + tile_w;
+		}
+		tile_opaque[tile] = opaque;
+	}
+}
+
+/// Opaque tiles are copied, others are drawn over background.
+void TileRenderer::draw_tile(unsigned x, unsigned y, int sprite)
+{
+	ARGBBuffer target = ARGBBuffer(frame.data(), width(), height()).region(int(x * tile_w), int(y * tile_h), tile_w, tile_h);
+	bool valid_sprite = sprite >= 0 && unsigned(sprite) < tile_count();
+	if(!valid_sprite || !tile_opaque[size_t(sprite)]) {
+		for(unsigned row = 0; row < tile_h; ++row) {
+			std::fill(target.row(row), target.row(row) + tile_w, background_color);
+		}
+	}
+	if(!valid_sprite) {
+		return;
+	}
+	unsigned tile = unsigned(sprite);
+	ARGBBuffer source = ARGBBuffer(atlas_pixels.data(), atlas_width, atlas_height).region(int(tile % atlas_columns * tile_w), int(tile / atlas_columns * tile_h), tile_w, tile_h);
+	if(tile_opaque[tile]) {
+		for(unsigned row = 0; row < tile_h; ++row) {
+			memcpy(target.row(row), source.row(row), tile_w * sizeof(uint32_t));
+		}
+	} else {
+		blit(source, target, 0, 0, BLEND_COLOR_KEY);
+	}
+}
+
+/// Rectangles which end at the previous row are kept in a separate list,
+/// so spans of the current row are matched against them only.
+const std::vector<TileRenderer::Rect> & TileRenderer::render(const Map<int> & sprites)
+{
+	dirty.clear();
+	if(sprites.width() != drawn.width() || sprites.height() != drawn.height()) {
+		drawn = Map<int>(sprites.width(), sprites.height());
+		frame.assign(size_t(width()) * height(), background_color);
+		full_redraw = true;
+	}
+	std::vector<size_t> previous_row, current_row;
+	for(unsigned y = 0; y < drawn.height(); ++y) {
+		current_row.clear();
+		unsigned x = 0;
+		while(x < drawn.width()) {
+			if(!full_redraw && sprites.cell(int(x), int(y)) == drawn.cell(int(x), int(y))) {
+				++x;
+				continue;
+			}
+			unsigned start = x;
+			while(x < drawn.width() && (full_redraw || sprites.cell(int(x), int(y)) != drawn.cell(int(x), int(y)))) {
+				int sprite = sprites.cell(int(x), int(y));
+				draw_tile(x, y, sprite);
+				drawn.cell(int(x), int(y)) = sprite;
+				++x;
+			}
+			Rect span(start * tile_w, y * tile_h, (x - start) * tile_w, tile_h);
+			size_t index = dirty.size();
+			foreach(size_t previous, previous_row) {
+				if(dirty[previous].x == span.x && dirty[previous].width == span.width) {
+					index = previous;
+					break;
+				}
+			}
+			if(index < dirty.size()) {
+				dirty[index].height += tile_h;
+			} else {
+				dirty.push_back(span);
+			}
+			current_row.push_back(index);
+		}
+		previous_row.swap(current_row);
+	}
+	full_redraw = false;
+	return dirty;
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "blit.h"
+#include "map.h"
+#include <string>
+#include <vector>
+
+namespace Chthon { /// @defgroup TileRenderer Tile renderer
+/// @{
+
+/** Draws maps of sprite ids into ARGB framebuffer using tiles from atlas pixmap.
+ * Atlas is split into tiles of equal size row by row, and sprite id is the index of tile,
+ * so with 16x16 tiles and 128 pixels wide atlas sprite 9 is the second tile in the second row.
+ * Transparent pixels of tiles and cells with sprite ids outside of atlas show background colour.
+ *
+ * Renderer remembers what was drawn, so each frame only changed cells are redrawn,
+ * and changed areas are reported as dirty rectangles:
+ * @code{.cpp}
+ * TileRenderer renderer(atlas, 16, 16);
+ * foreach(const TileRenderer::Rect & rect, renderer.render(sprites)) {
+ *     present(renderer.pixels(), renderer.width(), rect);
+ * }
+ * @endcode
+ */
+class TileRenderer {
+public:
+	/// Basic TileRenderer exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Rectangle in framebuffer pixels.
+	struct Rect {
+		unsigned x, y, width, height;
+		Rect(unsigned rect_x = 0, unsigned rect_y = 0, unsigned rect_width = 0, unsigned rect_height = 0)
+			: x(rect_x), y(rect_y), width(rect_width), height(rect_height) {}
+	};
+
+	/** Constructs renderer with tiles of given size.
+	 * Atlas is expanded once, so pixmap is not needed after construction.
+	 * Throws Exception if tile size is zero or atlas is smaller than one tile.
+	 */
+	TileRenderer(const Pixmap & atlas, unsigned tile_width, unsigned tile_height, Color background = 0xff000000);
+
+	unsigned tile_width() const { return tile_w; }
+	unsigned tile_height() const { return tile_h; }
+	/// Returns count of tiles in atlas.
+	unsigned tile_count() const { return unsigned(tile_opaque.size()); }
+	/// Returns framebuffer width in pixels.
+	unsigned width() const { return drawn.width() * tile_w; }
+	/// Returns framebuffer height in pixels.
+	unsigned height() const { return drawn.height() * tile_h; }
+	/// Returns framebuffer pixels row by row, without padding.
+	const uint32_t * pixels() const { return frame.empty() ? nullptr : frame.data(); }
+
+	/** Draws cells which sprite ids have changed since the previous frame.
+	 * Framebuffer is resized to fit the map and redrawn completely if map size has changed.
+	 * Returns dirty rectangles: adjacent changed cells in a row are merged,
+	 * and equal spans in consecutive rows are merged into one rectangle.
+	 */
+	const std::vector<Rect> & render(const Map<int> & sprites);
+	/// Returns dirty rectangles of the last frame.
+	const std::vector<Rect> & dirty_rects() const { return dirty; }
+	/// Makes the next frame redraw all cells.
+	void invalidate() { full_redraw = true; }
+private:
+	unsigned tile_w, tile_h;
+	unsigned atlas_columns;
+	Color background_color;
+	std::vector<uint32_t> atlas_pixels;
+	unsigned atlas_width, atlas_height;
+	std::vector<bool> tile_opaque;
+	Map<int> drawn;
+	std::vector<uint32_t> frame;
+	std::vector<Rect> dirty;
+	bool full_redraw;
+	void draw_tile(unsigned x, unsigned y, int sprite);
+};
+
+/// @}
+}
@@ -142,6 +142,21 @@ bool contains(const char * s, char c)
 	return strchr(s, c) != nullptr;
 }
 
+StringView::StringView(const char * c_string)
+	: first(c_string), length(c_string ? strlen(c_string) : 0)
+{
+}
+
+bool StringView::operator==(const StringView & other) const
+{
+	return length == other.length && (length == 0 || memcmp(first, other.first, length) == 0);
+}
+
+bool StringView::operator<(const StringView & other) const
+{
+	return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+}
+
 }
 
 namespace Chthon { // InterleavedCharMap
@@ -166,6 +166,40 @@ bool contains(const std::map<K, V> & map, const K & key)
 	return map.count(key) > 0;
 }
 
+/** Non-owning reference to a sequence of chars.
+ * Used to refer to parts of a large buffer (e.g. mapped file) without copying.
+ * Referred data should outlive the view.
+ */
+class StringView {
+public:
+	typedef const char * const_iterator;
+	/// Constructs empty view.
+	StringView() : first(nullptr), length(0) {}
+	/// Constructs view of given size starting at data.
+	StringView(const char * data, size_t size) : first(data), length(size) {}
+	/// Constructs view of zero-terminated string.
+	StringView(const char * c_string);
+	/// Constructs view of std::string content. String should not be changed while view is used.
+	StringView(const std::string & s) : first(s.data()), length(s.size()) {}
+
+	const char * data() const { return first; }
+	size_t size() const { return length; }
+	bool empty() const { return length == 0; }
+	const_iterator begin() const { return first; }
+	const_iterator end() const { return first + length; }
+	char operator[](size_t index) const { return first[index]; }
+	/// Returns copy of referred chars.
+	std::string str() const { return std::string(first, length); }
+
+	bool operator==(const StringView & other) const;
+	bool operator!=(const StringView & other) const { return !operator==(other); }
+	/// Compares views lexicographically.
+	bool operator<(const StringView & other) const;
+private:
+	const char * first;
+	size_t length;
+};
+
 /** Class for obtaining string value from interleave 2D char array.
  * Usable through iterators, each begin()/end() call is supplied with
  * index of specified map. Mostly usable for compact storage of small
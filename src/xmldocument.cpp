@@ -0,0 +1,360 @@
+#include "xmldocument.h"
+#include "files.h"
+#include "format.h"
+#include <cstring>
+#include <cctype>
+#include <future>
+#include <thread>
+#include <new>
+#include <stdint.h>
+
+namespace Chthon {
+
+XMLArena::XMLArena(size_t default_block_size)
+	: block_size(default_block_size), pos(nullptr), left(0), total(0)
+{
+}
+
+/// Allocations larger than block size get their own block.
+void * XMLArena::allocate(size_t size, size_t alignment)
+{
+	size_t padding = pos ? (alignment - reinterpret_cast<uintptr_t>(pos) % alignment) % alignment : 0;
+	if(!pos || padding + size > left) {
+		size_t new_block_size = std::max(block_size, size + alignment);
+		blocks.push_back(std::unique_ptr<char[]>(new char[new_block_size]));
+		pos = blocks.back().get();
+		left = new_block_size;
+		padding = (alignment - reinterpret_cast<uintptr_t>(pos) % alignment) % alignment;
+	}
+	char * result = pos + padding;
+	pos = result + size;
+	left -= padding + size;
+	total += padding + size;
+	return result;
+}
+
+
+std::string XMLNode::content() const
+{
+	return decode_xml_content(text);
+}
+
+const XMLAttribute * XMLNode::find_attribute(const StringView & name) const
+{
+	for(size_t i = 0; i < attribute_count; ++i) {
+		if(attributes[i].name == name) {
+			return &attributes[i];
+		}
+	}
+	return nullptr;
+}
+
+std::string XMLNode::get_attribute(const StringView & name) const
+{
+	const XMLAttribute * attribute = find_attribute(name);
+	return attribute ? attribute->unescaped() : std::string();
+}
+
+const XMLNode * XMLNode::child(const StringView & name) const
+{
+	for(const XMLNode * node = first_child; node; node = node->next_sibling) {
+		if(node->tag == name) {
+			return node;
+		}
+	}
+	return nullptr;
+}
+
+const XMLNode * XMLNode::next() const
+{
+	for(const XMLNode * node = next_sibling; node; node = node->next_sibling) {
+		if(node->tag == tag) {
+			return node;
+		}
+	}
+	return nullptr;
+}
+
+/// @cond INTERNAL
+struct XMLPathCondition {
+	StringView attribute;
+	StringView value;
+	bool has_value;
+};
+
+struct XMLPathStep {
+	StringView tag;
+	std::vector<XMLPathCondition> conditions;
+	bool matches(const XMLNode & node) const;
+};
+/// @endcond
+
+bool XMLPathStep::matches(const XMLNode & node) const
+{
+	if(tag != StringView("*") && tag != node.tag) {
+		return false;
+	}
+	foreach(const XMLPathCondition & condition, conditions) {
+		const XMLAttribute * attribute = node.find_attribute(condition.attribute);
+		if(!attribute || (condition.has_value && attribute->value != condition.value)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static std::vector<XMLPathStep> parse_xml_path(const std::string & path)
+{
+	std::vector<XMLPathStep> steps;
+	const char * pos = path.data();
+	const char * end = pos + path.size();
+	while(pos != end) {
+		XMLPathStep step;
+		const char * start = pos;
+		while(pos != end && *pos != '/' && *pos != '[') {
+			++pos;
+		}
+		step.tag = StringView(start, size_t(pos - start));
+		while(pos != end && *pos == '[') {
+			++pos;
+			if(pos == end || *pos != '@') {
+				throw XMLDocument::Exception(format("Error: invalid XML path \"{0}\": expected '@'.", path));
+			}
+			XMLPathCondition condition;
+			start = ++pos;
+			while(pos != end && *pos != '=' && *pos != ']') {
+				++pos;
+			}
+			condition.attribute = StringView(start, size_t(pos - start));
+			condition.has_value = pos != end && *pos == '=';
+			if(condition.has_value) {
+				++pos;
+				char quote = (pos != end && (*pos == '"' || *pos == '\'')) ? *pos : ']';
+				if(quote != ']') {
+					++pos;
+				}
+				start = pos;
+				while(pos != end && *pos != quote) {
+					++pos;
+				}
+				condition.value = StringView(start, size_t(pos - start));
+				if(quote != ']' && pos != end) {
+					++pos;
+				}
+			}
+			if(pos == end || *pos != ']' || condition.attribute.empty()) {
+				throw XMLDocument::Exception(format("Error: invalid XML path \"{0}\": expected ']'.", path));
+			}
+			++pos;
+			step.conditions.push_back(condition);
+		}
+		if(step.tag.empty()) {
+			throw XMLDocument::Exception(format("Error: invalid XML path \"{0}\": empty step.", path));
+		}
+		if(pos != end) {
+			if(*pos != '/') {
+				throw XMLDocument::Exception(format("Error: invalid XML path \"{0}\": expected '/'.", path));
+			}
+			++pos;
+		}
+		steps.push_back(step);
+	}
+	return steps;
+}
+
+static void find_xml_nodes(const XMLNode & node, const std::vector<XMLPathStep> & steps, size_t step, std::vector<const XMLNode *> & result, bool first_only)
+{
+	if(step == steps.size()) {
+		result.push_back(&node);
+		return;
+	}
+	for(const XMLNode * child = node.first_child; child; child = child->next_sibling) {
+		if(first_only && !result.empty()) {
+			return;
+		}
+		if(steps[step].matches(*child)) {
+			find_xml_nodes(*child, steps, step + 1, result, first_only);
+		}
+	}
+}
+
+const XMLNode * XMLNode::find(const std::string & path) const
+{
+	std::vector<const XMLNode *> result;
+	find_xml_nodes(*this, parse_xml_path(path), 0, result, true);
+	return result.empty() ? nullptr : result.front();
+}
+
+std::vector<const XMLNode *> XMLNode::find_all(const std::string & path) const
+{
+	std::vector<const XMLNode *> result;
+	find_xml_nodes(*this, parse_xml_path(path), 0, result, false);
+	return result;
+}
+
+
+XMLDocument::XMLDocument(const char * data, size_t size)
+	: root_node(nullptr), count(0)
+{
+	build(data, size);
+}
+
+XMLDocument::XMLDocument(const std::string & filename)
+	: file(std::make_shared<MappedFile>(filename)), root_node(nullptr), count(0)
+{
+	if(!file->is_open()) {
+		throw Exception(format("Error: cannot open XML file \"{0}\".", filename));
+	}
+	build(file->data(), file->size());
+}
+
+static XMLNode make_xml_node(const StringView & tag, const XMLNode * parent)
+{
+	XMLNode node;
+	node.tag = tag;
+	node.attributes = nullptr;
+	node.attribute_count = 0;
+	node.parent = parent;
+	node.first_child = nullptr;
+	node.next_sibling = nullptr;
+	node.last_child = nullptr;
+	return node;
+}
+
+/// Text of element is the content right after its opening tag.
+void XMLDocument::build(const char * data, size_t size)
+{
+	root_node = arena.create(make_xml_node(StringView(), nullptr));
+	std::vector<XMLNode *> open_nodes(1, root_node);
+	XMLNode * current = root_node;
+	bool text_expected = true;
+	XMLBufferReader reader(data, size);
+	for(StringView tag = reader.to_next_tag(); !tag.empty(); tag = reader.to_next_tag()) {
+		if(text_expected) {
+			current->text = reader.get_raw_content();
+			text_expected = false;
+		}
+		if(tag[0] == '?' || tag[0] == '!') {
+			continue;
+		}
+		if(tag[0] == '/') {
+			StringView name(tag.data() + 1, tag.size() - 1);
+			size_t depth = open_nodes.size() - 1;
+			while(depth > 0 && open_nodes[depth]->tag != name) {
+				--depth;
+			}
+			if(depth > 0) {
+				open_nodes.resize(depth);
+				current = open_nodes.back();
+			}
+			continue;
+		}
+		XMLNode * node = arena.create(make_xml_node(tag, current));
+		++count;
+		const std::vector<XMLAttribute> & attributes = reader.get_attributes();
+		bool self_closed = false;
+		size_t attribute_count = 0;
+		foreach(const XMLAttribute & attribute, attributes) {
+			if(attribute.name == StringView("/")) {
+				self_closed = true;
+			} else {
+				++attribute_count;
+			}
+		}
+		if(attribute_count > 0) {
+			XMLAttribute * node_attributes = static_cast<XMLAttribute *>(arena.allocate(sizeof(XMLAttribute) * attribute_count, alignof(XMLAttribute)));
+			node->attributes = node_attributes;
+			foreach(const XMLAttribute & attribute, attributes) {
+				if(attribute.name != StringView("/")) {
+					new(node_attributes++) XMLAttribute(attribute);
+				}
+			}
+			node->attribute_count = attribute_count;
+		}
+		if(current->last_child) {
+			current->last_child->next_sibling = node;
+		} else {
+			current->first_child = node;
+		}
+		current->last_child = node;
+		if(!self_closed) {
+			open_nodes.push_back(node);
+			current = node;
+			text_expected = true;
+		}
+	}
+	if(text_expected) {
+		current->text = reader.get_raw_content();
+	}
+}
+
+/// Returns position of the first record tag at or after given position, or end.
+static const char * find_xml_record(const char * pos, const char * end, const std::string & record_tag)
+{
+	while(pos != end) {
+		const char * tag_start = static_cast<const char *>(memchr(pos, '<', size_t(end - pos)));
+		if(!tag_start) {
+			return end;
+		}
+		const char * name = tag_start + 1;
+		const char * after_name = name + record_tag.size();
+		if(size_t(end - name) >= record_tag.size() && memcmp(name, record_tag.data(), record_tag.size()) == 0) {
+			if(after_name == end || *after_name == '>' || *after_name == '/' || isspace(static_cast<unsigned char>(*after_name))) {
+				return tag_start;
+			}
+		}
+		pos = name;
+	}
+	return end;
+}
+
+size_t parse_xml_records(const char * data, size_t size, const std::string & record_tag,
+		const std::function<void(const XMLNode &)> & callback, unsigned thread_count)
+{
+	const size_t min_chunk_size = 65536;
+	if(thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	const char * end = data + size;
+	size_t chunk_count = std::max<size_t>(1, std::min<size_t>(thread_count, size / min_chunk_size));
+	std::vector<const char *> bounds(1, find_xml_record(data, end, record_tag));
+	for(size_t i = 1; i < chunk_count; ++i) {
+		const char * bound = find_xml_record(std::max(bounds.back(), data + size * i / chunk_count), end, record_tag);
+		if(bound != bounds.back()) {
+			bounds.push_back(bound);
+		}
+	}
+	bounds.push_back(end);
+
+	std::vector<std::future<std::shared_ptr<XMLDocument> > > chunks;
+	for(size_t i = 0; i + 1 < bounds.size(); ++i) {
+		const char * chunk = bounds[i];
+		size_t chunk_size = size_t(bounds[i + 1] - bounds[i]);
+		chunks.push_back(std::async(std::launch::async, [chunk, chunk_size]() {
+			return std::make_shared<XMLDocument>(chunk, chunk_size);
+		}));
+	}
+	size_t count = 0;
+	for(size_t i = 0; i < chunks.size(); ++i) {
+		std::shared_ptr<XMLDocument> document = chunks[i].get();
+		for(const XMLNode * node = document->root().first_child; node; node = node->next_sibling) {
+			if(node->tag == record_tag) {
+				callback(*node);
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
+size_t parse_xml_records(const std::string & filename, const std::string & record_tag,
+		const std::function<void(const XMLNode &)> & callback, unsigned thread_count)
+{
+	MappedFile file(filename);
+	if(!file.is_open()) {
+		throw XMLDocument::Exception(format("Error: cannot open XML file \"{0}\".", filename));
+	}
+	return parse_xml_records(file.data(), file.size(), record_tag, callback, thread_count);
+}
+
+}
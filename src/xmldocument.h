@@ -0,0 +1,142 @@
+#pragma once
+#include "xmlreader.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Chthon { /// @defgroup XMLDocument XML document tree
+/// @{
+
+/// @cond INTERNAL
+class MappedFile;
+
+class XMLArena {
+public:
+	XMLArena(size_t default_block_size = 65536);
+	void * allocate(size_t size, size_t alignment);
+	template<class T>
+	T * create(const T & value) { return new(allocate(sizeof(T), alignof(T))) T(value); }
+	size_t allocated() const { return total; }
+private:
+	size_t block_size;
+	std::vector<std::unique_ptr<char[]> > blocks;
+	char * pos;
+	size_t left;
+	size_t total;
+};
+/// @endcond
+
+/** Element of XML document.
+ * All strings are views into source buffer, and nodes themselves are owned by XMLDocument,
+ * so nodes are valid as long as document exists.
+ */
+struct XMLNode {
+	/// Tag name. Empty for the root of document.
+	StringView tag;
+	/// Raw text between opening tag and the first child or closing tag, entities are not converted.
+	StringView text;
+	/// Attributes in order of appearance.
+	const XMLAttribute * attributes;
+	/// Count of attributes.
+	size_t attribute_count;
+	/// Parent node. Null pointer for the root of document.
+	const XMLNode * parent;
+	/// First child node or null pointer.
+	const XMLNode * first_child;
+	/// Next sibling node or null pointer.
+	const XMLNode * next_sibling;
+
+	/// Returns text with entities converted.
+	std::string content() const;
+	/// Returns first attribute with given name, or null pointer if there is no such attribute.
+	const XMLAttribute * find_attribute(const StringView & name) const;
+	/// Returns unescaped value of attribute with given name, or empty string if there is no such attribute.
+	std::string get_attribute(const StringView & name) const;
+	/// Returns first child with given tag name or null pointer.
+	const XMLNode * child(const StringView & name) const;
+	/// Returns next sibling with the same tag name or null pointer.
+	const XMLNode * next() const;
+	/** Returns first node matching given path, or null pointer if nothing matches.
+	 * Path is relative to this node and consists of steps separated by '/'.
+	 * Each step is a tag name (or `*` for any tag) with optional conditions on attributes:
+	 * `[@name]` checks that attribute is present, `[@name=value]` checks raw attribute value.
+	 * Value can be quoted with single or double quotes.
+	 * Throws XMLDocument::Exception if path is invalid.
+	 * @code{.cpp}
+	 * const XMLNode * node = document.root().find("data/item[@id=sword]/name");
+	 * @endcode
+	 */
+	const XMLNode * find(const std::string & path) const;
+	/// Returns all nodes matching given path in document order.
+	/// @see find()
+	std::vector<const XMLNode *> find_all(const std::string & path) const;
+
+	/// @cond INTERNAL
+	XMLNode * last_child;
+	/// @endcond
+};
+
+/** XML document tree, built in one pass over the buffer.
+ * Nodes and attribute arrays are allocated in memory arena owned by the document,
+ * and all strings are views into source buffer, so building does not make
+ * allocation per node and lookups are just pointer walks.
+ *
+ * Parsing is tolerant like XMLReader: declarations and comments are skipped,
+ * unmatched closing tags are ignored, unclosed elements are closed at the end of document.
+ * @see XMLReader
+ */
+class XMLDocument {
+public:
+	/// Basic XMLDocument exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Parses memory buffer of given size. Buffer should outlive the document.
+	XMLDocument(const char * data, size_t size);
+	/// Maps and parses file with given name. Throws Exception if file cannot be mapped.
+	XMLDocument(const std::string & filename);
+	/// Returns root node, which children are top-level elements of document.
+	const XMLNode & root() const { return *root_node; }
+	/// Returns count of element nodes.
+	size_t node_count() const { return count; }
+	/// Returns total size of memory allocated for nodes and attributes.
+	size_t allocated() const { return arena.allocated(); }
+private:
+	std::shared_ptr<MappedFile> file;
+	XMLArena arena;
+	XMLNode * root_node;
+	size_t count;
+	void build(const char * data, size_t size);
+	XMLDocument(const XMLDocument &);
+	XMLDocument & operator=(const XMLDocument &);
+};
+
+/** Parses large flat XML document in parallel and calls callback for each record.
+ * Records are elements with given tag name; they should not be nested
+ * and tag should not appear inside comments or attribute values.
+ * Buffer is split into chunks at the beginning of records,
+ * chunks are parsed as XMLDocument on up to thread_count threads (0 means hardware concurrency),
+ * and callback is called on the calling thread in document order,
+ * while the following chunks are still being parsed.
+ * Text outside records and elements with other tags are skipped.
+ * Returns count of records.
+ * @code{.cpp}
+ * parse_xml_records(data, size, "item", [&](const XMLNode & item) {
+ *     items.push_back(Item(item.get_attribute("id")));
+ * });
+ * @endcode
+ */
+size_t parse_xml_records(const char * data, size_t size, const std::string & record_tag,
+		const std::function<void(const XMLNode &)> & callback, unsigned thread_count = 0);
+/** Maps file with given name and parses its records.
+ * Throws XMLDocument::Exception if file cannot be mapped.
+ * @see parse_xml_records()
+ */
+size_t parse_xml_records(const std::string & filename, const std::string & record_tag,
+		const std::function<void(const XMLNode &)> & callback, unsigned thread_count = 0);
+
+/// @}
+}
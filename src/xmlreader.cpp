@@ -4,6 +4,11 @@
 #include "format.h"
 #include <sstream>
 #include <cctype>
+#include <cstring>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace Chthon {
 
@@ -13,93 +18,183 @@ XMLReader::XMLReader(std::istream & stream)
 	s.unsetf(std::ios::skipws);
 }
 
-const std::string & XMLReader::skip_to_tag(const std::string & tag_name)
+static bool equals(const char * name, size_t length, const char * expected)
+{
+	return length == strlen(expected) && memcmp(name, expected, length) == 0;
+}
+
+/// Dispatches by the first char, so each entity is compared with a few candidates at most.
+static const char * named_xml_entity(const char * name, size_t length)
 {
-	to_next_tag();
-	while(!current_tag.empty() && current_tag != tag_name) {
-		to_next_tag();
+	switch(name[0]) {
+		case 'a':
+			if(equals(name, length, "amp")) {
+				return "&";
+			}
+			if(equals(name, length, "apos")) {
+				return "'";
+			}
+			break;
+		case 'g':
+			if(equals(name, length, "gt")) {
+				return ">";
+			}
+			break;
+		case 'h':
+			if(equals(name, length, "hellip")) {
+				return "…";
+			}
+			break;
+		case 'l':
+			if(equals(name, length, "lt")) {
+				return "<";
+			}
+			if(equals(name, length, "laquo")) {
+				return "«";
+			}
+			if(equals(name, length, "ldquo")) {
+				return "“";
+			}
+			break;
+		case 'm':
+			if(equals(name, length, "mdash")) {
+				return "—";
+			}
+			break;
+		case 'n':
+			if(equals(name, length, "nbsp")) {
+				return " ";
+			}
+			if(equals(name, length, "ndash")) {
+				return "–";
+			}
+			break;
+		case 'q':
+			if(equals(name, length, "quot")) {
+				return "\"";
+			}
+			break;
+		case 'r':
+			if(equals(name, length, "raquo")) {
+				return "»";
+			}
+			if(equals(name, length, "rarr")) {
+				return "→";
+			}
+			if(equals(name, length, "rsquo")) {
+				return "’";
+			}
+			if(equals(name, length, "rdquo")) {
+				return "”";
+			}
+			if(equals(name, length, "rlm")) {
+				return "@";
+			}
+			break;
+		default: break;
 	}
-	return current_tag;
+	return nullptr;
 }
 
-static std::string convert_xml_entity(const std::string & entity)
-{
-	static std::vector<std::pair<std::string, std::string>> entities_data = {
-		{"quot", "\""},
-		{"nbsp", " "},
-		{"#171", "«"},
-		{"#187", "»"},
-		{"laquo", "«"},
-		{"raquo", "»"},
-		{"lt", "<"},
-		{"gt", ">"},
-		{"amp", "&"},
-		{"rarr", "→"},
-		{"mdash", "—"},
-		{"ndash", "–"},
-		{"#8216", "‘"},
-		{"#8217", "’"},
-		{"hellip", "…"},
-		{"rsquo", "’"},
-		{"rdquo", "”"},
-		{"ldquo", "“"},
-		{"#8220", "“"},
-		{"#8221", "”"},
-		{"#8211", "–"},
-		{"#8230", "…"},
-		{"#8594", "→"},
-		{"apos", "'"},
-		{"#58", ":"},
-		{"#41", ")"},
-		{"rlm", "@"},
-	};
-	static std::map<std::string, std::string> entities(
-			entities_data.begin(), entities_data.end());
-
-	if(entities.count(entity)) {
-		return entities[entity];
-	} else if(Chthon::starts_with(entity, "#")) {
-		int entity_code = atoi(entity.substr(1).c_str());
-		if(entity_code < 128) {
-			return std::string(1, (char)entity_code);
-		}
-	}
-	return '&' + entity + ';';
+/// Parses decimal (`#8230`) or hexadecimal (`#x2026`) code. Returns 0 if code is invalid.
+static uint32_t numeric_xml_entity(const char * name, size_t length)
+{
+	const uint32_t max_code = 0x10ffff;
+	bool hex = length > 1 && (name[1] == 'x' || name[1] == 'X');
+	size_t start = hex ? 2 : 1;
+	if(length <= start) {
+		return 0;
+	}
+	uint32_t code = 0;
+	for(size_t i = start; i < length; ++i) {
+		char ch = name[i];
+		uint32_t digit = 0;
+		if(ch >= '0' && ch <= '9') {
+			digit = uint32_t(ch - '0');
+		} else if(hex && ch >= 'a' && ch <= 'f') {
+			digit = uint32_t(ch - 'a' + 10);
+		} else if(hex && ch >= 'A' && ch <= 'F') {
+			digit = uint32_t(ch - 'A' + 10);
+		} else {
+			return 0;
+		}
+		code = code * (hex ? 16 : 10) + digit;
+		if(code > max_code) {
+			return 0;
+		}
+	}
+	if(code >= 0xd800 && code <= 0xdfff) {
+		return 0;
+	}
+	return code;
 }
 
-const std::string & XMLReader::to_next_tag()
+static void append_utf8(std::string & out, uint32_t code)
 {
-	current_tag.clear();
-	current_content.clear();
-	attributes.clear();
+	if(code < 0x80) {
+		out += char(code);
+	} else if(code < 0x800) {
+		out += char(0xc0 | (code >> 6));
+		out += char(0x80 | (code & 0x3f));
+	} else if(code < 0x10000) {
+		out += char(0xe0 | (code >> 12));
+		out += char(0x80 | ((code >> 6) & 0x3f));
+		out += char(0x80 | (code & 0x3f));
+	} else {
+		out += char(0xf0 | (code >> 18));
+		out += char(0x80 | ((code >> 12) & 0x3f));
+		out += char(0x80 | ((code >> 6) & 0x3f));
+		out += char(0x80 | (code & 0x3f));
+	}
+}
 
-	char ch;
-	std::string entity;
-	bool in_entity = false;
-	s >> ch;
-	while(s && ch != '<') {
-		if(ch == '&') {
-			in_entity = true;
-		} else if(in_entity) {
-			if(ch == ';') {
-				current_content += convert_xml_entity(entity);
-				entity.clear();
-				in_entity = false;
-			} else {
-				entity += ch;
+/** Appends value of entity (name between '&' and ';') to the output.
+ * Numeric entities are encoded to UTF-8.
+ * Unknown or invalid entities are appended as is.
+ */
+static void append_xml_entity(std::string & out, const char * name, size_t length)
+{
+	if(length > 0) {
+		if(name[0] == '#') {
+			uint32_t code = numeric_xml_entity(name, length);
+			if(code != 0) {
+				append_utf8(out, code);
+				return;
 			}
 		} else {
-			current_content += ch;
+			const char * value = named_xml_entity(name, length);
+			if(value) {
+				out += value;
+				return;
+			}
 		}
-		s >> ch;
 	}
-	if(in_entity) {
-		current_content += '&' + entity;
+	out += '&';
+	out.append(name, length);
+	out += ';';
+}
+
+const std::string & XMLReader::to_next_tag()
+{
+	current_tag.clear();
+	current_content.clear();
+	attributes.clear();
+	raw_content.clear();
+	std::getline(s, raw_content, '<');
+	current_content = decode_xml_content(raw_content);
+	if(!s.eof()) {
+		read_tag();
 	}
+	return current_tag;
+}
 
+/// Reads tag after '<' up to the closing '>'. Tag name may be already read into current_tag.
+void XMLReader::read_tag()
+{
 	enum { ERROR, TAG_NAME, ATTRIBUTE, EQUALS };
 	std::string attribute;
 	int mode = TAG_NAME;
+	char ch;
 	s >> ch;
 	while(s && ch != '>') {
 		switch(mode) {
@@ -154,7 +249,392 @@ const std::string & XMLReader::to_next_tag()
 	if(!attribute.empty()) {
 		attributes[attribute] = "";
 	}
+}
+
+/// Content is searched with std::getline(), which scans stream buffer for '<' as a whole.
+/// Skipped tags are compared by name only, their attributes and content are not parsed.
+const std::string & XMLReader::skip_to_tag(const std::string & tag_name)
+{
+	if(tag_name.empty()) {
+		return to_next_tag();
+	}
+	current_tag.clear();
+	current_content.clear();
+	attributes.clear();
+	raw_content.clear();
+	while(std::getline(s, raw_content, '<')) {
+		if(s.eof()) {
+			break;
+		}
+		while(s && isspace(s.peek())) {
+			s.get();
+		}
+		size_t matched = 0;
+		bool same = true;
+		for(int ch = s.peek(); ch != EOF && ch != '>' && !isspace(ch) && (ch != '/' || (matched == 0 && same)); ch = s.peek()) {
+			if(same && matched < tag_name.size() && tag_name[matched] == char(ch)) {
+				++matched;
+			} else {
+				same = false;
+			}
+			s.get();
+		}
+		if(same && matched == tag_name.size()) {
+			current_content = decode_xml_content(raw_content);
+			current_tag = tag_name;
+			read_tag();
+			return current_tag;
+		}
+		skip_tag_body();
+		raw_content.clear();
+	}
+	current_content = decode_xml_content(raw_content);
+	return current_tag;
+}
+
+void XMLReader::skip_tag_body()
+{
+	char ch;
+	while(s.get(ch) && ch != '>') {
+		if(ch == '"') {
+			while(s.get(ch) && ch != '"') {
+				if(ch == '\\') {
+					s.get(ch);
+				}
+			}
+		}
+	}
+}
+
+std::string decode_xml_content(const StringView & text)
+{
+	std::string result;
+	result.reserve(text.size());
+	const char * pos = text.begin();
+	while(pos != text.end()) {
+		const char * amp = static_cast<const char *>(memchr(pos, '&', size_t(text.end() - pos)));
+		if(!amp) {
+			result.append(pos, text.end());
+			break;
+		}
+		result.append(pos, amp);
+		const char * semicolon = static_cast<const char *>(memchr(amp, ';', size_t(text.end() - amp)));
+		if(!semicolon) {
+			result.append(amp, text.end());
+			break;
+		}
+		append_xml_entity(result, amp + 1, size_t(semicolon - amp - 1));
+		pos = semicolon + 1;
+	}
+	return result;
+}
+
+std::string XMLAttribute::unescaped() const
+{
+	if(!quoted) {
+		return value.str();
+	}
+	std::string result;
+	result.reserve(value.size());
+	for(const char * pos = value.begin(); pos != value.end(); ++pos) {
+		if(*pos == '\\' && pos + 1 != value.end()) {
+			++pos;
+		}
+		result += *pos;
+	}
+	return result;
+}
+
+static bool is_space(char ch)
+{
+	return isspace(static_cast<unsigned char>(ch)) != 0;
+}
+
+/// Scans 16 bytes at once when SSE2 is available.
+static const char * find_char(const char * pos, const char * end, char ch)
+{
+#ifdef __SSE2__
+	const __m128i pattern = _mm_set1_epi8(ch);
+	while(end - pos >= 16) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+		unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern)));
+		if(mask != 0) {
+			return pos + __builtin_ctz(mask);
+		}
+		pos += 16;
+	}
+#endif
+	const void * found = memchr(pos, ch, size_t(end - pos));
+	return found ? static_cast<const char *>(found) : end;
+}
+
+/// Returns position right after the closing '>' of tag. Quoted values may contain '>'.
+static const char * skip_tag_body(const char * pos, const char * end)
+{
+	while(pos != end) {
+		const char * close = find_char(pos, end, '>');
+		const char * quote = static_cast<const char *>(memchr(pos, '"', size_t(close - pos)));
+		if(!quote) {
+			return close == end ? end : close + 1;
+		}
+		pos = quote + 1;
+		while(pos != end && *pos != '"') {
+			if(*pos == '\\' && pos + 1 != end) {
+				++pos;
+			}
+			++pos;
+		}
+		if(pos != end) {
+			++pos;
+		}
+	}
+	return end;
+}
+
+XMLBufferReader::XMLBufferReader(const char * data, size_t size)
+	: begin(data), current(data), end(data + size)
+{
+}
+
+XMLBufferReader::XMLBufferReader(const std::string & filename)
+	: file(std::make_shared<MappedFile>(filename)), begin(nullptr), current(nullptr), end(nullptr)
+{
+	if(!file->is_open()) {
+		throw Exception(format("Error: cannot open XML file \"{0}\".", filename));
+	}
+	begin = current = file->data();
+	end = begin + file->size();
+}
+
+/// Skipped tags are compared by name only, their attributes and content are not parsed.
+StringView XMLBufferReader::skip_to_tag(const StringView & tag_name)
+{
+	if(tag_name.empty()) {
+		return to_next_tag();
+	}
+	current_tag = StringView();
+	attributes.clear();
+	const char * content_start = current;
+	while(current != end) {
+		const char * tag_start = find_char(current, end, '<');
+		if(tag_start == end) {
+			break;
+		}
+		const char * name = tag_start + 1;
+		while(name != end && is_space(*name)) {
+			++name;
+		}
+		if(size_t(end - name) >= tag_name.size() && memcmp(name, tag_name.data(), tag_name.size()) == 0) {
+			const char * after_name = name + tag_name.size();
+			if(after_name == end || *after_name == '>' || *after_name == '/' || is_space(*after_name)) {
+				raw_content = StringView(content_start, size_t(tag_start - content_start));
+				current = tag_start + 1;
+				read_tag();
+				return current_tag;
+			}
+		}
+		current = skip_tag_body(name, end);
+		content_start = current;
+	}
+	raw_content = StringView(content_start, size_t(end - content_start));
+	current = end;
+	return current_tag;
+}
+
+StringView XMLBufferReader::to_next_tag()
+{
+	current_tag = StringView();
+	attributes.clear();
+	const char * tag_start = find_char(current, end, '<');
+	if(tag_start == end) {
+		raw_content = StringView(current, size_t(end - current));
+		current = end;
+		return current_tag;
+	}
+	raw_content = StringView(current, size_t(tag_start - current));
+	current = tag_start + 1;
+	read_tag();
 	return current_tag;
 }
 
+/// Reads tag from current position (right after '<') up to the closing '>' inclusively.
+void XMLBufferReader::read_tag()
+{
+	static const char slash[] = "/";
+	while(current != end && is_space(*current)) {
+		++current;
+	}
+	const char * name_start = current;
+	while(current != end && *current != '>' && !is_space(*current) && (*current != '/' || current == name_start)) {
+		++current;
+	}
+	current_tag = StringView(name_start, size_t(current - name_start));
+	while(current != end) {
+		while(current != end && is_space(*current)) {
+			++current;
+		}
+		if(current == end) {
+			break;
+		}
+		if(*current == '>') {
+			++current;
+			break;
+		}
+		if(*current == '/') {
+			attributes.push_back(XMLAttribute(StringView(slash, 1)));
+			++current;
+			continue;
+		}
+		const char * attr_start = current;
+		while(current != end && *current != '>' && *current != '=' && *current != '/' && !is_space(*current)) {
+			++current;
+		}
+		XMLAttribute attribute(StringView(attr_start, size_t(current - attr_start)));
+		const char * after_name = current;
+		while(current != end && is_space(*current)) {
+			++current;
+		}
+		if(current == end || *current != '=') {
+			current = after_name;
+			attributes.push_back(attribute);
+			continue;
+		}
+		++current;
+		while(current != end && is_space(*current)) {
+			++current;
+		}
+		const char * value_start = current;
+		if(current != end && *current == '"') {
+			attribute.quoted = true;
+			value_start = ++current;
+			while(current != end && *current != '"') {
+				if(*current == '\\' && current + 1 != end) {
+					++current;
+				}
+				++current;
+			}
+			attribute.value = StringView(value_start, size_t(current - value_start));
+			if(current != end) {
+				++current;
+			}
+		} else {
+			while(current != end && *current != '>' && !is_space(*current)) {
+				if(*current == '/' && current + 1 != end && current[1] == '>') {
+					break;
+				}
+				++current;
+			}
+			attribute.value = StringView(value_start, size_t(current - value_start));
+		}
+		attributes.push_back(attribute);
+	}
+}
+
+std::string XMLBufferReader::get_current_content() const
+{
+	return decode_xml_content(raw_content);
+}
+
+const XMLAttribute * XMLBufferReader::find_attribute(const StringView & name) const
+{
+	foreach(const XMLAttribute & attribute, attributes) {
+		if(attribute.name == name) {
+			return &attribute;
+		}
+	}
+	return nullptr;
+}
+
+std::string XMLBufferReader::get_attribute(const StringView & name) const
+{
+	const XMLAttribute * attribute = find_attribute(name);
+	return attribute ? attribute->unescaped() : std::string();
+}
+
+XMLPushParser::XMLPushParser(size_t max_buffer_size)
+	: max_size(max_buffer_size), in_tag(false), in_quote(false), escaped(false), tag_scan(0)
+{
+}
+
+/// Input is processed by slices which fit into the rest of buffer, so buffer never grows over max size.
+void XMLPushParser::feed(const char * data, size_t size)
+{
+	const size_t slice_size = 65536;
+	while(size > 0) {
+		if(!buffer.empty() && buffer.size() >= max_size) {
+			throw Exception(format("Error: XML tag is too long (more than {0} bytes).", max_size));
+		}
+		size_t free_size = max_size > buffer.size() ? max_size - buffer.size() : 1;
+		size_t slice = std::min(size, std::min(slice_size, free_size));
+		buffer.append(data, slice);
+		data += slice;
+		size -= slice;
+		process(false);
+	}
+}
+
+void XMLPushParser::finish()
+{
+	process(true);
+	buffer.clear();
+	in_tag = in_quote = escaped = false;
+	tag_scan = 0;
+}
+
+void XMLPushParser::process(bool final)
+{
+	const size_t max_entity_size = 32;
+	size_t pos = 0;
+	while(pos < buffer.size()) {
+		if(!in_tag) {
+			size_t tag_start = buffer.find('<', pos);
+			size_t content_end = tag_start == std::string::npos ? buffer.size() : tag_start;
+			if(tag_start == std::string::npos && !final) {
+				size_t amp = buffer.rfind('&');
+				if(amp != std::string::npos && amp >= pos && buffer.find(';', amp) == std::string::npos && buffer.size() - amp <= max_entity_size) {
+					content_end = amp;
+				}
+			}
+			if(content_end > pos) {
+				on_content(decode_xml_content(StringView(buffer.data() + pos, content_end - pos)));
+			}
+			pos = content_end;
+			if(tag_start == std::string::npos) {
+				break;
+			}
+			in_tag = true;
+			tag_scan = pos + 1;
+		}
+		size_t tag_end = tag_scan;
+		while(tag_end < buffer.size()) {
+			char ch = buffer[tag_end];
+			if(escaped) {
+				escaped = false;
+			} else if(in_quote) {
+				escaped = ch == '\\';
+				in_quote = ch != '"';
+			} else if(ch == '"') {
+				in_quote = true;
+			} else if(ch == '>') {
+				break;
+			}
+			++tag_end;
+		}
+		if(tag_end == buffer.size() && !final) {
+			tag_scan = tag_end;
+			break;
+		}
+		tag_end = std::min(tag_end + 1, buffer.size());
+		XMLBufferReader reader(buffer.data() + pos, tag_end - pos);
+		reader.to_next_tag();
+		on_tag(reader.get_current_tag(), reader.get_attributes());
+		pos = tag_end;
+		in_tag = in_quote = escaped = false;
+	}
+	buffer.erase(0, pos);
+	if(in_tag) {
+		tag_scan -= pos;
+	}
+}
+
 }
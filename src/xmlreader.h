@@ -1,6 +1,9 @@
 #pragma once
+#include "util.h"
 #include <string>
+#include <vector>
 #include <map>
+#include <memory>
 
 namespace Chthon {
 
@@ -22,7 +25,8 @@ struct XMLReader {
 	const std::string & to_next_tag();
 	/** Reads fast-forward till finds specified tag, or to the EOF if tag could
 	 * not be found.
-	 * Equivalent to calling to_next_tag() in the loop.
+	 * Equivalent to calling to_next_tag() in the loop,
+	 * but skipped tags are not parsed and content is not converted.
 	 * @see to_next_tag();
 	 */
 	const std::string & skip_to_tag(const std::string & tag_name);
@@ -37,7 +41,148 @@ private:
 	std::istream & s;
 	std::string current_tag;
 	std::string current_content;
+	std::string raw_content;
 	std::map<std::string, std::string> attributes;
+	void read_tag();
+	void skip_tag_body();
 };
 
+class MappedFile;
+
+/// Tag attribute as views into the XML buffer.
+struct XMLAttribute {
+	/// Attribute name.
+	StringView name;
+	/// Raw attribute value without quotes. Escaped chars are not converted.
+	StringView value;
+	/// True if value was quoted, i.e. may contain escaped chars.
+	bool quoted;
+	/// Constructs attribute with given name and value.
+	XMLAttribute(const StringView & attr_name = StringView(), const StringView & attr_value = StringView(), bool is_quoted = false)
+		: name(attr_name), value(attr_value), quoted(is_quoted) {}
+	/// Returns value with escaped chars converted.
+	std::string unescaped() const;
+};
+
+/** Iterator class for XML document, which is already in memory.
+ * Works like XMLReader, but does not copy anything:
+ * tag name, attributes and content are views into the buffer,
+ * so they are valid as long as the reader exists.
+ * Entities in content are converted only when decoded content is requested.
+ * @code{.cpp}
+ * XMLBufferReader reader("data.xml");
+ * while(!reader.skip_to_tag("item").empty()) {
+ *     std::string name = reader.get_attribute("name");
+ * }
+ * @endcode
+ * @see XMLReader
+ */
+class XMLBufferReader {
+public:
+	/// Basic XMLBufferReader exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Reads from memory buffer of given size. Buffer should outlive the reader.
+	XMLBufferReader(const char * data, size_t size);
+	/// Maps file with given name. Throws Exception if file cannot be mapped.
+	XMLBufferReader(const std::string & filename);
+
+	/** Seeks to the end of the next tag.
+	 * If there is not tag, seeks up until the end of buffer.
+	 * @see XMLReader::to_next_tag()
+	 */
+	StringView to_next_tag();
+	/** Reads fast-forward till finds specified tag, or to the end of buffer if tag could
+	 * not be found.
+	 * Equivalent to calling to_next_tag() in the loop,
+	 * but buffer is scanned for tags by blocks (using SSE2 when available)
+	 * and skipped tags are not parsed.
+	 */
+	StringView skip_to_tag(const StringView & tag_name);
+	/// Returns current position in buffer.
+	size_t position() const { return size_t(current - begin); }
+
+	/// Get current (last found) tag.
+	StringView get_current_tag() const { return current_tag; }
+	/// Get raw current content (between last and current tag) without conversion of entities.
+	StringView get_raw_content() const { return raw_content; }
+	/// Get current content with entities converted.
+	std::string get_current_content() const;
+	/// Get attributes for current tag in order of appearance.
+	const std::vector<XMLAttribute> & get_attributes() const { return attributes; }
+	/// Returns true if current tag has attribute with given name.
+	bool has_attribute(const StringView & name) const { return find_attribute(name) != nullptr; }
+	/// Returns first attribute of current tag with given name, or null pointer if there is no such attribute.
+	const XMLAttribute * find_attribute(const StringView & name) const;
+	/// Returns unescaped value of attribute with given name, or empty string if there is no such attribute.
+	std::string get_attribute(const StringView & name) const;
+private:
+	std::shared_ptr<MappedFile> file;
+	const char * begin;
+	const char * current;
+	const char * end;
+	StringView current_tag;
+	StringView raw_content;
+	std::vector<XMLAttribute> attributes;
+	void read_tag();
+};
+
+/** Push-mode XML parser for input which becomes available by parts (e.g. from pipe).
+ * Chunks of any size are passed to feed(), parser keeps its state between calls
+ * and calls on_content() and on_tag() as soon as text or tag is complete.
+ * Tags are parsed like in XMLReader.
+ * Content may be reported in several parts, but entities are never split between parts.
+ * Only incomplete tag is buffered, so buffer size is bounded:
+ * tag longer than max_buffer_size makes feed() throw Exception.
+ * @code{.cpp}
+ * struct ItemParser : XMLPushParser {
+ *     virtual void on_tag(const StringView & tag, const std::vector<XMLAttribute> &) { ... }
+ * };
+ * ItemParser parser;
+ * while(in.read(chunk, sizeof(chunk)) || in.gcount() > 0) {
+ *     parser.feed(chunk, size_t(in.gcount()));
+ * }
+ * parser.finish();
+ * @endcode
+ */
+class XMLPushParser {
+public:
+	/// Basic XMLPushParser exception.
+	struct Exception {
+		std::string message;
+		/// Constructs exception instance with given text.
+		Exception(const std::string & text) : message(text) {}
+	};
+	/// Creates parser which buffers at most max_buffer_size bytes of incomplete tag.
+	XMLPushParser(size_t max_buffer_size = 65536);
+	virtual ~XMLPushParser() {}
+	/// Parses next chunk of input.
+	void feed(const char * data, size_t size);
+	/// Reports the rest of input (trailing content and unterminated tag, if any) and resets parser.
+	void finish();
+	/// Returns count of bytes which are buffered until tag is complete.
+	size_t buffered() const { return buffer.size(); }
+protected:
+	/** Called for each complete tag.
+	 * Tag and attributes are views into internal buffer and are valid only during the call.
+	 */
+	virtual void on_tag(const StringView & tag, const std::vector<XMLAttribute> & attributes) = 0;
+	/// Called for text between tags with entities converted. By default text is ignored.
+	virtual void on_content(const std::string & /*content*/) {}
+private:
+	size_t max_size;
+	std::string buffer;
+	bool in_tag;
+	bool in_quote;
+	bool escaped;
+	size_t tag_scan;
+	void process(bool final);
+};
+
+/// Converts XML entities in text.
+std::string decode_xml_content(const StringView & text);
+
 }
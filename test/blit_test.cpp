@@ -0,0 +1,192 @@
+#include "../src/blit.h"
+#include "../src/test.h"
+using Chthon::ARGBBuffer;
+using Chthon::Pixmap;
+
+namespace {
+
+Pixmap make_pixmap(unsigned width, unsigned height, unsigned palette_size)
+{
+	Pixmap pixmap(width, height, palette_size);
+	for(unsigned i = 0; i < palette_size; ++i) {
+		pixmap.palette[i] = Chthon::from_rgb(uint8_t(i), uint8_t(i >> 8), uint8_t(i * 3));
+	}
+	unsigned i = 0;
+	for(unsigned & pixel : pixmap.pixels) {
+		pixel = (i++ * 7) % palette_size;
+	}
+	return pixmap;
+}
+
+uint32_t expected_blend(uint32_t source, uint32_t target)
+{
+	uint32_t alpha = source >> 24;
+	uint32_t result = 0;
+	for(unsigned shift = 0; shift < 32; shift += 8) {
+		uint32_t source_channel = shift == 24 ? 255 : (source >> shift) & 0xff;
+		double value = (source_channel * alpha + ((target >> shift) & 0xff) * (255 - alpha)) / 255.0;
+		result |= uint32_t(value + 0.5) << shift;
+	}
+	return result;
+}
+
+}
+
+SUITE(blit) {
+
+TEST(should_expand_pixmap_with_byte_indices)
+{
+	Pixmap pixmap = make_pixmap(37, 3, 20);
+	pixmap.pixels.cell(36, 2) = 200;
+	std::vector<uint32_t> buffer(37 * 3, 1);
+	Chthon::expand_pixmap(pixmap, ARGBBuffer(buffer.data(), 37, 3));
+	for(int y = 0; y < 3; ++y) {
+		for(int x = 0; x < 36; ++x) {
+			EQUAL(buffer[size_t(x + y * 37)], pixmap.palette[pixmap.pixels.cell(x, y)]);
+		}
+	}
+	EQUAL(buffer[36 + 2 * 37], 0u);
+}
+
+TEST(should_expand_pixmap_with_large_indices)
+{
+	Pixmap pixmap = make_pixmap(19, 2, 300);
+	pixmap.pixels.cell(3, 1) = 301;
+	pixmap.pixels.cell(4, 1) = 0x80000001;
+	std::vector<uint32_t> buffer(19 * 2, 1);
+	Chthon::expand_pixmap(pixmap, ARGBBuffer(buffer.data(), 19, 2));
+	EQUAL(buffer[18], pixmap.palette[pixmap.pixels.cell(18, 0)]);
+	EQUAL(buffer[19 + 2], pixmap.palette[pixmap.pixels.cell(2, 1)]);
+	EQUAL(buffer[19 + 3], 0u);
+	EQUAL(buffer[19 + 4], 0u);
+}
+
+TEST(should_expand_compact_pixel_map_of_any_index_size)
+{
+	Pixmap pixmap = make_pixmap(19, 2, 300);
+	Chthon::PixelMap pixels(pixmap.pixels);
+	EQUAL(pixels.index_size(), 2u);
+	pixels.cell(3, 1) = 301;
+	std::vector<uint32_t> buffer(19 * 2, 1);
+	Chthon::expand_pixmap(pixels, pixmap.palette, ARGBBuffer(buffer.data(), 19, 2));
+	EQUAL(buffer[18], pixmap.palette[pixels.cell(18, 0)]);
+	EQUAL(buffer[19 + 2], pixmap.palette[pixels.cell(2, 1)]);
+	EQUAL(buffer[19 + 3], 0u);
+
+	pixels.cell(4, 1) = 0x80000001;
+	EQUAL(pixels.index_size(), 4u);
+	Chthon::expand_pixmap(pixels, pixmap.palette, ARGBBuffer(buffer.data(), 19, 2));
+	EQUAL(buffer[17], pixmap.palette[pixels.cell(17, 0)]);
+	EQUAL(buffer[19 + 4], 0u);
+
+	Chthon::PixelMap small(pixmap.pixels);
+	for(auto && pixel : small) {
+		pixel = unsigned(pixel) % 20;
+	}
+	small.shrink_to_fit();
+	EQUAL(small.index_size(), 1u);
+	Chthon::expand_pixmap(small, pixmap.palette, ARGBBuffer(buffer.data(), 19, 2));
+	EQUAL(buffer[19 + 5], pixmap.palette[small.cell(5, 1)]);
+}
+
+TEST(should_expand_only_part_of_pixmap_which_fits_into_buffer)
+{
+	Pixmap pixmap = make_pixmap(4, 4, 5);
+	std::vector<uint32_t> buffer(3 * 5, 1);
+	Chthon::expand_pixmap(pixmap, ARGBBuffer(buffer.data(), 2, 3, 5));
+	EQUAL(buffer[0], pixmap.palette[pixmap.pixels.cell(0, 0)]);
+	EQUAL(buffer[1], pixmap.palette[pixmap.pixels.cell(1, 0)]);
+	EQUAL(buffer[2], 1u);
+	EQUAL(buffer[5 * 2 + 1], pixmap.palette[pixmap.pixels.cell(1, 2)]);
+	EQUAL(buffer[5 * 2 + 2], 1u);
+}
+
+TEST(should_skip_transparent_pixels_with_color_key)
+{
+	std::vector<uint32_t> source(37), target(37, 0xff123456);
+	for(unsigned i = 0; i < source.size(); ++i) {
+		source[i] = i % 3 == 0 ? 0x00ffffff : 0x80000000 + i;
+	}
+	Chthon::blit(ARGBBuffer(source.data(), 37, 1), ARGBBuffer(target.data(), 37, 1), 0, 0);
+	for(unsigned i = 0; i < target.size(); ++i) {
+		EQUAL(target[i], i % 3 == 0 ? 0xff123456 : 0x80000000 + i);
+	}
+}
+
+TEST(should_blend_pixels_with_alpha)
+{
+	std::vector<uint32_t> source(37), target(37);
+	for(unsigned i = 0; i < source.size(); ++i) {
+		source[i] = (uint32_t(i * 7) << 24) | (i * 0x10305);
+		target[i] = 0x80000000 | (i * 0x30507);
+	}
+	source[5] = 0xff010203;
+	source[6] = 0x00010203;
+	std::vector<uint32_t> original(target);
+	Chthon::blit(ARGBBuffer(source.data(), 37, 1), ARGBBuffer(target.data(), 37, 1), 0, 0, Chthon::BLEND_ALPHA);
+	for(unsigned i = 0; i < target.size(); ++i) {
+		EQUAL(target[i], expected_blend(source[i], original[i]));
+	}
+	EQUAL(target[5], 0xff010203);
+	EQUAL(target[6], original[6]);
+}
+
+TEST(should_blend_whole_vectors_of_opaque_and_transparent_pixels)
+{
+	std::vector<uint32_t> source(16, 0xff00ff00), target(16, 0xff0000ff);
+	std::fill(source.begin() + 8, source.end(), 0x00ff0000);
+	Chthon::blit(ARGBBuffer(source.data(), 16, 1), ARGBBuffer(target.data(), 16, 1), 0, 0, Chthon::BLEND_ALPHA);
+	EQUAL(target[0], 0xff00ff00);
+	EQUAL(target[7], 0xff00ff00);
+	EQUAL(target[8], 0xff0000ff);
+	EQUAL(target[15], 0xff0000ff);
+}
+
+TEST(should_clip_blitted_buffer)
+{
+	std::vector<uint32_t> source(3 * 3), target(4 * 4, 0);
+	for(unsigned i = 0; i < source.size(); ++i) {
+		source[i] = 0xff000000 + i;
+	}
+	ARGBBuffer target_buffer(target.data(), 4, 4);
+	Chthon::blit(ARGBBuffer(source.data(), 3, 3), target_buffer, -1, -2);
+	EQUAL(target[0], 0xff000007u);
+	EQUAL(target[1], 0xff000008u);
+	EQUAL(target[2], 0u);
+	EQUAL(target[4], 0u);
+	Chthon::blit(ARGBBuffer(source.data(), 3, 3), target_buffer, 3, 3);
+	EQUAL(target[15], 0xff000000u);
+	Chthon::blit(ARGBBuffer(source.data(), 3, 3), target_buffer, 4, 0);
+	Chthon::blit(ARGBBuffer(source.data(), 3, 3), target_buffer, 0, -3);
+	EQUAL(target[3], 0u);
+}
+
+TEST(should_make_clipped_region_of_buffer)
+{
+	std::vector<uint32_t> buffer(4 * 4, 0);
+	ARGBBuffer region = ARGBBuffer(buffer.data(), 4, 4).region(2, -1, 3, 3);
+	EQUAL(region.width, 2u);
+	EQUAL(region.height, 2u);
+	EQUAL(region.pitch, 4u);
+	ASSERT(region.pixels == buffer.data() + 2);
+	ARGBBuffer empty = ARGBBuffer(buffer.data(), 4, 4).region(5, 0, 3, 3);
+	EQUAL(empty.width, 0u);
+}
+
+TEST(should_blit_pixmap_with_transparent_color)
+{
+	Pixmap pixmap(3, 2, 2);
+	pixmap.palette[0] = 0;
+	pixmap.palette[1] = 0xffaabbcc;
+	pixmap.pixels.cell(0, 0) = 1;
+	pixmap.pixels.cell(2, 1) = 1;
+	pixmap.pixels.cell(1, 1) = 7;
+	std::vector<uint32_t> target(3 * 3, 0xff000000);
+	Chthon::blit(pixmap, ARGBBuffer(target.data(), 3, 3), -1, 1);
+	EQUAL(target[3 + 0], 0xff000000u);
+	EQUAL(target[6 + 0], 0xff000000u);
+	EQUAL(target[6 + 1], 0xffaabbccu);
+	EQUAL(target[3 + 2], 0xff000000u);
+}
+
+}
@@ -0,0 +1,129 @@
+#include "../src/compress.h"
+#include "../src/files.h"
+#include "../src/test.h"
+#include <sstream>
+using Chthon::CompressedIStream;
+using Chthon::CompressedOStream;
+
+SUITE(compress) {
+
+TEST(should_compress_repetitive_block)
+{
+	std::string data;
+	for(int i = 0; i < 100; ++i) {
+		data += "1 0 0 ";
+	}
+	std::string packed = Chthon::compress_block(data.data(), data.size());
+	ASSERT(packed.size() < data.size() / 10);
+	EQUAL(Chthon::decompress_block(packed.data(), packed.size(), data.size()), data);
+}
+
+TEST(should_compress_block_with_overlapping_match)
+{
+	std::string data = "a" + std::string(1000, 'b') + "c";
+	std::string packed = Chthon::compress_block(data.data(), data.size());
+	EQUAL(Chthon::decompress_block(packed.data(), packed.size(), data.size()), data);
+}
+
+TEST(should_compress_short_and_empty_blocks)
+{
+	std::string data = "abc";
+	std::string packed = Chthon::compress_block(data.data(), data.size());
+	EQUAL(Chthon::decompress_block(packed.data(), packed.size(), data.size()), data);
+	packed = Chthon::compress_block(data.data(), 0);
+	EQUAL(Chthon::decompress_block(packed.data(), packed.size(), 0), "");
+}
+
+TEST(should_throw_exception_when_block_is_corrupted)
+{
+	std::string packed = "\x04" "a\x05\x00";
+	CATCH(Chthon::decompress_block(packed.data(), packed.size(), 5), const Chthon::CompressionException & e) {
+		EQUAL(e.message, "Compressed block is corrupted: match is out of block.");
+	}
+}
+
+TEST(should_throw_exception_when_original_size_is_too_large_for_block)
+{
+	std::string packed = "\x10" "a";
+	CATCH(Chthon::decompress_block(packed.data(), packed.size(), 1u << 30), const Chthon::CompressionException & e) {
+		EQUAL(e.message, "Compressed block is corrupted: original size is too large.");
+	}
+}
+
+TEST(should_make_stream_bad_when_block_size_is_too_large)
+{
+	std::istringstream in(std::string("CHLZ\x05\xff\xff\xff\xff\x0f" "hello", 15));
+	CompressedIStream decompressed(in);
+	std::string s;
+	decompressed >> s;
+	ASSERT(decompressed.bad());
+}
+
+TEST(should_read_compressed_stream)
+{
+	std::ostringstream out;
+	{
+		CompressedOStream compressed(out, 1, 16);
+		compressed << "hello world, hello world, hello world";
+	}
+	std::istringstream in(out.str());
+	CompressedIStream decompressed(in);
+	std::string s;
+	std::getline(decompressed, s);
+	EQUAL(s, "hello world, hello world, hello world");
+}
+
+TEST(should_compress_blocks_in_parallel)
+{
+	std::string data;
+	for(int i = 0; i < 1000; ++i) {
+		data += "0 1 2 3 ";
+	}
+	std::ostringstream out;
+	{
+		CompressedOStream compressed(out, 4, 256);
+		compressed << data;
+	}
+	ASSERT(out.str().size() < data.size() / 4);
+	std::istringstream in(out.str());
+	CompressedIStream decompressed(in);
+	std::string s;
+	std::getline(decompressed, s);
+	EQUAL(s, data);
+}
+
+TEST(should_be_used_as_filter_for_writer_and_reader)
+{
+	std::ostringstream out;
+	{
+		CompressedOStream compressed(out);
+		Chthon::Writer writer(compressed);
+		writer.version(1, 2);
+		writer.store(42).store(std::string("hello"));
+		writer.check("test");
+	}
+	std::istringstream in(out.str());
+	CompressedIStream decompressed(in);
+	Chthon::Reader reader(decompressed);
+	int i = 0;
+	std::string s;
+	reader.version(1, 2);
+	reader.store(i).store(s);
+	reader.check("test");
+	EQUAL(i, 42);
+	EQUAL(s, "hello");
+}
+
+TEST(should_make_stream_bad_when_data_is_not_compressed)
+{
+	std::istringstream in("1 2 ");
+	CompressedIStream decompressed(in);
+	Chthon::Reader reader(decompressed);
+	int i = 0;
+	reader.store(i);
+	CATCH(reader.check("test"), const Chthon::Reader::Exception & e) {
+		EQUAL(e.message, "Error: savefile is corrupted (reading test).");
+	}
+}
+
+}
@@ -3,6 +3,8 @@
 #include "../src/format.h"
 #include "../src/test.h"
 #include <sstream>
+#include <fstream>
+#include <cstdio>
 
 SUITE(files) {
 
@@ -227,5 +229,354 @@ TEST(should_throw_exception_when_cannot_read_user_defined_type)
 	}
 }
 
+
+using Chthon::BinaryReader;
+using Chthon::BinaryWriter;
+
+TEST(binary_writer_should_write_small_values_as_single_bytes)
+{
+	std::ostringstream out;
+	{
+		BinaryWriter writer(out);
+		writer.store(1).store(-1).store(unsigned(2)).store('A').store(true);
+	}
+	EQUAL(out.str(), std::string("\x02\x01\x02\x41\x01", 5));
+}
+
+TEST(binary_writer_should_write_varint)
+{
+	std::ostringstream out;
+	BinaryWriter writer(out);
+	writer.store(unsigned(300));
+	writer.check("test");
+	EQUAL(out.str(), "\xac\x02");
+}
+
+TEST(binary_writer_should_write_length_prefixed_string)
+{
+	std::ostringstream out;
+	BinaryWriter writer(out);
+	writer.store(std::string("hello \"world\""));
+	writer.check("test");
+	EQUAL(out.str(), "\x0dhello \"world\"");
+}
+
+TEST(binary_writer_should_buffer_output_until_check)
+{
+	std::ostringstream out;
+	BinaryWriter writer(out);
+	writer.store(1);
+	EQUAL(out.str(), "");
+	writer.check("test");
+	EQUAL(out.str(), "\x02");
+}
+
+TEST(binary_reader_should_read_values_written_by_binary_writer)
+{
+	std::ostringstream out;
+	{
+		BinaryWriter writer(out);
+		writer.version(1, 2);
+		writer.store(-100000).store(unsigned(0xffffffff)).store('A').store(false);
+		writer.store(std::string(5000, 'x')).store(std::string());
+	}
+	std::istringstream in(out.str());
+	BinaryReader reader(in);
+	reader.version(1, 2);
+	int i;
+	unsigned u;
+	char ch;
+	bool b;
+	std::string long_string, empty_string = "not empty";
+	reader.store(i).store(u).store(ch).store(b).store(long_string).store(empty_string);
+	reader.check("test");
+	EQUAL(reader.version(), 2);
+	EQUAL(i, -100000);
+	EQUAL(u, 0xffffffff);
+	EQUAL(ch, 'A');
+	EQUAL(b, false);
+	EQUAL(long_string, std::string(5000, 'x'));
+	EQUAL(empty_string, "");
+}
+
+TEST(binary_reader_should_throw_exception_when_minor_version_is_less)
+{
+	std::istringstream in("\x02\x04");
+	BinaryReader reader(in);
+	CATCH(reader.version(1, 1), const BinaryReader::Exception & e) {
+		EQUAL(
+				e.message,
+				"Savefile has minor version 2, which is incompatible with current program savefile minor version 1."
+			 );
+	}
+}
+
+TEST(binary_reader_should_throw_exception_when_stream_is_truncated)
+{
+	std::istringstream in("\x05hel");
+	BinaryReader reader(in);
+	std::string s;
+	reader.store(s);
+	CATCH(reader.check("test"), const BinaryReader::Exception & e) {
+		EQUAL(e.message, "Error: savefile is corrupted (reading test).");
+	}
+}
+
+TEST(should_read_and_write_user_defined_type_in_binary_stream)
+{
+	std::ostringstream out;
+	{
+		BinaryWriter writer(out);
+		store(writer, UserNamespace::UserDefinedType(1, 'A'));
+	}
+	std::istringstream in(out.str());
+	BinaryReader reader(in);
+	UserNamespace::UserDefinedType value;
+	store(reader, value, "user defined type");
+	EQUAL(value.i, 1);
+	EQUAL(value.ch, 'A');
+}
+
+TEST(binary_writer_should_write_vector_of_ints_as_raw_block)
+{
+	std::ostringstream out;
+	BinaryWriter writer(out);
+	std::vector<int> values(2, 1);
+	store(writer, values);
+	writer.check("test");
+	std::string expected = std::string("\x02", 1) + Chthon::native_byte_order() + '\x04';
+	expected += std::string(reinterpret_cast<const char *>(values.data()), 2 * sizeof(int));
+	EQUAL(out.str(), expected);
+}
+
+TEST(writer_should_write_vector_element_by_element)
+{
+	std::ostringstream out;
+	Writer writer(out);
+	std::vector<int> values(2, 1);
+	store(writer, values);
+	EQUAL(out.str(), "2 1 1 ");
+}
+
+TEST(binary_reader_should_read_map_written_as_raw_block)
+{
+	Chthon::Map<unsigned> map(3, 2);
+	map.cell(2, 1) = 0xdeadbeef;
+	std::ostringstream out;
+	{
+		BinaryWriter writer(out);
+		store(writer, static_cast<const Chthon::Map<unsigned> &>(map));
+	}
+	std::istringstream in(out.str());
+	BinaryReader reader(in);
+	Chthon::Map<unsigned> restored;
+	store(reader, restored, "map");
+	EQUAL(restored.width(), 3u);
+	EQUAL(restored.height(), 2u);
+	EQUAL(restored.cell(2, 1), 0xdeadbeef);
+	EQUAL(restored.cell(0, 0), 0u);
+}
+
+TEST(binary_reader_should_swap_bytes_of_block_with_other_byte_order)
+{
+	char other_byte_order = Chthon::native_byte_order() == 1 ? 2 : 1;
+	std::istringstream in(std::string("\x01", 1) + other_byte_order + std::string("\x02\x01\x02", 3));
+	BinaryReader reader(in);
+	std::vector<uint16_t> values;
+	store(reader, values, "vector");
+	EQUAL(values.size(), 1u);
+	uint16_t expected = 0x0102;
+	EQUAL(values[0], expected);
+}
+
+TEST(binary_reader_should_throw_exception_when_element_size_differs)
+{
+	std::istringstream in(std::string("\x01", 1) + Chthon::native_byte_order() + std::string("\x08", 1));
+	BinaryReader reader(in);
+	std::vector<int> values;
+	CATCH(store(reader, values), const BinaryReader::Exception & e) {
+		EQUAL(
+				e.message,
+				"Savefile has block of elements with size 8, which is incompatible with element size 4."
+			 );
+	}
+}
+
+TEST(binary_reader_should_throw_exception_when_vector_size_is_corrupted)
+{
+	std::istringstream in(std::string("\xff\xff\xff\xff\x0f", 5) + Chthon::native_byte_order() + std::string("\x04\x01\x02\x03\x04", 5));
+	BinaryReader reader(in);
+	std::vector<int> values;
+	CATCH(store(reader, values), const BinaryReader::Exception & e) {
+		EQUAL(e.message, "Error: savefile is corrupted (reading block).");
+	}
+}
+
+TEST(binary_reader_should_throw_exception_when_map_size_is_too_large)
+{
+	std::istringstream in(std::string("\x80\x80\x04\x80\x80\x04", 6));
+	BinaryReader reader(in);
+	Chthon::Map<unsigned> map;
+	CATCH(store(reader, map), const BinaryReader::Exception & e) {
+		EQUAL(e.message, "Savefile has map of too large size 65536x65536.");
+	}
+}
+
+TEST(binary_reader_should_read_vector_of_complex_types_element_by_element)
+{
+	std::vector<std::string> values;
+	values.push_back("hello");
+	values.push_back("world");
+	std::ostringstream out;
+	{
+		BinaryWriter writer(out);
+		store(writer, static_cast<const std::vector<std::string> &>(values));
+	}
+	std::istringstream in(out.str());
+	BinaryReader reader(in);
+	std::vector<std::string> restored;
+	store(reader, restored, "vector");
+	EQUAL(restored.size(), 2u);
+	EQUAL(restored[0], "hello");
+	EQUAL(restored[1], "world");
+}
+
+using Chthon::MappedReader;
+
+TEST(mapped_reader_should_read_values_written_by_binary_writer)
+{
+	std::ostringstream out;
+	{
+		BinaryWriter writer(out);
+		writer.version(1, 2);
+		writer.store(-100000).store(unsigned(300)).store('A').store(true).store(std::string("hello"));
+		store(writer, std::vector<int>(3, 7));
+	}
+	std::string buffer = out.str();
+	MappedReader reader(buffer.data(), buffer.size());
+	reader.version(1, 2);
+	int i;
+	unsigned u;
+	char ch;
+	bool b;
+	std::string s;
+	std::vector<int> values;
+	reader.store(i).store(u).store(ch).store(b).store(s);
+	store(reader, values);
+	reader.check("test");
+	EQUAL(i, -100000);
+	EQUAL(u, 300u);
+	EQUAL(ch, 'A');
+	EQUAL(b, true);
+	EQUAL(s, "hello");
+	EQUAL(values.size(), 3u);
+	EQUAL(values[2], 7);
+	EQUAL(reader.position(), buffer.size());
+}
+
+TEST(mapped_reader_should_return_string_view_into_buffer)
+{
+	std::string buffer = "\x05hello";
+	MappedReader reader(buffer.data(), buffer.size());
+	Chthon::StringView view;
+	store(reader, view, "string");
+	EQUAL(view, Chthon::StringView("hello"));
+	EQUAL(view.data(), buffer.data() + 1);
+}
+
+TEST(mapped_reader_should_throw_exception_when_buffer_is_truncated)
+{
+	std::string buffer = "\x05hel";
+	MappedReader reader(buffer.data(), buffer.size());
+	std::string s;
+	reader.store(s);
+	CATCH(reader.check("test"), const MappedReader::Exception & e) {
+		EQUAL(e.message, "Error: savefile is corrupted (reading test).");
+	}
+}
+
+TEST(mapped_reader_should_read_mapped_file)
+{
+	const char * filename = "chthon_test_mapped.tmp";
+	{
+		std::ofstream out(filename, std::ios::binary);
+		BinaryWriter writer(out);
+		writer.version(1, 0);
+		store(writer, UserNamespace::UserDefinedType(1, 'A'));
+	}
+	UserNamespace::UserDefinedType value;
+	{
+		MappedReader reader(filename);
+		reader.version(1, 0);
+		store(reader, value, "user defined type");
+	}
+	std::remove(filename);
+	EQUAL(value.i, 1);
+	EQUAL(value.ch, 'A');
+}
+
+TEST(mapped_reader_should_throw_exception_when_file_cannot_be_mapped)
+{
+	CATCH(MappedReader("chthon_test_missing.tmp"), const MappedReader::Exception & e) {
+		EQUAL(e.message, "Error: cannot open savefile \"chthon_test_missing.tmp\".");
+	}
 }
 
+using Chthon::IndexedReader;
+using Chthon::IndexedWriter;
+
+TEST(indexed_reader_should_read_any_section)
+{
+	std::ostringstream out;
+	IndexedWriter writer(out);
+	writer.section("first").store(1).store(std::string("hello"));
+	writer.section("second").store(2);
+	writer.add_section("third", Chthon::StringView("\x06"));
+	writer.finish();
+	std::string buffer = out.str();
+
+	IndexedReader reader(buffer.data(), buffer.size());
+	EQUAL(reader.section_names().size(), 3u);
+	ASSERT(reader.has_section("second"));
+	ASSERT(!reader.has_section("fourth"));
+	int value = 0;
+	reader.section("third").store(value).check("third");
+	EQUAL(value, 3);
+	MappedReader first = reader.section("first");
+	std::string s;
+	first.store(value).store(s).check("first");
+	EQUAL(value, 1);
+	EQUAL(s, "hello");
+	reader.section("second").store(value).check("second");
+	EQUAL(value, 2);
+}
+
+TEST(indexed_reader_should_throw_exception_when_section_is_missing)
+{
+	std::ostringstream out;
+	IndexedWriter writer(out);
+	writer.finish();
+	std::string buffer = out.str();
+	IndexedReader reader(buffer.data(), buffer.size());
+	CATCH(reader.section("level 1"), const IndexedReader::Exception & e) {
+		EQUAL(e.message, "Error: savefile has no section \"level 1\".");
+	}
+}
+
+TEST(indexed_reader_should_throw_exception_when_savefile_is_not_indexed)
+{
+	std::string buffer = "1 2 ";
+	CATCH(IndexedReader(buffer.data(), buffer.size()), const IndexedReader::Exception & e) {
+		EQUAL(e.message, "Error: savefile is not an indexed savefile.");
+	}
+}
+
+TEST(indexed_reader_should_throw_exception_when_section_is_out_of_file)
+{
+	std::string buffer = std::string("CHSI\x01\x01x\x00\x05", 9);
+	CATCH(IndexedReader(buffer.data(), buffer.size()), const IndexedReader::Exception & e) {
+		EQUAL(e.message, "Error: savefile is corrupted (reading section \"x\").");
+	}
+}
+
+}
@@ -1,6 +1,7 @@
 #include "mocks.h"
 #include "../src/game.h"
 #include "../src/monsters.h"
+#include "../src/actions.h"
 #include "../src/cell.h"
 #include "../src/format.h"
 #include "../src/test.h"
@@ -11,6 +12,8 @@ SUITE(game) {
 using GameMocks::GameWithDummyOnTrap;
 using GameMocks::GameWithDummy;
 using GameMocks::GameWithDummyAndKiller;
+using GameMocks::GameWithStairs;
+using GameMocks::StairsDungeon;
 
 TEST_FIXTURE(GameWithDummyOnTrap, should_trigger_trap_if_trap_is_set)
 {
@@ -58,6 +61,15 @@ TEST_FIXTURE(GameWithDummy, should_hurt_monster_if_cell_hurts)
 	} DONE(e);
 }
 
+TEST_FIXTURE(GameWithDummy, should_process_environment_when_controller_suspends_game)
+{
+	game.add_cell_type("floor").hurts(true);
+	game.controller_factory.add_controller(game.monster_type("dummy")->ai, new GameMocks::ScriptedController(std::vector<Chthon::Point>()));
+	game.run();
+	EQUAL(game.state, Chthon::Game::SUSPENDED);
+	EQUAL(dummy().hp, 99);
+}
+
 TEST_FIXTURE(GameWithDummy, should_hurt_monster_is_poisoned)
 {
 	dummy().poisoning = 10;
@@ -203,4 +215,90 @@ TEST_FIXTURE(GameWithDummyAndKiller, should_die_if_hit_was_too_much)
 	} DONE(e);
 }
 
+TEST_FIXTURE(GameWithStairs, should_share_types_and_levels_with_fork)
+{
+	game.go_to_level(1);
+	StairsDungeon fork = game.fork<StairsDungeon>();
+	const StairsDungeon & const_fork = fork;
+	EQUAL(&fork.type_source(), &game);
+	ASSERT(fork.cell_types.empty());
+	EQUAL(fork.levels.count(1), 0u);
+	EQUAL(&const_fork.current_level(), &game.levels[1]);
+	EQUAL(fork.cell_type("floor"), game.cell_type("floor"));
+}
+
+TEST_FIXTURE(GameWithStairs, should_copy_level_when_fork_changes_it)
+{
+	game.go_to_level(1);
+	StairsDungeon fork = game.fork<StairsDungeon>();
+	int hp = game.current_level().monsters[1].hp;
+	fork.current_level().monsters[1].hp = hp + 1;
+	EQUAL(fork.levels.count(1), 1u);
+	EQUAL(game.current_level().monsters[1].hp, hp);
+	EQUAL(fork.current_level().monsters[1].hp, hp + 1);
+}
+
+TEST_FIXTURE(GameWithStairs, should_not_change_original_when_fork_goes_to_other_level)
+{
+	game.go_to_level(1);
+	StairsDungeon fork = game.fork<StairsDungeon>();
+	fork.go_to_level(2);
+	EQUAL(fork.current_level_index, 2);
+	EQUAL(game.current_level_index, 1);
+	ASSERT(!game.has_level(2));
+	ASSERT(game.current_level().get_player().valid());
+}
+
+TEST_FIXTURE(GameWithStairs, should_see_levels_changed_by_fork_in_fork_of_fork)
+{
+	game.go_to_level(1);
+	StairsDungeon fork = game.fork<StairsDungeon>();
+	fork.current_level().monsters[1].hp = 7;
+	StairsDungeon fork_of_fork = fork.fork<StairsDungeon>();
+	const StairsDungeon & const_fork_of_fork = fork_of_fork;
+	EQUAL(&fork_of_fork.type_source(), &game);
+	EQUAL(const_fork_of_fork.current_level().monsters[1].hp, 7);
+	EQUAL(&const_fork_of_fork.current_level(), &fork.levels[1]);
+}
+
+TEST_FIXTURE(GameWithStairs, should_copy_levels_and_types_when_game_is_copied)
+{
+	game.go_to_level(1);
+	StairsDungeon copy(game);
+	EQUAL(copy.levels.size(), game.levels.size());
+	ASSERT(&copy.levels[1] != &game.levels[1]);
+	EQUAL(copy.cell_types.size(), game.cell_types.size());
+	EQUAL(&copy.type_source(), &copy);
+	copy.current_level().monsters[1].hp = 7;
+	ASSERT(game.current_level().monsters[1].hp != 7);
+
+	other_game = game;
+	EQUAL(other_game.current_level_index, 1);
+	EQUAL(other_game.levels.size(), game.levels.size());
+	ASSERT(other_game.current_level().get_player().valid());
+}
+
+TEST_FIXTURE(GameWithStairs, should_keep_levels_of_original_game_in_place_when_forked)
+{
+	game.go_to_level(1);
+	Chthon::Level & level = game.current_level();
+	{
+		StairsDungeon fork = game.fork<StairsDungeon>();
+		game.current_level().monsters[1].hp = 5;
+	}
+	EQUAL(&game.current_level(), &level);
+	EQUAL(level.monsters[1].hp, 5);
+}
+
+TEST_FIXTURE(GameWithStairs, should_copy_plan_actions_with_monster)
+{
+	game.go_to_level(1);
+	game.current_level().monsters[1].add_path(std::list<Chthon::Point>(1, Chthon::Point(1, 0)));
+	StairsDungeon fork = game.fork<StairsDungeon>();
+	Chthon::Monster & monster = fork.current_level().monsters[1];
+	EQUAL(monster.plan.size(), 1u);
+	ASSERT(monster.plan.front() != game.current_level().monsters[1].plan.front());
+	EQUAL(dynamic_cast<Chthon::Move*>(monster.plan.front())->shift, Chthon::Point(1, 0));
+}
+
 }
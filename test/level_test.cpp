@@ -6,6 +6,24 @@ using Chthon::Point;
 
 SUITE(dungeon) {
 using GameMocks::GameWithLevels;
+using GameMocks::GameWithStairs;
+using GameMocks::GameWithLevelCache;
+using GameMocks::StairsDungeon;
+
+TEST(should_pick_random_positions_and_shuffle_rooms_with_thread_generator_by_default)
+{
+	std::pair<Point, Point> room(Point(1, 1), Point(3, 3));
+	Chthon::thread_random() = Chthon::Random(5);
+	std::vector<Point> positions = Chthon::DungeonBuilder::random_positions(room, 4);
+	Chthon::Random generator(5);
+	std::vector<Point> expected = Chthon::DungeonBuilder::random_positions(room, 4, generator);
+	EQUAL(positions.size(), 4u);
+	for(size_t i = 0; i < positions.size(); ++i) {
+		EQUAL(positions[i], expected[i]);
+	}
+	std::vector<std::pair<Point, Point> > rooms(9, room);
+	EQUAL(Chthon::DungeonBuilder::shuffle_rooms(rooms).size(), 9u);
+}
 
 TEST_FIXTURE(GameWithLevels, should_save_current_level_as_visited)
 {
@@ -37,6 +55,131 @@ TEST_FIXTURE(GameWithLevels, should_generated_newly_visited_level)
 	EQUAL(game.current_level().get_player().type->sprite, 1);
 }
 
+TEST_FIXTURE(GameWithStairs, should_not_pregenerate_levels_by_default)
+{
+	game.go_to_level(1);
+	ASSERT(!game.has_level(2));
+}
+
+TEST_FIXTURE(GameWithStairs, should_pregenerate_levels_reachable_by_stairs)
+{
+	game.pregenerate_levels = true;
+	game.go_to_level(1);
+	ASSERT(game.has_level(2));
+	ASSERT(!game.has_level(3));
+	game.wait_for_pregeneration();
+	EQUAL(game.levels.count(2), 1u);
+}
+
+TEST_FIXTURE(GameWithStairs, should_pregenerate_same_level_as_synchronous_generation)
+{
+	game.pregenerate_levels = true;
+	game.go_to_level(1);
+	game.go_to_level(2);
+	other_game.go_to_level(1);
+	other_game.go_to_level(2);
+	const Chthon::Level & level = game.current_level();
+	const Chthon::Level & other_level = other_game.current_level();
+	EQUAL(level.monsters.size(), other_level.monsters.size());
+	for(size_t i = 0; i < level.monsters.size(); ++i) {
+		EQUAL(level.monsters[i].pos, other_level.monsters[i].pos);
+	}
+	EQUAL(level.objects.front().pos, other_level.objects.front().pos);
+	ASSERT(game.has_level(3));
+}
+
+TEST_FIXTURE(GameWithStairs, should_pregenerate_levels_while_running_with_seed_of_run_start)
+{
+	game.pregenerate_levels = true;
+	game.controller_factory.add_controller(0, new GameMocks::ScriptedController(std::vector<Chthon::Point>()));
+	game.go_to_level(1);
+	game.run();
+	game.random = Chthon::Random(7);
+	game.wait_for_pregeneration();
+	other_game.go_to_level(1);
+	other_game.go_to_level(2);
+	const Chthon::Level & level = game.levels[2];
+	const Chthon::Level & other_level = other_game.current_level();
+	EQUAL(level.monsters.size(), other_level.monsters.size());
+	for(size_t i = 0; i < level.monsters.size(); ++i) {
+		EQUAL(level.monsters[i].pos, other_level.monsters[i].pos);
+	}
+}
+
+TEST_FIXTURE(GameWithLevelCache, should_evict_least_recently_visited_level)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.go_to_level(3);
+	EQUAL(game.levels.size(), 2u);
+	ASSERT(game.is_evicted(1));
+	ASSERT(game.has_level(1));
+}
+
+TEST_FIXTURE(GameWithLevelCache, should_reload_evicted_level_when_visited)
+{
+	game.go_to_level(1);
+	game.current_level().monsters.back().hp = 0;
+	Point rat_pos = game.current_level().monsters.back().pos;
+	game.go_to_level(2);
+	game.go_to_level(3);
+	game.go_to_level(1);
+	ASSERT(!game.is_evicted(1));
+	EQUAL(game.current_level().monsters.back().hp, 0);
+	EQUAL(game.current_level().monsters.back().pos, rat_pos);
+	ASSERT(game.is_evicted(2));
+}
+
+TEST_FIXTURE(GameWithLevelCache, should_not_evict_recently_visited_levels)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.go_to_level(1);
+	game.go_to_level(3);
+	ASSERT(game.is_evicted(2));
+	ASSERT(!game.is_evicted(1));
+}
+
+TEST_FIXTURE(GameWithLevelCache, should_reuse_scratch_space_of_reloaded_levels)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.go_to_level(3);
+	game.go_to_level(1);
+	size_t scratch_size = scratch_file_size();
+	for(int i = 0; i < 5; ++i) {
+		game.go_to_level(2);
+		game.go_to_level(3);
+		game.go_to_level(1);
+	}
+	EQUAL(scratch_file_size(), scratch_size);
+	ASSERT(game.is_evicted(2));
+	ASSERT(game.current_level().get_player().valid());
+}
+
+TEST_FIXTURE(GameWithLevelCache, should_not_reuse_scratch_space_shared_with_fork)
+{
+	game.go_to_level(1);
+	game.current_level().monsters.back().hp = 5;
+	game.go_to_level(2);
+	game.go_to_level(3);
+	StairsDungeon fork = game.fork<StairsDungeon>();
+	game.go_to_level(1);
+	fork.go_to_level(1);
+	EQUAL(fork.current_level().monsters.back().hp, 5);
+}
+
+TEST_FIXTURE(GameWithLevelCache, should_reload_all_levels_when_cache_is_disabled)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.go_to_level(3);
+	game.set_level_cache(0, "");
+	EQUAL(game.levels.count(1), 1u);
+	EQUAL(game.levels.count(2), 1u);
+	ASSERT(!game.is_evicted(1));
+}
+
 }
 
 SUITE(level) {
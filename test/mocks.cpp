@@ -1,11 +1,15 @@
 #include "mocks.h"
+#include "../src/actions.h"
 #include "../src/log.h"
+#include <cstdio>
+#include <fstream>
 using Chthon::Level;
 using Chthon::Point;
 using Chthon::Monster;
 using Chthon::Map;
 using Chthon::Cell;
 using Chthon::Item;
+using Chthon::Game;
 
 namespace GameMocks {
 
@@ -32,6 +36,70 @@ void TestDungeon::generate(Level & level, int level_index)
 	}
 }
 
+ScriptedController::ScriptedController(const std::vector<Point> & script_moves)
+	: moves(script_moves), position(0)
+{
+}
+Chthon::Action * ScriptedController::act(Monster &, Game & game)
+{
+	if(position >= moves.size()) {
+		game.state = Game::SUSPENDED;
+		return nullptr;
+	}
+	return new Chthon::Move(moves[position++]);
+}
+
+SavingController::SavingController(const std::string & save_filename)
+	: filename(save_filename)
+{
+}
+Chthon::Action * SavingController::act(Monster & monster, Game & game)
+{
+	game.save_in_background(filename);
+	monster.hp = 5;
+	game.state = Game::SUSPENDED;
+	return nullptr;
+}
+
+RandomDungeon::RandomDungeon()
+{
+	add_cell_type("floor").passable(true).transparent(true);
+	add_cell_type("wall");
+	add_monster_type("player").max_hp(100).faction(Monster::PLAYER).sight(10).ai(PLAYER_AI);
+	add_monster_type("rat").max_hp(3).faction(Monster::MONSTER).sight(3).ai(RANDOM_AI);
+}
+RandomDungeon::~RandomDungeon() {}
+void RandomDungeon::generate(Level & level, int level_index)
+{
+	Chthon::Random generator = level_random(level_index);
+	level = Level(8, 8);
+	Chthon::DungeonBuilder::fill_room(level.map, std::make_pair(Point(0, 0), Point(7, 7)), cell_type("wall"));
+	Chthon::DungeonBuilder::fill_room(level.map, std::make_pair(Point(1, 1), Point(6, 6)), cell_type("floor"));
+	std::vector<Point> positions = Chthon::DungeonBuilder::random_positions(std::make_pair(Point(1, 1), Point(6, 6)), 5, generator);
+	add_monster(level, "player").pos(positions[0]);
+	for(size_t i = 1; i < positions.size(); ++i) {
+		add_monster(level, "rat").pos(positions[i]);
+	}
+}
+
+StairsDungeon::StairsDungeon()
+{
+	add_cell_type("floor").passable(true).transparent(true);
+	add_monster_type("player").faction(Monster::PLAYER);
+	add_monster_type("rat");
+	add_object_type("stairs").transporting();
+}
+void StairsDungeon::generate(Level & level, int level_index)
+{
+	Chthon::Random generator = level_random(level_index);
+	level = Level(4, 4);
+	std::fill(level.map.begin(), level.map.end(), Cell(cell_type("floor")));
+	std::vector<Point> positions = Chthon::DungeonBuilder::random_positions(std::make_pair(Point(0, 0), Point(3, 3)), 3, generator);
+	add_monster(level, "player").pos(positions[0]);
+	add_monster(level, "rat").pos(positions[1]);
+	add_object(level, "stairs").pos(positions[2]).up_destination(level_index - 1).down_destination(level_index + 1);
+}
+
 
 GameWithDummyWieldingAndWearing::GameWithDummyWieldingAndWearing()
 	: game()
@@ -185,6 +253,36 @@ Game2x2::Game2x2()
 	std::fill(map.begin(), map.end(), Cell(game.cell_type("floor")));
 }
 
+GameWithStairs::GameWithStairs()
+{
+	game.random = Chthon::Random(42);
+	other_game.random = Chthon::Random(42);
+}
+
+GameWithLevelCache::GameWithLevelCache()
+{
+	game.set_level_cache(2, "chthon_test_levels.tmp");
+}
+GameWithLevelCache::~GameWithLevelCache()
+{
+	game.set_level_cache(0, "");
+	std::remove("chthon_test_levels.tmp");
+}
+size_t GameWithLevelCache::scratch_file_size() const
+{
+	std::ifstream file("chthon_test_levels.tmp", std::ios::binary | std::ios::ate);
+	return size_t(file.tellg());
+}
+
+GameWithSavefile::GameWithSavefile()
+	: filename("chthon_test_game.sav")
+{
+}
+GameWithSavefile::~GameWithSavefile()
+{
+	std::remove(filename.c_str());
+}
+
 LevelWithPath::LevelWithPath()
 	: game()
 {
@@ -203,6 +301,14 @@ LevelWithPath::LevelWithPath()
 	std::copy(a, a + size_of_array(a), map.begin());
 }
 
+GameWithReplay::GameWithReplay()
+{
+	std::vector<Point> moves;
+	moves << Point(1, 0) << Point(0, 1) << Point(-1, 0) << Point(0, -1) << Point(1, 1) << Point(-1, -1);
+	game.controller_factory.add_controller(RandomDungeon::PLAYER_AI, new ScriptedController(moves));
+	game.controller_factory.add_controller(RandomDungeon::RANDOM_AI, (new Chthon::BasicAI())->add(Chthon::BasicAI::MOVE_RANDOM));
+}
+
 LevelForSeeing::LevelForSeeing()
 	: game()
 {
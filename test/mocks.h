@@ -25,6 +25,38 @@ private:
 };
 
 
+class ScriptedController : public Chthon::Controller {
+public:
+	ScriptedController(const std::vector<Chthon::Point> & script_moves);
+	virtual Chthon::Action * act(Chthon::Monster &, Chthon::Game & game);
+private:
+	std::vector<Chthon::Point> moves;
+	size_t position;
+};
+
+/// Starts background save, then changes acting monster and suspends game.
+class SavingController : public Chthon::Controller {
+public:
+	SavingController(const std::string & save_filename);
+	virtual Chthon::Action * act(Chthon::Monster & monster, Chthon::Game & game);
+private:
+	std::string filename;
+};
+
+struct RandomDungeon : public Chthon::Game {
+	enum { PLAYER_AI = 1, RANDOM_AI };
+	RandomDungeon();
+	virtual ~RandomDungeon();
+	virtual void generate(Chthon::Level & level, int level_index);
+};
+
+struct StairsDungeon : public Chthon::Game {
+	StairsDungeon();
+	StairsDungeon(const StairsDungeon & other, ForkTag tag) : Chthon::Game(other, tag) {}
+	virtual void generate(Chthon::Level & level, int level_index);
+};
+
+
 struct GameWithDummyWieldingAndWearing {
 	DummyDungeon game;
 	GameWithDummyWieldingAndWearing();
@@ -88,11 +120,35 @@ struct GameWithLevels {
 	GameWithLevels(): game(Chthon::Point(1, 1), Chthon::Point(2, 2)) {}
 };
 
+struct GameWithStairs {
+	StairsDungeon game;
+	StairsDungeon other_game;
+	GameWithStairs();
+};
+
+struct GameWithLevelCache : public GameWithStairs {
+	GameWithLevelCache();
+	~GameWithLevelCache();
+	size_t scratch_file_size() const;
+};
+
+struct GameWithSavefile : public GameWithStairs {
+	std::string filename;
+	GameWithSavefile();
+	~GameWithSavefile();
+};
+
 struct LevelWithPath {
 	DummyDungeon game;
 	LevelWithPath();
 };
 
+struct GameWithReplay {
+	RandomDungeon game;
+	RandomDungeon other_game;
+	GameWithReplay();
+};
+
 struct LevelForSeeing {
 	DummyDungeon game;
 	LevelForSeeing();
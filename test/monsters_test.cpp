@@ -1,8 +1,35 @@
 #include "../src/monsters.h"
+#include "../src/actions.h"
 #include "../src/test.h"
 
+namespace {
+
+class Shout : public Chthon::Action {
+public:
+	std::string text;
+	Shout(const std::string & shout_text) : text(shout_text) {}
+	virtual void commit(Chthon::Monster &, Chthon::Game &) {}
+	virtual Action * clone() const { return new Shout(*this); }
+};
+
+}
+
 SUITE(monsters) {
 
+TEST(should_copy_user_defined_actions_of_plan)
+{
+	Chthon::Monster monster;
+	monster.plan.push_back(new Shout("hey"));
+	Chthon::Monster copy(monster);
+	Chthon::Monster assigned;
+	assigned = monster;
+	EQUAL(copy.plan.size(), 1u);
+	ASSERT(copy.plan.front() != monster.plan.front());
+	EQUAL(dynamic_cast<Shout*>(copy.plan.front())->text, "hey");
+	EQUAL(assigned.plan.size(), 1u);
+	EQUAL(dynamic_cast<Shout*>(assigned.plan.front())->text, "hey");
+}
+
 TEST(monster_with_nonzero_hp_should_be_alive)
 {
 	Chthon::Monster monster;
@@ -3,6 +3,9 @@
 #include "../src/test.h"
 #include <sstream>
 #include <iomanip>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
 
 SUITE(pixmap) {
 using Chthon::Pixmap;
@@ -98,6 +101,64 @@ TEST(should_load_pixmap_from_text_lines)
 	EQUAL(pixmap.pixels.cell(2, 1), 0u);
 }
 
+TEST(should_load_pixmap_with_two_chars_per_pixel)
+{
+	static const char * xpm[] = {
+	"2 2 3 2",
+	".. c #ff0000",
+	".# c #00ff00",
+	"#. c #0000ff",
+	"...#",
+	"#...",
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	pixmap.load(xpm_lines);
+	EQUAL(pixmap.pixels.cell(0, 0), 0u);
+	EQUAL(pixmap.pixels.cell(1, 0), 1u);
+	EQUAL(pixmap.pixels.cell(0, 1), 2u);
+	EQUAL(pixmap.pixels.cell(1, 1), 0u);
+}
+
+TEST(should_load_pixmap_with_wide_pixel_codes)
+{
+	static const char * xpm[] = {
+	"2 1 2 3",
+	"abc c #ff0000",
+	"abd c #00ff00",
+	"abdabc",
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	pixmap.load(xpm_lines);
+	EQUAL(pixmap.pixels.cell(0, 0), 1u);
+	EQUAL(pixmap.pixels.cell(1, 0), 0u);
+
+	static const char * wide_xpm[] = {
+	"2 1 2 9",
+	"123456789 c #ff0000",
+	"123456780 c #00ff00",
+	"123456789123456780",
+	};
+	std::vector<std::string> wide_xpm_lines(wide_xpm, wide_xpm + size_of_array(wide_xpm));
+	pixmap.load(wide_xpm_lines);
+	EQUAL(pixmap.pixels.cell(0, 0), 0u);
+	EQUAL(pixmap.pixels.cell(1, 0), 1u);
+}
+
+TEST(should_load_pixmap_with_non_ascii_pixel_codes)
+{
+	std::vector<std::string> xpm_lines;
+	xpm_lines.push_back("2 1 2 1");
+	xpm_lines.push_back("\xff c #ff0000");
+	xpm_lines.push_back("\x80 c #00ff00");
+	xpm_lines.push_back("\x80\xff");
+	Pixmap pixmap;
+	pixmap.load(xpm_lines);
+	EQUAL(pixmap.pixels.cell(0, 0), 1u);
+	EQUAL(pixmap.pixels.cell(1, 0), 0u);
+}
+
 TEST(should_recognize_none_color)
 {
 	static const char * xpm[] = {
@@ -146,6 +207,40 @@ TEST(should_recognize_x11_color_names_with_spaces)
 	EQUAL(pixmap.palette[0], 0xff90ee90);
 }
 
+TEST(should_recognize_x11_color_names_from_the_whole_table)
+{
+	static const char * xpm[] = {
+	"4 1 4 1",
+	"a c AliceBlue",
+	"b c yellow green",
+	"c c YellowGreen",
+	"d c gray100",
+	"abcd",
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	pixmap.load(xpm_lines);
+	EQUAL(pixmap.palette.size(), 4u);
+	EQUAL(pixmap.palette[0], 0xfff0f8ff);
+	EQUAL(pixmap.palette[1], 0xff9acd32);
+	EQUAL(pixmap.palette[2], 0xff9acd32);
+	EQUAL(pixmap.palette[3], 0xffffffff);
+}
+
+TEST(should_match_x11_color_names_exactly)
+{
+	static const char * xpm[] = {
+	"1 1 1 1",
+	"a c Light green",
+	"a",
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	CATCH(pixmap.load(xpm_lines), const Pixmap::Exception & e) {
+		EQUAL(e.what, "Color value <Light green> is invalid.");
+	}
+}
+
 TEST(should_load_pixmap_from_xpm_file)
 {
 	static const char * xpm_data = 
@@ -209,6 +304,35 @@ TEST(should_throw_exception_when_pixel_lines_are_missing_or_not_enough_in_xpm)
 	}
 }
 
+TEST(should_throw_exception_when_pixmap_size_is_too_large_in_xpm)
+{
+	static const char * xpm[] = {
+	"4000000000 4000000000 1 1",
+	"# c #00ff00",
+	"#"
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	CATCH(pixmap.load(xpm_lines), const Pixmap::Exception & e) {
+		EQUAL(e.what, "Pixmap size 4000000000x4000000000 is too large.");
+	}
+}
+
+TEST(should_check_pixel_rows_before_allocating_pixmap)
+{
+	static const char * xpm[] = {
+	"60000 60000 1 1",
+	"# c #00ff00",
+	"#"
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	CATCH(pixmap.load(xpm_lines), const Pixmap::Exception & e) {
+		EQUAL(e.what, "Pixel row is too small.");
+	}
+	EQUAL(pixmap.pixels.width(), 1u);
+}
+
 TEST(should_throw_exception_when_value_count_is_not_four_in_xpm)
 {
 	static const char * xpm[] = {
@@ -377,6 +501,35 @@ TEST(shoudl_throw_exception_when_pixel_is_broken_in_xpm)
 	}
 }
 
+TEST(should_throw_exception_when_wide_pixel_is_invalid_in_xpm)
+{
+	static const char * xpm[] = {
+	"2 1 1 3",
+	"abc c #ff0000",
+	"abcabd",
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	CATCH(pixmap.load(xpm_lines), const Pixmap::Exception & e) {
+		EQUAL(e.what, "Pixel value is invalid.");
+	}
+}
+
+TEST(should_throw_exception_when_wide_colours_are_repeated_in_xpm)
+{
+	static const char * xpm[] = {
+	"1 1 2 3",
+	"abc c #ff0000",
+	"abc c #00ff00",
+	"abc",
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + size_of_array(xpm));
+	Pixmap pixmap;
+	CATCH(pixmap.load(xpm_lines), const Pixmap::Exception & e) {
+		EQUAL(e.what, "Color <abc> was found more than once.");
+	}
+}
+
 TEST(shoudl_throw_exception_when_pixel_is_invalid_in_xpm)
 {
 	static const char * xpm[] = {
@@ -657,5 +810,229 @@ TEST(should_remove_text_constants_when_height_is_decreased_when_saving_xpm)
 	EQUAL(save_data, std::string(xpm_result));
 }
 
+TEST(should_load_batch_of_pixmaps_reporting_errors_per_file)
+{
+	std::vector<std::string> filenames;
+	for(int i = 0; i < 5; ++i) {
+		filenames.push_back(Chthon::format("chthon_test_pixmap_{0}.tmp", i));
+	}
+	{
+		std::ofstream(filenames[0].c_str()) << "\"2 1 2 1\",\"  c None\",\"# c #ff0000\",\" #\"";
+		std::ofstream(filenames[1].c_str()) << "\"1 1 1 1\",\"# c bad\",\"#\"";
+		std::ofstream(filenames[3].c_str()) << "\"1 2 1 1\",\"# c #00ff00\",\"#\",\"#\"";
+		std::ofstream(filenames[4].c_str()) << "\"65536 65536 1 1\",\"# c #00ff00\",\"#\"";
+	}
+	std::vector<Chthon::PixmapLoadResult> results = Chthon::load_pixmaps(filenames, 2);
+	std::remove(filenames[0].c_str());
+	std::remove(filenames[1].c_str());
+	std::remove(filenames[3].c_str());
+	std::remove(filenames[4].c_str());
+	EQUAL(results.size(), 5u);
+	ASSERT(results[0].ok());
+	EQUAL(results[0].filename, filenames[0]);
+	EQUAL(results[0].pixmap.pixels.width(), 2u);
+	EQUAL(results[0].pixmap.palette[results[0].pixmap.pixels.cell(1, 0)], 0xffff0000u);
+	ASSERT(!results[1].ok());
+	EQUAL(results[1].error, "Color value <bad> is invalid.");
+	EQUAL(results[2].error, "Error: cannot read XPM file \"chthon_test_pixmap_2.tmp\".");
+	ASSERT(results[3].ok());
+	EQUAL(results[3].pixmap.pixels.height(), 2u);
+	EQUAL(results[4].error, "Pixmap size 65536x65536 is too large.");
+}
+
+}
+
+SUITE(pixel_map) {
+using Chthon::Pixmap;
+using Chthon::PixelMap;
+
+TEST(should_store_small_indices_in_bytes)
+{
+	PixelMap pixels(3, 2, 5);
+	EQUAL(pixels.index_size(), 1u);
+	EQUAL(pixels.cell(2, 1), 5u);
+	ASSERT(pixels.data<uint8_t>());
+	ASSERT(!pixels.data<uint16_t>());
+	ASSERT(!pixels.data<uint32_t>());
+}
+
+TEST(should_widen_storage_when_large_index_is_stored)
+{
+	PixelMap pixels(3, 2, 5);
+	pixels.cell(1, 0) = 300;
+	EQUAL(pixels.index_size(), 2u);
+	EQUAL(pixels.cell(1, 0), 300u);
+	EQUAL(pixels.cell(2, 1), 5u);
+	pixels.cell(0, 1) = 70000;
+	EQUAL(pixels.index_size(), 4u);
+	EQUAL(pixels.cell(0, 1), 70000u);
+	EQUAL(pixels.cell(1, 0), 300u);
+	EQUAL(pixels.max_index(), 70000u);
+}
+
+TEST(should_shrink_storage_to_fit_indices)
+{
+	PixelMap pixels(2, 2, 70000);
+	EQUAL(pixels.index_size(), 4u);
+	for(auto && pixel : pixels) {
+		pixel = 7;
+	}
+	pixels.shrink_to_fit();
+	EQUAL(pixels.index_size(), 1u);
+	EQUAL(pixels.cell(1, 1), 7u);
 }
 
+TEST(should_iterate_over_indices)
+{
+	PixelMap pixels(2, 2, 1);
+	pixels.cell(1, 1) = 2;
+	const PixelMap & const_pixels = pixels;
+	std::vector<unsigned> values(const_pixels.begin(), const_pixels.end());
+	EQUAL(values.size(), 4u);
+	EQUAL(values[0], 1u);
+	EQUAL(values[3], 2u);
+	EQUAL(size_t(pixels.end() - pixels.begin()), 4u);
+}
+
+TEST(should_resize_pixel_map_keeping_indices)
+{
+	PixelMap pixels(2, 2, 1);
+	pixels.cell(1, 1) = 300;
+	pixels.resize(3, 1);
+	EQUAL(pixels.width(), 3u);
+	EQUAL(pixels.height(), 1u);
+	EQUAL(pixels.cell(0, 0), 1u);
+	EQUAL(pixels.cell(1, 0), 1u);
+	EQUAL(pixels.cell(2, 0), 0u);
+	pixels.resize(2, 2);
+	EQUAL(pixels.cell(1, 1), 0u);
+}
+
+TEST(should_floodfill_pixel_map)
+{
+	PixelMap pixels(3, 3, 0);
+	pixels.cell(1, 0) = 1;
+	pixels.cell(1, 1) = 1;
+	pixels.cell(1, 2) = 1;
+	pixels.floodfill(0, 0, 2);
+	EQUAL(pixels.cell(0, 2), 2u);
+	EQUAL(pixels.cell(1, 1), 1u);
+	EQUAL(pixels.cell(2, 2), 0u);
+}
+
+TEST(should_compare_and_offset_iterators)
+{
+	PixelMap pixels(4, 1, 0);
+	PixelMap::iterator begin = pixels.begin();
+	PixelMap::iterator end = pixels.end();
+	ASSERT(begin < end);
+	ASSERT(end > begin);
+	ASSERT(begin <= begin);
+	ASSERT(end >= begin);
+	ASSERT(2 + begin == begin + 2);
+	EQUAL(size_t(end - (2 + begin)), 2u);
+}
+
+TEST(should_reverse_and_sort_indices_through_proxies)
+{
+	PixelMap pixels(4, 1, 0);
+	pixels.cell(0, 0) = 3;
+	pixels.cell(1, 0) = 300;
+	pixels.cell(2, 0) = 1;
+	std::reverse(pixels.begin(), pixels.end());
+	EQUAL(pixels.cell(0, 0), 0u);
+	EQUAL(pixels.cell(1, 0), 1u);
+	EQUAL(pixels.cell(2, 0), 300u);
+	EQUAL(pixels.cell(3, 0), 3u);
+	std::sort(pixels.begin(), pixels.end());
+	EQUAL(pixels.cell(0, 0), 0u);
+	EQUAL(pixels.cell(1, 0), 1u);
+	EQUAL(pixels.cell(2, 0), 3u);
+	EQUAL(pixels.cell(3, 0), 300u);
+}
+
+TEST(should_convert_pixmap_pixels_to_compact_storage_and_back)
+{
+	std::vector<std::string> xpm_lines;
+	xpm_lines.push_back("2 1 300 2");
+	for(unsigned i = 0; i < 300; ++i) {
+		xpm_lines.push_back(Chthon::format("{0}{1} c #{2}{3}0000", char('A' + i / 20), char('A' + i % 20), i / 16 % 10, i % 10));
+	}
+	xpm_lines.push_back("AAOT");
+	Pixmap pixmap;
+	pixmap.load(xpm_lines);
+	PixelMap pixels(pixmap.pixels);
+	EQUAL(pixels.index_size(), 2u);
+	EQUAL(pixels.cell(0, 0), 0u);
+	EQUAL(pixels.cell(1, 0), 299u);
+	pixels.cell(0, 0) = 7;
+	pixmap.pixels = pixels.to_map();
+	EQUAL(pixmap.pixels.width(), 2u);
+	EQUAL(pixmap.pixels.cell(0, 0), 7u);
+	EQUAL(pixmap.pixels.cell(1, 0), 299u);
+}
+
+TEST(should_load_pixmap_into_compact_storage_when_requested)
+{
+	static const char * xpm[] = {
+	"3 2 2 1",
+	". c #ff0000",
+	"# c #00ff00",
+	"#.#",
+	".#."
+	};
+	std::vector<std::string> xpm_lines(xpm, xpm + Chthon::size_of_array(xpm));
+	Pixmap pixmap;
+	pixmap.compact = true;
+	pixmap.load(xpm_lines);
+	EQUAL(pixmap.pixels.width(), 0u);
+	EQUAL(pixmap.width(), 3u);
+	EQUAL(pixmap.height(), 2u);
+	EQUAL(pixmap.compact_pixels.index_size(), 1u);
+	EQUAL(pixmap.compact_pixels.cell(0, 0), 1u);
+	EQUAL(pixmap.compact_pixels.cell(1, 0), 0u);
+	EQUAL(pixmap.compact_pixels.cell(2, 0), 1u);
+	EQUAL(pixmap.compact_pixels.cell(0, 1), 0u);
+	EQUAL(pixmap.compact_pixels.cell(1, 1), 1u);
+	EQUAL(pixmap.compact_pixels.cell(2, 1), 0u);
+}
+
+TEST(should_save_compact_pixmap_exactly_when_intact)
+{
+	static const char * xpm_data = 
+		"/* XPM */\n"
+		"static char * xpm[] = {\n"
+		"/* Values */\n"
+		"\"3 2 2 1\",\n"
+		"/* Colors */\n"
+		"\". c #ff0000\" /* red */,\n"
+		"\"# c #00ff00\",\n"
+		"/* Pixels */\n"
+		"\"#.#\",\n"
+		"\".#.\"\n"
+		"};\n"
+		;
+	Pixmap pixmap;
+	pixmap.compact = true;
+	pixmap.load(xpm_data);
+	EQUAL(pixmap.save(), std::string(xpm_data));
+}
+
+TEST(should_save_compact_pixmap_with_wide_indices_as_plain_one)
+{
+	std::vector<std::string> xpm_lines;
+	xpm_lines.push_back("2 1 300 2");
+	for(unsigned i = 0; i < 300; ++i) {
+		xpm_lines.push_back(Chthon::format("{0}{1} c #{2}{3}0000", char('A' + i / 20), char('A' + i % 20), i / 16 % 10, i % 10));
+	}
+	xpm_lines.push_back("AAOT");
+	Pixmap pixmap;
+	pixmap.load(xpm_lines);
+	Pixmap compact_pixmap(1, 1, 1, true);
+	compact_pixmap.load(xpm_lines);
+	EQUAL(compact_pixmap.compact_pixels.index_size(), 2u);
+	EQUAL(compact_pixmap.compact_pixels.cell(1, 0), 299u);
+	EQUAL(compact_pixmap.save(), pixmap.save());
+}
+
+}
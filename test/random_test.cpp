@@ -0,0 +1,128 @@
+#include "../src/random.h"
+#include "../src/util.h"
+#include "../src/test.h"
+#include <thread>
+
+SUITE(random) {
+
+TEST(should_produce_same_sequence_for_same_seed)
+{
+	Chthon::Random a(42), b(42);
+	for(int i = 0; i < 100; ++i) {
+		EQUAL(a.next(), b.next());
+	}
+}
+
+TEST(should_produce_different_sequences_for_different_seeds)
+{
+	Chthon::Random a(1), b(2);
+	bool differs = false;
+	for(int i = 0; i < 10; ++i) {
+		differs = differs || a.next() != b.next();
+	}
+	ASSERT(differs);
+}
+
+TEST(should_remember_seed)
+{
+	Chthon::Random random(42);
+	random.next();
+	EQUAL(random.seed(), 42u);
+}
+
+TEST(should_get_value_in_range)
+{
+	Chthon::Random random(1);
+	for(int i = 0; i < 1000; ++i) {
+		ASSERT(random.get(3) < 3);
+	}
+}
+
+TEST(should_get_zero_for_empty_range)
+{
+	Chthon::Random random(1);
+	EQUAL(random.get(0), 0u);
+}
+
+TEST(should_get_all_values_in_range)
+{
+	Chthon::Random random(1);
+	std::vector<int> counts(7, 0);
+	for(int i = 0; i < 7000; ++i) {
+		++counts[random.get(7)];
+	}
+	for(int count : counts) {
+		ASSERT(count > 800 && count < 1200);
+	}
+}
+
+TEST(should_get_value_in_inclusive_range)
+{
+	Chthon::Random random(1);
+	bool min_found = false, max_found = false;
+	for(int i = 0; i < 1000; ++i) {
+		int value = random.range(-1, 1);
+		ASSERT(-1 <= value && value <= 1);
+		min_found = min_found || value == -1;
+		max_found = max_found || value == 1;
+	}
+	ASSERT(min_found && max_found);
+}
+
+TEST(should_derive_same_seed_for_same_stream)
+{
+	EQUAL(Chthon::Random::derive_seed(42, 1), Chthon::Random::derive_seed(42, 1));
+	ASSERT(Chthon::Random::derive_seed(42, 1) != Chthon::Random::derive_seed(42, 2));
+}
+
+TEST(should_fork_generator_independently_of_its_state)
+{
+	Chthon::Random a(42), b(42);
+	b.next();
+	EQUAL(a.fork(3).next(), b.fork(3).next());
+}
+
+TEST(should_shuffle_values)
+{
+	Chthon::Random random(1);
+	std::vector<int> v;
+	for(int i = 0; i < 20; ++i) {
+		v.push_back(i);
+	}
+	std::vector<int> shuffled = v;
+	random.shuffle(shuffled.begin(), shuffled.end());
+	ASSERT(shuffled != v);
+	std::sort(shuffled.begin(), shuffled.end());
+	ASSERT(shuffled == v);
+}
+
+TEST(should_sample_distinct_values)
+{
+	Chthon::Random random(1);
+	std::vector<unsigned> values = random.sample(10, 5);
+	EQUAL(values.size(), 5u);
+	for(size_t i = 1; i < values.size(); ++i) {
+		ASSERT(values[i - 1] < values[i]);
+	}
+	ASSERT(values.back() < 10);
+}
+
+TEST(should_sample_all_values_if_count_is_too_large)
+{
+	Chthon::Random random(1);
+	std::vector<int> v;
+	v << 1 << 2 << 3;
+	std::vector<int> values = random.sample(v, 5);
+	ASSERT(values == v);
+}
+
+TEST(should_have_separate_generator_in_each_thread)
+{
+	Chthon::Random * main_random = &Chthon::thread_random();
+	Chthon::Random * other_random = nullptr;
+	std::thread thread([&other_random]() { other_random = &Chthon::thread_random(); });
+	thread.join();
+	ASSERT(main_random != other_random);
+}
+
+}
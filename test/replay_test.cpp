@@ -0,0 +1,138 @@
+#include "mocks.h"
+#include "../src/replay.h"
+#include "../src/actions.h"
+#include "../src/test.h"
+#include <sstream>
+using Chthon::ActionRecord;
+using Chthon::Replay;
+using Chthon::Point;
+
+SUITE(replay) {
+using GameMocks::GameWithReplay;
+
+TEST(should_record_directed_action)
+{
+	Chthon::Move move(Point(1, -1));
+	ActionRecord record(3, &move);
+	EQUAL(int(record.type), int(ActionRecord::MOVE));
+	EQUAL(record.actor, 3u);
+	EQUAL(record.shift, Point(1, -1));
+}
+
+TEST(should_record_slot_action)
+{
+	Chthon::Wield wield(2);
+	ActionRecord record(0, &wield);
+	EQUAL(int(record.type), int(ActionRecord::WIELD));
+	EQUAL(record.slot, 2u);
+}
+
+TEST(should_record_null_action_as_none)
+{
+	ActionRecord record(0, nullptr);
+	EQUAL(int(record.type), int(ActionRecord::NONE));
+}
+
+TEST(should_restore_action_from_record)
+{
+	Chthon::Swing swing(Point(0, 1));
+	Chthon::Action * action = ActionRecord(0, &swing).restore();
+	Chthon::Swing * restored = dynamic_cast<Chthon::Swing*>(action);
+	ASSERT(restored);
+	EQUAL(restored->shift, Point(0, 1));
+	delete action;
+}
+
+TEST(should_write_and_read_replay)
+{
+	Replay replay(12345);
+	Chthon::Move move(Point(-1, 0));
+	Chthon::Eat eat(25);
+	Chthon::Grab grab;
+	replay.record(0, &move);
+	replay.record(1000, &eat);
+	replay.record(2, &grab);
+	std::ostringstream out;
+	replay.write(out);
+
+	std::istringstream in(out.str());
+	Replay other;
+	other.read(in);
+	EQUAL(other.seed, 12345u);
+	TEST_CONTAINER(other.actions, record) {
+		EQUAL(int(record.type), int(ActionRecord::MOVE));
+		EQUAL(record.shift, Point(-1, 0));
+	} NEXT(record) {
+		EQUAL(int(record.type), int(ActionRecord::EAT));
+		EQUAL(record.actor, 1000u);
+		EQUAL(record.slot, 25u);
+	} NEXT(record) {
+		EQUAL(int(record.type), int(ActionRecord::GRAB));
+	} DONE(record);
+}
+
+TEST(should_throw_on_corrupted_replay)
+{
+	std::istringstream in("CHRP");
+	Replay replay;
+	CATCH(replay.read(in), const Replay::Exception & e) {
+		EQUAL(e.message, "Replay has unsupported version.");
+	}
+}
+
+TEST_FIXTURE(GameWithReplay, should_record_every_action_decision)
+{
+	Replay replay(7);
+	game.record(replay);
+	game.create_new_game();
+	game.run();
+	ASSERT(!replay.actions.empty());
+	EQUAL(int(replay.actions.front().type), int(ActionRecord::MOVE));
+}
+
+TEST_FIXTURE(GameWithReplay, should_reproduce_game_on_playback)
+{
+	Replay replay(7);
+	game.record(replay);
+	game.create_new_game();
+	game.run();
+
+	std::ostringstream out;
+	replay.write(out);
+	std::istringstream in(out.str());
+	Replay loaded;
+	loaded.read(in);
+	other_game.playback(loaded);
+
+	EQUAL(other_game.turns, game.turns);
+	EQUAL(other_game.current_level().monsters.size(), game.current_level().monsters.size());
+	for(size_t i = 0; i < game.current_level().monsters.size(); ++i) {
+		EQUAL(other_game.current_level().monsters[i].pos, game.current_level().monsters[i].pos);
+		EQUAL(other_game.current_level().monsters[i].hp, game.current_level().monsters[i].hp);
+	}
+}
+
+TEST_FIXTURE(GameWithReplay, should_reproduce_game_on_playback_of_already_played_game)
+{
+	Replay replay(7);
+	game.record(replay);
+	game.create_new_game();
+	game.run();
+
+	other_game.controller_factory.add_controller(GameMocks::RandomDungeon::PLAYER_AI, new GameMocks::ScriptedController(std::vector<Chthon::Point>(3, Chthon::Point(1, 0))));
+	other_game.controller_factory.add_controller(GameMocks::RandomDungeon::RANDOM_AI, (new Chthon::BasicAI())->add(Chthon::BasicAI::MOVE_RANDOM));
+	other_game.random = Chthon::Random(99);
+	other_game.create_new_game();
+	other_game.run();
+	other_game.current_level().monsters.front().hp = 1000;
+	other_game.playback(replay);
+
+	EQUAL(other_game.turns, game.turns);
+	EQUAL(other_game.current_level().monsters.size(), game.current_level().monsters.size());
+	for(size_t i = 0; i < game.current_level().monsters.size(); ++i) {
+		EQUAL(other_game.current_level().monsters[i].pos, game.current_level().monsters[i].pos);
+		EQUAL(other_game.current_level().monsters[i].hp, game.current_level().monsters[i].hp);
+	}
+}
+
+}
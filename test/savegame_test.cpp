@@ -0,0 +1,366 @@
+#include "mocks.h"
+#include "../src/savegame.h"
+#include "../src/actions.h"
+#include "../src/test.h"
+#include <sstream>
+#include <fstream>
+using Chthon::Point;
+using Chthon::Level;
+using Chthon::Reader;
+using Chthon::Writer;
+
+namespace {
+
+struct CountingDungeon : public GameMocks::StairsDungeon {
+	unsigned generated_count;
+	CountingDungeon() : generated_count(0) {}
+	virtual void generate(Level & level, int level_index)
+	{
+		++generated_count;
+		GameMocks::StairsDungeon::generate(level, level_index);
+	}
+};
+
+}
+
+SUITE(savegame) {
+using GameMocks::GameWithStairs;
+using GameMocks::GameWithSavefile;
+using GameMocks::GameWithReplay;
+
+TEST_FIXTURE(GameWithStairs, should_store_type_as_type_id)
+{
+	std::ostringstream out;
+	Writer writer(out);
+	store(writer, Chthon::Cell(game.cell_type("floor")), game);
+	EQUAL(out.str(), "\"floor\" 0 0 ");
+}
+
+TEST_FIXTURE(GameWithStairs, should_resolve_type_id_when_reading)
+{
+	std::istringstream in("\"floor\" 1 5 ");
+	Reader reader(in);
+	Chthon::Cell cell;
+	store(reader, cell, game);
+	EQUAL(cell.type, game.cell_type("floor"));
+	ASSERT(cell.visible);
+	EQUAL(cell.seen_sprite, 5);
+}
+
+TEST_FIXTURE(GameWithStairs, should_read_unknown_type_as_null)
+{
+	std::istringstream in("\"lava\" 0 0 ");
+	Reader reader(in);
+	Chthon::Cell cell(game.cell_type("floor"));
+	store(reader, cell, game);
+	ASSERT(!cell.type);
+}
+
+TEST_FIXTURE(GameWithStairs, should_throw_exception_when_map_columns_do_not_match_map_size)
+{
+	std::ostringstream out;
+	Writer writer(out);
+	writer.store(2u).store(2u);
+	store(writer, std::vector<std::string>(1, "floor"));
+	store(writer, std::vector<unsigned>(3, 0));
+	store(writer, std::vector<char>(4, 0));
+	store(writer, std::vector<int>(4, 0));
+	std::istringstream in(out.str());
+	Reader reader(in);
+	Chthon::Map<Chthon::Cell> map;
+	CATCH(store(reader, map, game), const Reader::Exception & e) {
+		EQUAL(e.message, "Error: savefile is corrupted (reading map).");
+	}
+}
+
+TEST_FIXTURE(GameWithStairs, should_store_and_restore_level)
+{
+	game.add_item_type("key").sprite(3);
+	game.go_to_level(1);
+	Level & level = game.current_level();
+	level.map.cell(1, 2).seen_sprite = 7;
+	level.monsters[0].hp = 3;
+	level.monsters[0].inventory.insert(Chthon::Item::Builder(game.item_type("key")).key_type(2));
+	level.monsters[0].plan.push_back(new Chthon::Move(Point(1, 0)));
+	level.monsters[0].plan.push_back(new Chthon::Wield(1));
+	level.objects[0].items.push_back(Chthon::Item(game.item_type("key")));
+
+	std::stringstream stream;
+	Writer writer(stream);
+	store(writer, static_cast<const Level &>(level), game);
+	writer.check("level");
+
+	Reader reader(stream);
+	Level restored;
+	store(reader, restored, game);
+	reader.check("level");
+
+	EQUAL(restored.map.width(), 4u);
+	EQUAL(restored.map.height(), 4u);
+	EQUAL(restored.map.cell(1, 2).type, game.cell_type("floor"));
+	EQUAL(restored.map.cell(1, 2).seen_sprite, 7);
+	EQUAL(restored.monsters.size(), 2u);
+	EQUAL(restored.monsters[0].type, game.monster_type("player"));
+	EQUAL(restored.monsters[0].pos, level.monsters[0].pos);
+	EQUAL(restored.monsters[0].hp, 3);
+	EQUAL(restored.monsters[0].inventory.get_item(0).type, game.item_type("key"));
+	EQUAL(restored.monsters[0].inventory.get_item(0).key_type, 2);
+	EQUAL(restored.monsters[0].plan.size(), 2u);
+	EQUAL(dynamic_cast<Chthon::Move*>(restored.monsters[0].plan.front())->shift, Point(1, 0));
+	EQUAL(restored.objects[0].type, game.object_type("stairs"));
+	EQUAL(restored.objects[0].down_destination, 2);
+	EQUAL(restored.objects[0].items.size(), 1u);
+}
+
+TEST_FIXTURE(GameWithStairs, should_store_and_restore_level_in_binary_stream)
+{
+	game.go_to_level(1);
+	Level & level = game.current_level();
+	level.map.cell(1, 2).seen_sprite = 7;
+	level.monsters[0].hp = 3;
+
+	std::stringstream stream;
+	{
+		Chthon::BinaryWriter writer(stream);
+		store(writer, static_cast<const Level &>(level), game);
+		writer.check("level");
+	}
+	std::stringstream text_stream;
+	Writer text_writer(text_stream);
+	store(text_writer, static_cast<const Level &>(level), game);
+	ASSERT(stream.str().size() < text_stream.str().size());
+
+	Chthon::BinaryReader reader(stream);
+	Level restored;
+	store(reader, restored, game);
+	reader.check("level");
+
+	EQUAL(restored.map.cell(1, 2).type, game.cell_type("floor"));
+	EQUAL(restored.map.cell(1, 2).seen_sprite, 7);
+	EQUAL(restored.monsters.size(), 2u);
+	EQUAL(restored.monsters[0].pos, level.monsters[0].pos);
+	EQUAL(restored.monsters[0].hp, 3);
+	EQUAL(restored.objects[0].down_destination, 2);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_read_only_current_level_when_loading_game)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.go_to_level(3);
+	game.turns = 10;
+	game.save(filename);
+
+	other_game.load(filename);
+	EQUAL(other_game.turns, 10);
+	EQUAL(other_game.current_level_index, 3);
+	EQUAL(other_game.levels.size(), 1u);
+	ASSERT(other_game.is_saved(1));
+	ASSERT(other_game.is_saved(2));
+	ASSERT(!other_game.is_saved(3));
+	ASSERT(other_game.has_level(2));
+	EQUAL(other_game.current_level().monsters[1].pos, game.current_level().monsters[1].pos);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_read_saved_level_when_visited)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.level(1).monsters[1].hp = 5;
+	game.save(filename);
+
+	other_game.load(filename);
+	other_game.go_to_level(1);
+	ASSERT(!other_game.is_saved(1));
+	EQUAL(other_game.current_level().monsters[1].hp, 5);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_restore_random_state_when_loading_game)
+{
+	game.go_to_level(1);
+	game.random.next();
+	game.save(filename);
+	other_game.load(filename);
+	EQUAL(other_game.random.next(), game.random.next());
+}
+
+TEST_FIXTURE(GameWithSavefile, should_keep_unread_levels_when_saving_loaded_game)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.level(1).monsters[1].hp = 5;
+	game.save(filename);
+
+	other_game.load(filename);
+	other_game.save(filename);
+	game.load(filename);
+	EQUAL(game.level(1).monsters[1].hp, 5);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_throw_exception_when_savefile_uses_unknown_type)
+{
+	game.add_monster_type("ghost");
+	game.go_to_level(1);
+	game.save(filename);
+	CATCH(other_game.load(filename), const Chthon::IndexedReader::Exception & e) {
+		EQUAL(e.message, "Error: savefile uses unknown type \"ghost\".");
+	}
+}
+
+TEST_FIXTURE(GameWithSavefile, should_save_snapshot_in_background)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.save_in_background(filename);
+	game.level(1).monsters[1].hp = 5;
+	game.turns = 10;
+	game.wait_for_background_save();
+
+	other_game.load(filename);
+	EQUAL(other_game.turns, 0);
+	ASSERT(other_game.level(1).monsters[1].hp != 5);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_not_save_changes_made_by_running_game_after_background_save)
+{
+	game.go_to_level(1);
+	game.controller_factory.add_controller(0, new GameMocks::SavingController(filename));
+	game.run();
+	game.wait_for_background_save();
+	EQUAL(game.current_level().monsters[0].hp, 5);
+
+	other_game.load(filename);
+	ASSERT(other_game.current_level().monsters[0].hp != 5);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_rewrite_savefile_with_torn_tail_on_next_save)
+{
+	game.go_to_level(1);
+	game.level(1).monsters[1].hp = 3;
+	game.save(filename);
+	{
+		std::ofstream out(filename.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+		out << "torn tail";
+	}
+	other_game.load(filename);
+	other_game.turns = 42;
+	other_game.level(1).monsters[1].hp = 1;
+	other_game.save_changes(filename);
+
+	GameMocks::StairsDungeon restored;
+	restored.load(filename);
+	EQUAL(restored.turns, 42);
+	EQUAL(restored.level(1).monsters[1].hp, 1);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_not_generate_pending_levels_when_loading)
+{
+	game.go_to_level(1);
+	game.save(filename);
+	CountingDungeon loading_game;
+	loading_game.pregenerate_levels = true;
+	loading_game.go_to_level(1);
+	ASSERT(loading_game.has_level(2));
+	EQUAL(loading_game.generated_count, 1u);
+	loading_game.load(filename);
+	EQUAL(loading_game.generated_count, 1u);
+	ASSERT(!loading_game.has_level(2));
+	EQUAL(loading_game.current_level_index, 1);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_rethrow_background_save_error)
+{
+	game.go_to_level(1);
+	game.save_in_background("chthon_test_missing_dir/game.sav");
+	CATCH(game.wait_for_background_save(), const Chthon::IndexedWriter::Exception & e) {
+		EQUAL(e.message, "Error: cannot open savefile \"chthon_test_missing_dir/game.sav\" for writing.");
+	}
+}
+
+TEST_FIXTURE(GameWithReplay, should_autosave_every_given_number_of_turns)
+{
+	const char * filename = "chthon_test_autosave.sav";
+	game.set_autosave(2, filename);
+	game.create_new_game();
+	game.run();
+	game.wait_for_background_save();
+	other_game.load(filename);
+	std::remove(filename);
+	ASSERT(other_game.turns > 0);
+	EQUAL(other_game.turns % 2, 0);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_track_changed_levels)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.save(filename);
+	ASSERT(!game.is_changed(1));
+	game.level(1).monsters[1].hp = 5;
+	ASSERT(game.is_changed(1));
+	ASSERT(!game.is_changed(2));
+}
+
+TEST_FIXTURE(GameWithSavefile, should_not_mark_current_level_as_changed_when_it_is_only_read)
+{
+	game.go_to_level(1);
+	game.save(filename);
+	game.controller_factory.add_controller(0, new GameMocks::ScriptedController(std::vector<Chthon::Point>()));
+	game.run();
+	EQUAL(game.current_level().monsters.size(), 2u);
+	ASSERT(!game.is_changed(1));
+}
+
+TEST_FIXTURE(GameWithSavefile, should_mark_current_level_as_changed_when_actions_are_committed)
+{
+	game.go_to_level(1);
+	game.save(filename);
+	game.controller_factory.add_controller(0, new GameMocks::ScriptedController(std::vector<Chthon::Point>(1, Chthon::Point(0, 0))));
+	game.run();
+	ASSERT(game.is_changed(1));
+}
+
+TEST_FIXTURE(GameWithSavefile, should_append_only_changed_levels)
+{
+	game.go_to_level(1);
+	game.go_to_level(2);
+	game.go_to_level(3);
+	game.save(filename);
+	game.level(1).monsters[1].hp = 5;
+	game.turns = 10;
+	game.save_changes(filename);
+
+	Chthon::IndexedReader reader(filename);
+	EQUAL(reader.part_count(), 2u);
+	other_game.load(filename);
+	EQUAL(other_game.turns, 10);
+	EQUAL(other_game.level(1).monsters[1].hp, 5);
+	EQUAL(other_game.level(2).monsters[1].pos, game.level(2).monsters[1].pos);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_compact_savefile_after_too_many_changes)
+{
+	game.set_save_compaction(2);
+	game.go_to_level(1);
+	game.save_changes(filename);
+	EQUAL(Chthon::IndexedReader(filename).part_count(), 1u);
+	game.save_changes(filename);
+	game.save_changes(filename);
+	EQUAL(Chthon::IndexedReader(filename).part_count(), 3u);
+	game.save_changes(filename);
+	EQUAL(Chthon::IndexedReader(filename).part_count(), 1u);
+}
+
+TEST_FIXTURE(GameWithSavefile, should_ignore_incomplete_appended_part)
+{
+	game.go_to_level(1);
+	game.save(filename);
+	{
+		std::ofstream out(filename.c_str(), std::ios::app | std::ios::binary);
+		out << "CHSI\x05";
+	}
+	other_game.load(filename);
+	EQUAL(other_game.current_level_index, 1);
+}
+
+}
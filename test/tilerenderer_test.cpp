@@ -0,0 +1,134 @@
+#include "../src/tilerenderer.h"
+#include "../src/test.h"
+using Chthon::Map;
+using Chthon::Pixmap;
+using Chthon::TileRenderer;
+
+namespace {
+
+const uint32_t BACKGROUND = 0xff000000;
+
+/// Atlas 4x2 with 2x2 tiles: tile 0 is red, tile 1 is green with transparent top-left pixel.
+struct Atlas {
+	Pixmap atlas;
+	Atlas() : atlas(4, 2, 3)
+	{
+		atlas.palette[0] = 0xffff0000;
+		atlas.palette[1] = 0xff00ff00;
+		atlas.palette[2] = 0;
+		for(int y = 0; y < 2; ++y) {
+			atlas.pixels.cell(2, y) = 1;
+			atlas.pixels.cell(3, y) = 1;
+		}
+		atlas.pixels.cell(2, 0) = 2;
+	}
+};
+
+uint32_t pixel(const TileRenderer & renderer, unsigned x, unsigned y)
+{
+	return renderer.pixels()[x + y * renderer.width()];
+}
+
+}
+
+SUITE(tile_renderer) {
+
+TEST_FIXTURE(Atlas, should_split_atlas_into_tiles)
+{
+	TileRenderer renderer(atlas, 2, 2);
+	EQUAL(renderer.tile_count(), 2u);
+	EQUAL(renderer.width(), 0u);
+	ASSERT(!renderer.pixels());
+}
+
+TEST_FIXTURE(Atlas, should_throw_exception_if_tile_does_not_fit_atlas)
+{
+	CATCH((TileRenderer(atlas, 5, 2)), const TileRenderer::Exception & e) {
+		EQUAL(e.message, "Error: tile size 5x2 does not fit atlas 4x2.");
+	}
+	CATCH((TileRenderer(atlas, 0, 2)), const TileRenderer::Exception & e) {
+		EQUAL(e.message, "Error: tile size 0x2 does not fit atlas 4x2.");
+	}
+}
+
+TEST_FIXTURE(Atlas, should_draw_tiles_over_background)
+{
+	TileRenderer renderer(atlas, 2, 2);
+	Map<int> sprites(3, 1, 0);
+	sprites.cell(1, 0) = 1;
+	sprites.cell(2, 0) = 5;
+	renderer.render(sprites);
+	EQUAL(renderer.width(), 6u);
+	EQUAL(renderer.height(), 2u);
+	EQUAL(pixel(renderer, 0, 0), 0xffff0000u);
+	EQUAL(pixel(renderer, 1, 1), 0xffff0000u);
+	EQUAL(pixel(renderer, 2, 0), BACKGROUND);
+	EQUAL(pixel(renderer, 3, 0), 0xff00ff00u);
+	EQUAL(pixel(renderer, 2, 1), 0xff00ff00u);
+	EQUAL(pixel(renderer, 4, 0), BACKGROUND);
+	EQUAL(pixel(renderer, 5, 1), BACKGROUND);
+}
+
+TEST_FIXTURE(Atlas, should_report_whole_map_as_dirty_on_the_first_frame)
+{
+	TileRenderer renderer(atlas, 2, 2);
+	const std::vector<TileRenderer::Rect> & rects = renderer.render(Map<int>(3, 2, 0));
+	EQUAL(rects.size(), 1u);
+	EQUAL(rects[0].x, 0u);
+	EQUAL(rects[0].y, 0u);
+	EQUAL(rects[0].width, 6u);
+	EQUAL(rects[0].height, 4u);
+}
+
+TEST_FIXTURE(Atlas, should_redraw_only_changed_cells)
+{
+	TileRenderer renderer(atlas, 2, 2);
+	Map<int> sprites(4, 3, 0);
+	renderer.render(sprites);
+	EQUAL(renderer.render(sprites).size(), 0u);
+
+	sprites.cell(1, 0) = 1;
+	sprites.cell(2, 0) = 1;
+	sprites.cell(1, 1) = 1;
+	sprites.cell(2, 1) = 1;
+	sprites.cell(3, 2) = 1;
+	const std::vector<TileRenderer::Rect> & rects = renderer.render(sprites);
+	EQUAL(rects.size(), 2u);
+	EQUAL(rects[0].x, 2u);
+	EQUAL(rects[0].y, 0u);
+	EQUAL(rects[0].width, 4u);
+	EQUAL(rects[0].height, 4u);
+	EQUAL(rects[1].x, 6u);
+	EQUAL(rects[1].y, 4u);
+	EQUAL(rects[1].width, 2u);
+	EQUAL(rects[1].height, 2u);
+	EQUAL(pixel(renderer, 3, 0), 0xff00ff00u);
+	EQUAL(pixel(renderer, 2, 0), BACKGROUND);
+}
+
+TEST_FIXTURE(Atlas, should_redraw_transparent_pixels_with_background)
+{
+	TileRenderer renderer(atlas, 2, 2);
+	Map<int> sprites(1, 1, 0);
+	renderer.render(sprites);
+	EQUAL(pixel(renderer, 0, 0), 0xffff0000u);
+	sprites.cell(0, 0) = 1;
+	renderer.render(sprites);
+	EQUAL(pixel(renderer, 0, 0), BACKGROUND);
+	EQUAL(pixel(renderer, 1, 0), 0xff00ff00u);
+}
+
+TEST_FIXTURE(Atlas, should_redraw_everything_after_invalidation_or_resize)
+{
+	TileRenderer renderer(atlas, 2, 2);
+	Map<int> sprites(2, 2, 0);
+	renderer.render(sprites);
+	renderer.invalidate();
+	EQUAL(renderer.render(sprites).size(), 1u);
+	EQUAL(renderer.dirty_rects()[0].height, 4u);
+	EQUAL(renderer.render(Map<int>(3, 1, 0)).size(), 1u);
+	EQUAL(renderer.dirty_rects()[0].width, 6u);
+	EQUAL(renderer.dirty_rects()[0].height, 2u);
+}
+
+}
@@ -1,4 +1,5 @@
 #include "../src/util.h"
+#include "../src/format.h"
 #include "../src/test.h"
 
 SUITE(util) {
@@ -265,4 +266,23 @@ TEST(should_extract_interleaved_charmap)
 	EQUAL(result, "abcdefghi");
 }
 
+TEST(string_view_should_refer_to_part_of_string)
+{
+	std::string s = "hello world";
+	Chthon::StringView view(s.data() + 6, 5);
+	EQUAL(view.size(), 5u);
+	EQUAL(view.data(), s.data() + 6);
+	EQUAL(view.str(), "world");
+}
+
+TEST(string_views_should_be_compared_by_content)
+{
+	std::string s = "abcabd";
+	Chthon::StringView first(s.data(), 3), second(s.data() + 3, 3);
+	ASSERT(first == Chthon::StringView("abc"));
+	ASSERT(first != second);
+	ASSERT(first < second);
+	ASSERT(Chthon::StringView() == Chthon::StringView(""));
+}
+
 }
@@ -0,0 +1,193 @@
+#include "../src/xmldocument.h"
+#include "../src/test.h"
+#include "../src/format.h"
+using Chthon::XMLDocument;
+using Chthon::XMLNode;
+
+SUITE(xml_document) {
+
+struct Document {
+	std::string text;
+	XMLDocument document;
+	Document(const std::string & xml) : text(xml), document(text.data(), text.size()) {}
+};
+
+TEST(should_build_tree_of_elements)
+{
+	Document xml("<?xml version=\"1.0\"?><data><first/><second>text</second></data>");
+	const XMLNode & root = xml.document.root();
+	EQUAL(xml.document.node_count(), 3u);
+	ASSERT(root.tag.empty());
+	const XMLNode * data = root.first_child;
+	ASSERT(data);
+	EQUAL(data->tag.str(), "data");
+	ASSERT(!data->next_sibling);
+	ASSERT(data->parent == &root);
+	EQUAL(data->first_child->tag.str(), "first");
+	EQUAL(data->first_child->next_sibling->tag.str(), "second");
+	ASSERT(!data->first_child->next_sibling->next_sibling);
+	ASSERT(data->first_child->parent == data);
+}
+
+TEST(should_store_attributes_without_self_closing_slash)
+{
+	Document xml("<item id=sword name=\"Long \\\"sword\\\"\" />");
+	const XMLNode * item = xml.document.root().first_child;
+	EQUAL(item->attribute_count, 2u);
+	EQUAL(item->attributes[0].name.str(), "id");
+	EQUAL(item->get_attribute("id"), "sword");
+	EQUAL(item->get_attribute("name"), "Long \"sword\"");
+	ASSERT(!item->find_attribute("/"));
+}
+
+TEST(should_keep_views_into_source_buffer)
+{
+	Document xml("<item id=sword>Sword</item>");
+	const XMLNode * item = xml.document.root().first_child;
+	ASSERT(item->tag.data() == xml.text.data() + 1);
+	ASSERT(item->text.data() == xml.text.data() + 15);
+	ASSERT(item->attributes[0].value.data() == xml.text.data() + 9);
+}
+
+TEST(should_decode_text_of_element)
+{
+	Document xml("<a>Fish &amp; chips<b>inner</b>tail</a>");
+	const XMLNode * a = xml.document.root().first_child;
+	EQUAL(a->text.str(), "Fish &amp; chips");
+	EQUAL(a->content(), "Fish & chips");
+	EQUAL(a->first_child->content(), "inner");
+}
+
+TEST(should_find_children_by_name)
+{
+	Document xml("<data><item id=1/><other/><item id=2/></data>");
+	const XMLNode * item = xml.document.root().child("data")->child("item");
+	EQUAL(item->get_attribute("id"), "1");
+	item = item->next();
+	EQUAL(item->get_attribute("id"), "2");
+	ASSERT(!item->next());
+	ASSERT(!xml.document.root().child("item"));
+}
+
+TEST(should_find_nodes_by_path)
+{
+	Document xml("<data><item id=shield><name>Shield</name></item><item id=\"sword\"><name>Sword</name></item></data>");
+	const XMLNode * name = xml.document.root().find("data/item[@id=sword]/name");
+	ASSERT(name);
+	EQUAL(name->content(), "Sword");
+	EQUAL(xml.document.root().find("data/item/name")->content(), "Shield");
+	ASSERT(!xml.document.root().find("data/item[@id=axe]"));
+	ASSERT(!xml.document.root().find("item"));
+}
+
+TEST(should_find_node_deeper_than_first_matching_branch)
+{
+	Document xml("<data><item><name/></item><item><desc>Found</desc></item></data>");
+	EQUAL(xml.document.root().find("data/item/desc")->content(), "Found");
+}
+
+TEST(should_find_nodes_by_quoted_value_and_presence_of_attribute)
+{
+	Document xml("<data><item id=\"a b\"/><item unique/><item/></data>");
+	ASSERT(xml.document.root().find("data/item[@id=\"a b\"]"));
+	ASSERT(xml.document.root().find("data/item[@id='a b']"));
+	EQUAL(xml.document.root().find_all("data/item[@unique]").size(), 1u);
+	EQUAL(xml.document.root().find_all("data/*").size(), 3u);
+}
+
+TEST(should_find_all_nodes_in_document_order)
+{
+	Document xml("<data><group><item id=1/><item id=2/></group><group><item id=3/></group></data>");
+	std::vector<const XMLNode *> items = xml.document.root().find_all("data/group/item");
+	EQUAL(items.size(), 3u);
+	EQUAL(items[0]->get_attribute("id"), "1");
+	EQUAL(items[1]->get_attribute("id"), "2");
+	EQUAL(items[2]->get_attribute("id"), "3");
+}
+
+TEST(should_throw_exception_for_invalid_path)
+{
+	Document xml("<data/>");
+	CATCH(xml.document.root().find("data/item[id=1]"), const XMLDocument::Exception & e) {
+		EQUAL(e.message, "Error: invalid XML path \"data/item[id=1]\": expected '@'.");
+	}
+	CATCH(xml.document.root().find("data//item"), const XMLDocument::Exception & e) {
+		EQUAL(e.message, "Error: invalid XML path \"data//item\": empty step.");
+	}
+	CATCH(xml.document.root().find("data/item[@id=1"), const XMLDocument::Exception & e) {
+		EQUAL(e.message, "Error: invalid XML path \"data/item[@id=1\": expected ']'.");
+	}
+}
+
+TEST(should_ignore_unmatched_closing_tags)
+{
+	Document xml("<data><a></b><c/></a><d>");
+	const XMLNode * data = xml.document.root().first_child;
+	EQUAL(data->first_child->tag.str(), "a");
+	EQUAL(data->first_child->first_child->tag.str(), "c");
+	EQUAL(data->first_child->next_sibling->tag.str(), "d");
+}
+
+TEST(should_allocate_nodes_in_arena)
+{
+	std::string text = "<data>";
+	for(int i = 0; i < 1000; ++i) {
+		text += "<item id=1 name=2/>";
+	}
+	text += "</data>";
+	XMLDocument document(text.data(), text.size());
+	EQUAL(document.node_count(), 1001u);
+	EQUAL(document.root().find_all("data/item[@name=2]").size(), 1000u);
+	ASSERT(document.allocated() >= 1001 * sizeof(XMLNode));
+}
+
+TEST(should_throw_exception_if_xml_document_cannot_be_opened)
+{
+	CATCH(XMLDocument("chthon_test_missing.xml"), const XMLDocument::Exception & e) {
+		EQUAL(e.message, "Error: cannot open XML file \"chthon_test_missing.xml\".");
+	}
+}
+
+TEST(should_parse_records_in_document_order)
+{
+	std::string text = "<?xml version=\"1.0\"?>\n<data>\n";
+	for(int i = 0; i < 20000; ++i) {
+		text += Chthon::format("<item id=\"{0}\"><name>Item &amp; {0}</name></item>\n<other/>\n", i);
+	}
+	text += "</data>\n";
+	std::vector<std::string> ids, names;
+	size_t count = Chthon::parse_xml_records(text.data(), text.size(), "item", [&](const XMLNode & item) {
+		ids.push_back(item.get_attribute("id"));
+		names.push_back(item.child("name")->content());
+	}, 4);
+	EQUAL(count, 20000u);
+	EQUAL(ids.size(), 20000u);
+	for(size_t i = 0; i < ids.size(); ++i) {
+		EQUAL(ids[i], Chthon::to_string(i));
+		EQUAL(names[i], "Item & " + Chthon::to_string(i));
+	}
+}
+
+TEST(should_not_split_records_at_similar_tags)
+{
+	std::string text = "<data>";
+	for(int i = 0; i < 10000; ++i) {
+		text += "<items><item/><itemset/></items>";
+	}
+	text += "</data>";
+	size_t count = Chthon::parse_xml_records(text.data(), text.size(), "items", [](const XMLNode & items) {
+		EQUAL(items.find_all("*").size(), 2u);
+	}, 3);
+	EQUAL(count, 10000u);
+}
+
+TEST(should_parse_no_records_in_empty_document)
+{
+	std::string text = "<data></data>";
+	size_t count = Chthon::parse_xml_records(text.data(), text.size(), "item", [](const XMLNode &) {
+		FAIL("Callback should not be called.");
+	});
+	EQUAL(count, 0u);
+}
+
+}
@@ -2,6 +2,8 @@
 #include "../src/test.h"
 #include <sstream>
 using Chthon::XMLReader;
+using Chthon::XMLBufferReader;
+using Chthon::XMLPushParser;
 
 SUITE(xml) {
 
@@ -69,6 +71,35 @@ TEST(should_skip_to_the_end_if_tag_is_not_found)
 	ASSERT(tag.empty());
 }
 
+TEST(should_skip_tags_with_similar_names)
+{
+	std::istringstream stream("<worldwide>first<world/>second<world attr=\"value\">");
+	XMLReader reader(stream);
+	reader.skip_to_tag("world");
+	EQUAL(reader.get_current_content(), "first");
+	EQUAL(reader.get_attributes().count("/"), 1ul);
+	reader.skip_to_tag("world");
+	EQUAL(reader.get_current_content(), "second");
+	EQUAL(reader.get_attributes()["attr"], "value");
+}
+
+TEST(should_skip_tags_with_quoted_closing_bracket)
+{
+	std::istringstream stream("<Hello attr=\"a > <world> \\\" b\">&lt;content&gt;<world>");
+	XMLReader reader(stream);
+	EQUAL(reader.skip_to_tag("world"), "world");
+	EQUAL(reader.get_current_content(), "<content>");
+	ASSERT(reader.skip_to_tag("world").empty());
+}
+
+TEST(should_keep_content_after_the_last_tag_when_skipping)
+{
+	std::istringstream stream("<Hello>content &amp; more");
+	XMLReader reader(stream);
+	ASSERT(reader.skip_to_tag("world").empty());
+	EQUAL(reader.get_current_content(), "content & more");
+}
+
 TEST(should_store_intertag_content)
 {
 	std::istringstream stream("<Hello>content<world>");
@@ -212,6 +243,30 @@ TEST(should_convert_entities)
 	EQUAL(reader.get_current_content(), "foo >> bar…");
 }
 
+TEST(should_convert_numeric_entities_to_utf8)
+{
+	std::istringstream stream("&#65;&#xe9;&#X416;&#8364;&#x1F600;&#171;");
+	XMLReader reader(stream);
+	reader.to_next_tag();
+	EQUAL(reader.get_current_content(), "A\xc3\xa9\xd0\x96\xe2\x82\xac\xf0\x9f\x98\x80\xc2\xab");
+}
+
+TEST(should_not_convert_invalid_numeric_entities)
+{
+	std::istringstream stream("&#;&#x;&#12a;&#xD800;&#x110000;&#0;&;");
+	XMLReader reader(stream);
+	reader.to_next_tag();
+	EQUAL(reader.get_current_content(), "&#;&#x;&#12a;&#xD800;&#x110000;&#0;&;");
+}
+
+TEST(should_convert_named_entities)
+{
+	std::istringstream stream("&quot;&apos;&lt;&gt;&amp;&laquo;&raquo;&mdash;&ndash;&hellip;&rarr;&ldquo;&rdquo;&rsquo;");
+	XMLReader reader(stream);
+	reader.to_next_tag();
+	EQUAL(reader.get_current_content(), "\"'<>&«»—–…→“”’");
+}
+
 TEST(should_not_convert_unknown_entities)
 {
 	std::istringstream stream("foo &unknownentity; bar");
@@ -222,3 +277,239 @@ TEST(should_not_convert_unknown_entities)
 
 }
 
+SUITE(xml_buffer) {
+
+struct Buffer {
+	std::string text;
+	XMLBufferReader reader;
+	Buffer(const std::string & xml) : text(xml), reader(text.data(), text.size()) {}
+};
+
+TEST(should_find_tags_and_content_in_buffer)
+{
+	Buffer xml("Hello<world>content<end>");
+	EQUAL(xml.reader.to_next_tag().str(), "world");
+	EQUAL(xml.reader.get_current_content(), "Hello");
+	EQUAL(xml.reader.to_next_tag().str(), "end");
+	EQUAL(xml.reader.get_current_content(), "content");
+	ASSERT(xml.reader.to_next_tag().empty());
+	ASSERT(xml.reader.get_raw_content().empty());
+}
+
+TEST(should_have_content_after_the_last_tag_in_buffer)
+{
+	Buffer xml("<world>Hello");
+	xml.reader.to_next_tag();
+	ASSERT(xml.reader.to_next_tag().empty());
+	EQUAL(xml.reader.get_current_content(), "Hello");
+	EQUAL(xml.reader.position(), xml.text.size());
+}
+
+TEST(should_return_views_into_buffer)
+{
+	Buffer xml("text<tag attr=value>");
+	xml.reader.to_next_tag();
+	ASSERT(xml.reader.get_current_tag().data() == xml.text.data() + 5);
+	ASSERT(xml.reader.get_raw_content().data() == xml.text.data());
+	ASSERT(xml.reader.get_attributes()[0].value.data() == xml.text.data() + 14);
+}
+
+TEST(should_skip_until_tag_is_found_in_buffer)
+{
+	Buffer xml("<Hello>content<world>");
+	EQUAL(xml.reader.skip_to_tag("world").str(), "world");
+	EQUAL(xml.reader.get_current_content(), "content");
+	ASSERT(xml.reader.skip_to_tag("world").empty());
+}
+
+TEST(should_skip_tags_with_quoted_closing_bracket_in_buffer)
+{
+	Buffer xml("<Hello attr=\"a > <world> \\\" b\">content<worldwide><world/>last");
+	EQUAL(xml.reader.skip_to_tag("world").str(), "world");
+	EQUAL(xml.reader.get_raw_content().str(), "");
+	ASSERT(xml.reader.has_attribute("/"));
+	ASSERT(xml.reader.skip_to_tag("world").empty());
+	EQUAL(xml.reader.get_raw_content().str(), "last");
+}
+
+TEST(should_find_tag_after_long_content_in_buffer)
+{
+	Buffer xml("<Hello>" + std::string(100, 'a') + "<world>");
+	EQUAL(xml.reader.skip_to_tag("world").str(), "world");
+	EQUAL(xml.reader.get_raw_content().str(), std::string(100, 'a'));
+	EQUAL(xml.reader.position(), xml.text.size());
+}
+
+TEST(should_skip_whitespace_around_tag_name_in_buffer)
+{
+	Buffer xml("< Hello  attribute = value  >");
+	xml.reader.to_next_tag();
+	EQUAL(xml.reader.get_current_tag().str(), "Hello");
+	EQUAL(xml.reader.get_attribute("attribute"), "value");
+}
+
+TEST(should_keep_attributes_in_order)
+{
+	Buffer xml("<Hello first=1 second=\"two\" third>");
+	xml.reader.to_next_tag();
+	EQUAL(xml.reader.get_attributes().size(), 3u);
+	EQUAL(xml.reader.get_attributes()[0].name.str(), "first");
+	EQUAL(xml.reader.get_attributes()[1].name.str(), "second");
+	EQUAL(xml.reader.get_attributes()[1].value.str(), "two");
+	EQUAL(xml.reader.get_attributes()[2].name.str(), "third");
+	ASSERT(xml.reader.has_attribute("third"));
+	EQUAL(xml.reader.get_attribute("third"), "");
+	ASSERT(!xml.reader.has_attribute("fourth"));
+}
+
+TEST(should_unescape_quoted_attribute_in_buffer)
+{
+	Buffer xml("<Hello attribute=\"hello \\\"world\\\" > there\">");
+	xml.reader.to_next_tag();
+	EQUAL(xml.reader.get_attribute("attribute"), "hello \"world\" > there");
+	EQUAL(xml.reader.to_next_tag().str(), "");
+}
+
+TEST(should_recognize_trailing_slash_as_attribute_in_buffer)
+{
+	Buffer xml("<Hello/><World attr=\"value\" />");
+	EQUAL(xml.reader.to_next_tag().str(), "Hello");
+	ASSERT(xml.reader.has_attribute("/"));
+	EQUAL(xml.reader.to_next_tag().str(), "World");
+	EQUAL(xml.reader.get_attribute("attr"), "value");
+	ASSERT(xml.reader.has_attribute("/"));
+}
+
+TEST(should_not_include_self_closing_slash_in_unquoted_value_in_buffer)
+{
+	Buffer xml("<Hello attr=a/b/>");
+	xml.reader.to_next_tag();
+	EQUAL(xml.reader.get_attribute("attr"), "a/b");
+	ASSERT(xml.reader.has_attribute("/"));
+}
+
+TEST(should_consider_heading_slash_as_a_part_of_closing_tag_in_buffer)
+{
+	Buffer xml("</Hello>");
+	EQUAL(xml.reader.to_next_tag().str(), "/Hello");
+	ASSERT(xml.reader.get_attributes().empty());
+}
+
+TEST(should_convert_entities_only_when_content_is_requested)
+{
+	Buffer xml("foo &gt;&#62; bar&#8230; &unknownentity; &amp<tag>");
+	xml.reader.to_next_tag();
+	EQUAL(xml.reader.get_raw_content().str(), "foo &gt;&#62; bar&#8230; &unknownentity; &amp");
+	EQUAL(xml.reader.get_current_content(), "foo >> bar… &unknownentity; &amp");
+}
+
+TEST(should_throw_exception_if_xml_file_cannot_be_opened)
+{
+	CATCH(XMLBufferReader("chthon_test_missing.xml"), const XMLBufferReader::Exception & e) {
+		EQUAL(e.message, "Error: cannot open XML file \"chthon_test_missing.xml\".");
+	}
+}
+
+}
+
+SUITE(xml_push) {
+
+struct EventRecorder : XMLPushParser {
+	std::string events;
+	bool last_was_content;
+	EventRecorder(size_t max_buffer_size = 65536) : XMLPushParser(max_buffer_size), last_was_content(false) {}
+	virtual void on_tag(const Chthon::StringView & tag, const std::vector<Chthon::XMLAttribute> & attributes)
+	{
+		events += "<" + tag.str();
+		foreach(const Chthon::XMLAttribute & attribute, attributes) {
+			events += " " + attribute.name.str() + "=" + attribute.unescaped();
+		}
+		events += ">";
+		last_was_content = false;
+	}
+	virtual void on_content(const std::string & content)
+	{
+		if(last_was_content) {
+			events.insert(events.size() - 1, content);
+		} else {
+			events += "[" + content + "]";
+		}
+		last_was_content = true;
+	}
+	void feed_by_chunks(const std::string & text, size_t chunk_size)
+	{
+		for(size_t pos = 0; pos < text.size(); pos += chunk_size) {
+			feed(text.data() + pos, std::min(chunk_size, text.size() - pos));
+		}
+		finish();
+	}
+};
+
+TEST(should_emit_events_for_whole_input)
+{
+	EventRecorder parser;
+	parser.feed_by_chunks("text<Hello attr=\"value\"/>more</Hello>", 1000);
+	EQUAL(parser.events, "[text]<Hello attr=value /=>[more]</Hello>");
+}
+
+TEST(should_emit_same_events_for_input_split_at_any_point)
+{
+	const std::string text = "A &amp; B<a x=\"1 > \\\" 2\" y=3>&#x41;&lt;c&gt;</a><b/>tail &quot;";
+	EventRecorder whole;
+	whole.feed_by_chunks(text, text.size());
+	EQUAL(whole.events, "[A & B]<a x=1 > \" 2 y=3>[A<c>]</a><b /=>[tail \"]");
+	for(size_t chunk_size = 1; chunk_size < text.size(); ++chunk_size) {
+		EventRecorder parser;
+		parser.feed_by_chunks(text, chunk_size);
+		EQUAL(parser.events, whole.events);
+	}
+}
+
+TEST(should_emit_tag_as_soon_as_it_is_complete)
+{
+	EventRecorder parser;
+	parser.feed("<Hel", 4);
+	EQUAL(parser.events, "");
+	EQUAL(parser.buffered(), 4u);
+	parser.feed("lo>con", 6);
+	EQUAL(parser.events, "<Hello>[con]");
+	EQUAL(parser.buffered(), 0u);
+	parser.feed("tent &am", 8);
+	EQUAL(parser.events, "<Hello>[content ]");
+	EQUAL(parser.buffered(), 3u);
+	parser.feed("p;", 2);
+	EQUAL(parser.events, "<Hello>[content &]");
+}
+
+TEST(should_report_unterminated_tag_on_finish)
+{
+	EventRecorder parser;
+	parser.feed("text<Hello attr", 15);
+	EQUAL(parser.events, "[text]");
+	parser.finish();
+	EQUAL(parser.events, "[text]<Hello attr=>");
+	EQUAL(parser.buffered(), 0u);
+}
+
+TEST(should_keep_buffer_bounded)
+{
+	EventRecorder parser(16);
+	std::string content(100000, 'a');
+	parser.feed(content.data(), content.size());
+	EQUAL(parser.buffered(), 0u);
+	CATCH(parser.feed("<Hello attribute=value", 22), const XMLPushParser::Exception & e) {
+		EQUAL(e.message, "Error: XML tag is too long (more than 16 bytes).");
+	}
+}
+
+TEST(should_not_buffer_more_than_limit_of_long_tag)
+{
+	EventRecorder parser(16);
+	std::string tag = "<" + std::string(100000, 'a');
+	CATCH(parser.feed(tag.data(), tag.size()), const XMLPushParser::Exception & e) {
+		EQUAL(e.message, "Error: XML tag is too long (more than 16 bytes).");
+	}
+	EQUAL(parser.buffered(), 16u);
+}
+
+}